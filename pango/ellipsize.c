@@ -31,6 +31,7 @@
 typedef struct _EllipsizeState EllipsizeState;
 typedef struct _RunInfo        RunInfo;
 typedef struct _LineIter       LineIter;
+typedef struct _ClusterInfo    ClusterInfo;
 
 
 /* Overall, the way we ellipsize is we grow a "gap" out from an original
@@ -61,6 +62,12 @@ typedef struct _LineIter       LineIter;
  *
  * All computations are done using logical order; the ellipsization
  * process occurs before the runs are ordered into visual order.
+ *
+ * Since which end we grow doesn't depend on the ellipsis, the whole
+ * sequence of gaps can be computed upfront from the cluster positions.
+ * We then binary search it for the first gap that makes the line fit,
+ * and only step through the gaps one by one to keep the ellipsis shape
+ * up-to-date.
  */
 
 /* Keeps information about a single run */
@@ -69,6 +76,7 @@ struct _RunInfo
   PangoGlyphItem *run;
   int start_offset;		/* Character offset of run start */
   int width;			/* Width of run in Pango units */
+  int first_cluster;		/* Index of the first cluster of the run */
 };
 
 /* Iterator to a position within the ellipsized line */
@@ -78,6 +86,16 @@ struct _LineIter
   int run_index;
 };
 
+/* Keeps information about a single cluster */
+struct _ClusterInfo
+{
+  LineIter iter;		/* Iterator pointing to the cluster */
+  int x;			/* x position of the cluster start, in Pango units */
+  int width;			/* Width of the cluster in Pango units */
+  guint starts_boundary : 1;	/* Whether there is an ellipsization boundary before it */
+  guint ends_boundary : 1;	/* Whether there is an ellipsization boundary after it */
+};
+
 /* State of ellipsization process */
 struct _EllipsizeState
 {
@@ -87,6 +105,9 @@ struct _EllipsizeState
   RunInfo *run_info;		/* Array of information about each run */
   int n_runs;
 
+  ClusterInfo *clusters;	/* Array of information about each cluster */
+  int n_clusters;
+
   int total_width;		/* Original width of line in Pango units */
   int gap_center;		/* Goal for center of gap */
 
@@ -149,6 +170,9 @@ init_state (EllipsizeState  *state,
       start_offset += run->item->num_chars;
     }
 
+  state->clusters = NULL;
+  state->n_clusters = 0;
+
   state->ellipsis_run = NULL;
   state->ellipsis_is_cjk = FALSE;
   state->line_start_attr = NULL;
@@ -166,6 +190,7 @@ free_state (EllipsizeState *state)
   if (state->gap_start_attr)
     pango_attr_iterator_destroy (state->gap_start_attr);
   g_free (state->run_info);
+  g_free (state->clusters);
 }
 
 /* Computes the width of a single cluster
@@ -214,28 +239,6 @@ line_iter_next_cluster (EllipsizeState *state,
   return TRUE;
 }
 
-/* Move backward one cluster. Returns %FALSE if we were already at the end
- */
-static gboolean
-line_iter_prev_cluster (EllipsizeState *state,
-			LineIter       *iter)
-{
-  if (!pango_glyph_item_iter_prev_cluster (&iter->run_iter))
-    {
-      if (iter->run_index == 0)
-	return FALSE;
-      else
-	{
-	  iter->run_index--;
-	  pango_glyph_item_iter_init_end (&iter->run_iter,
-					  state->run_info[iter->run_index].run,
-					  state->layout->text);
-	}
-    }
-
-  return TRUE;
-}
-
 /*
  * An ellipsization boundary is defined by two things
  *
@@ -275,6 +278,52 @@ ends_at_ellipsization_boundary (EllipsizeState *state,
   return state->layout->log_attrs[run_info->start_offset + iter->run_iter.end_char + 1].is_cursor_position;
 }
 
+/* Collects the positions and boundaries of all clusters in the line,
+ * so we don't need to walk the glyph strings again while searching
+ * for the gap.
+ */
+static void
+init_clusters (EllipsizeState *state)
+{
+  LineIter iter;
+  int n_allocated;
+  int x;
+
+  n_allocated = 16;
+  state->clusters = g_new (ClusterInfo, n_allocated);
+  state->n_clusters = 0;
+
+  iter.run_index = 0;
+  pango_glyph_item_iter_init_start (&iter.run_iter, state->run_info[0].run, state->layout->text);
+  state->run_info[0].first_cluster = 0;
+
+  x = 0;
+  do
+    {
+      ClusterInfo *cluster;
+
+      if (state->n_clusters == n_allocated)
+        {
+          n_allocated *= 2;
+          state->clusters = g_renew (ClusterInfo, state->clusters, n_allocated);
+        }
+
+      if (iter.run_index > 0 &&
+          iter.run_index != state->clusters[state->n_clusters - 1].iter.run_index)
+        state->run_info[iter.run_index].first_cluster = state->n_clusters;
+
+      cluster = &state->clusters[state->n_clusters++];
+      cluster->iter = iter;
+      cluster->x = x;
+      cluster->width = get_cluster_width (&iter);
+      cluster->starts_boundary = starts_at_ellipsization_boundary (state, &iter);
+      cluster->ends_boundary = ends_at_ellipsization_boundary (state, &iter);
+
+      x += cluster->width;
+    }
+  while (line_iter_next_cluster (state, &iter));
+}
+
 /* Helper function to re-itemize a string of text
  */
 static PangoItem *
@@ -477,16 +526,30 @@ update_ellipsis_shape (EllipsizeState *state)
     shape_ellipsis (state);
 }
 
-/* Computes the position of the gap center and finds the smallest span containing it
+/* Points the gap at the clusters @start and @end, inclusive
  */
 static void
-find_initial_span (EllipsizeState *state)
+set_gap (EllipsizeState *state,
+         int             start,
+         int             end)
 {
-  PangoGlyphItem *glyph_item;
-  PangoGlyphItemIter *run_iter;
-  gboolean have_cluster;
-  int i;
+  state->gap_start_iter = state->clusters[start].iter;
+  state->gap_start_x = state->clusters[start].x;
+  state->gap_end_iter = state->clusters[end].iter;
+  state->gap_end_x = state->clusters[end].x + state->clusters[end].width;
+}
+
+/* Computes the position of the gap center and finds the smallest span
+ * containing it. Returns the first and last cluster of the span.
+ */
+static void
+find_initial_span (EllipsizeState *state,
+                   int            *span_start,
+                   int            *span_end)
+{
+  int i, c;
   int x;
+  int cluster_end;
   int cluster_width;
 
   switch (state->layout->ellipsize)
@@ -524,16 +587,11 @@ find_initial_span (EllipsizeState *state)
 
   /* Find the cluster containing the gap center
    */
-  state->gap_start_iter.run_index = i;
-  run_iter = &state->gap_start_iter.run_iter;
-  glyph_item = state->run_info[i].run;
-
+  cluster_end = i + 1 < state->n_runs ? state->run_info[i + 1].first_cluster : state->n_clusters;
   cluster_width = 0;		/* Quiet GCC, the line must have at least one cluster */
-  for (have_cluster = pango_glyph_item_iter_init_start (run_iter, glyph_item, state->layout->text);
-       have_cluster;
-       have_cluster = pango_glyph_item_iter_next_cluster (run_iter))
+  for (c = state->run_info[i].first_cluster; c < cluster_end; c++)
     {
-      cluster_width = get_cluster_width (&state->gap_start_iter);
+      cluster_width = state->clusters[c].width;
 
       if (x + cluster_width > state->gap_center)
 	break;
@@ -541,92 +599,230 @@ find_initial_span (EllipsizeState *state)
       x += cluster_width;
     }
 
-  if (!have_cluster)	/* Last cluster is a closed interval, so back off one cluster */
-    x -= cluster_width;
+  if (c == cluster_end)	/* Last cluster is a closed interval, so back off one cluster */
+    c--;
+
+  /* Expand the gap to a full span
+   */
+  *span_start = c;
+  while (!state->clusters[*span_start].starts_boundary)
+    (*span_start)--;
 
-  state->gap_end_iter = state->gap_start_iter;
+  *span_end = c;
+  while (!state->clusters[*span_end].ends_boundary)
+    (*span_end)++;
+}
 
-  state->gap_start_x = x;
-  state->gap_end_x = x + cluster_width;
+/* The gaps we go through while growing the gap one span at a time.
+ * Gap k covers the clusters from start[k] to end[k], inclusive.
+ */
+typedef struct {
+  int *start;
+  int *end;
+  int n_gaps;
+  gboolean monotonic;	/* Whether each gap is at least as wide as the previous one */
+} GapSequence;
+
+static inline int
+gap_width (EllipsizeState *state,
+           GapSequence    *gaps,
+           int             k)
+{
+  ClusterInfo *end = &state->clusters[gaps->end[k]];
 
-  /* Expand the gap to a full span
+  return end->x + end->width - state->clusters[gaps->start[k]].x;
+}
+
+/* Computes all the gaps, starting from the given span. At each step,
+ * we remove one span from the start or end of the gap. In the case
+ * where we could remove a span from either end of the gap, we look at
+ * which causes the smaller increase in the
+ * MAX (gap_end - gap_center, gap_start - gap_center)
+ */
+static void
+compute_gaps (EllipsizeState *state,
+              int             span_start,
+              int             span_end,
+              GapSequence    *gaps)
+{
+  ClusterInfo *clusters = state->clusters;
+  int n = state->n_clusters;
+  int *prev_span;
+  int *next_span;
+  int i, last;
+
+  /* The start of the span before each cluster, and the end of the span
+   * after it. Spans consist of at least one cluster with a width, and
+   * end at ellipsization boundaries. We never go beyond the line ends.
    */
-  while (!starts_at_ellipsization_boundary (state, &state->gap_start_iter))
+  prev_span = g_new (int, n);
+  next_span = g_new (int, n);
+
+  last = 0;
+  for (i = 0; i < n; i++)
     {
-      line_iter_prev_cluster (state, &state->gap_start_iter);
-      state->gap_start_x -= get_cluster_width (&state->gap_start_iter);
+      prev_span[i] = last;
+      if (clusters[i].starts_boundary && clusters[i].width != 0)
+        last = i;
     }
 
-  while (!ends_at_ellipsization_boundary (state, &state->gap_end_iter))
+  last = n - 1;
+  for (i = n - 1; i >= 0; i--)
     {
-      line_iter_next_cluster (state, &state->gap_end_iter);
-      state->gap_end_x += get_cluster_width (&state->gap_end_iter);
+      next_span[i] = last;
+      if (clusters[i].ends_boundary && clusters[i].width != 0)
+        last = i;
     }
 
-  update_ellipsis_shape (state);
+  /* Every gap contains at least one more cluster than the previous one */
+  gaps->start = g_new (int, n);
+  gaps->end = g_new (int, n);
+  gaps->start[0] = span_start;
+  gaps->end[0] = span_end;
+  gaps->n_gaps = 1;
+  gaps->monotonic = TRUE;
+
+  while (TRUE)
+    {
+      int start = gaps->start[gaps->n_gaps - 1];
+      int end = gaps->end[gaps->n_gaps - 1];
+      int gap_start_x = clusters[start].x;
+      int gap_end_x = clusters[end].x + clusters[end].width;
+      int new_start = prev_span[start];
+      int new_end = next_span[end];
+      int new_gap_start_x = clusters[new_start].x;
+      int new_gap_end_x = clusters[new_end].x + clusters[new_end].width;
+
+      if (gap_end_x == new_gap_end_x && gap_start_x == new_gap_start_x)
+        break;
+
+      if (gap_end_x == new_gap_end_x ||
+          (gap_start_x != new_gap_start_x &&
+           state->gap_center - new_gap_start_x < new_gap_end_x - state->gap_center))
+        {
+          gaps->start[gaps->n_gaps] = new_start;
+          gaps->end[gaps->n_gaps] = end;
+        }
+      else
+        {
+          gaps->start[gaps->n_gaps] = start;
+          gaps->end[gaps->n_gaps] = new_end;
+        }
+
+      gaps->n_gaps++;
+
+      if (gap_width (state, gaps, gaps->n_gaps - 1) < gap_width (state, gaps, gaps->n_gaps - 2))
+        gaps->monotonic = FALSE;
+    }
+
+  g_free (prev_span);
+  g_free (next_span);
 }
 
-/* Removes one run from the start or end of the gap. Returns FALSE
- * if there's nothing left to remove in either direction.
+static inline gboolean
+gap_fits (EllipsizeState *state,
+          GapSequence    *gaps,
+          int             k,
+          int             ellipsis_width,
+          int             goal_width)
+{
+  return state->total_width - gap_width (state, gaps, k) + ellipsis_width <= goal_width;
+}
+
+/* Returns the first gap at or after @first that makes the line fit
+ * with the given ellipsis width, or gaps->n_gaps if there is none
  */
-static gboolean
-remove_one_span (EllipsizeState *state)
+static int
+find_first_fit (EllipsizeState *state,
+                GapSequence    *gaps,
+                int             first,
+                int             ellipsis_width,
+                int             goal_width)
 {
-  LineIter new_gap_start_iter;
-  LineIter new_gap_end_iter;
-  int new_gap_start_x;
-  int new_gap_end_x;
-  int width;
+  int lo, hi;
 
-  /* Find one span backwards and forward from the gap
-   */
-  new_gap_start_iter = state->gap_start_iter;
-  new_gap_start_x = state->gap_start_x;
-  do
+  if (!gaps->monotonic)
     {
-      if (!line_iter_prev_cluster (state, &new_gap_start_iter))
-	break;
-      width = get_cluster_width (&new_gap_start_iter);
-      new_gap_start_x -= width;
+      for (lo = first; lo < gaps->n_gaps; lo++)
+        if (gap_fits (state, gaps, lo, ellipsis_width, goal_width))
+          break;
+
+      return lo;
     }
-  while (!starts_at_ellipsization_boundary (state, &new_gap_start_iter) ||
-	 width == 0);
 
-  new_gap_end_iter = state->gap_end_iter;
-  new_gap_end_x = state->gap_end_x;
-  do
+  lo = first;
+  hi = gaps->n_gaps;
+  while (lo < hi)
     {
-      if (!line_iter_next_cluster (state, &new_gap_end_iter))
-	break;
-      width = get_cluster_width (&new_gap_end_iter);
-      new_gap_end_x += width;
+      int mid = lo + (hi - lo) / 2;
+
+      if (gap_fits (state, gaps, mid, ellipsis_width, goal_width))
+        hi = mid;
+      else
+        lo = mid + 1;
     }
-  while (!ends_at_ellipsization_boundary (state, &new_gap_end_iter) ||
-	 width == 0);
 
-  if (state->gap_end_x == new_gap_end_x && state->gap_start_x == new_gap_start_x)
-    return FALSE;
+  return lo;
+}
 
-  /* In the case where we could remove a span from either end of the
-   * gap, we look at which causes the smaller increase in the
-   * MAX (gap_end - gap_center, gap_start - gap_center)
-   */
-  if (state->gap_end_x == new_gap_end_x ||
-      (state->gap_start_x != new_gap_start_x &&
-       state->gap_center - new_gap_start_x < new_gap_end_x - state->gap_center))
-    {
-      state->gap_start_iter = new_gap_start_iter;
-      state->gap_start_x = new_gap_start_x;
+/* Finds the smallest gap that makes the line fit, or the largest
+ * gap if none does, and points the state at it.
+ *
+ * The ellipsis is shaped according to the start of the gap, so its
+ * width can change whenever the start moves. We binary search for a
+ * gap with the current ellipsis width, then walk the start positions
+ * up to that gap to update the ellipsis as it would have been when
+ * growing the gap one span at a time. If it changes on the way, we
+ * continue the search from there.
+ */
+static void
+find_gap (EllipsizeState *state,
+          int             goal_width)
+{
+  GapSequence gaps;
+  int span_start, span_end;
+  int k, j;
 
-      update_ellipsis_shape (state);
-    }
-  else
+  find_initial_span (state, &span_start, &span_end);
+  compute_gaps (state, span_start, span_end, &gaps);
+
+  set_gap (state, gaps.start[0], gaps.end[0]);
+  update_ellipsis_shape (state);
+
+  k = 0;
+  while (TRUE)
     {
-      state->gap_end_iter = new_gap_end_iter;
-      state->gap_end_x = new_gap_end_x;
+      int ellipsis_width = state->ellipsis_width;
+      int fit;
+
+      fit = find_first_fit (state, &gaps, k, ellipsis_width, goal_width);
+      fit = MIN (fit, gaps.n_gaps - 1);
+
+      for (j = k + 1; j <= fit; j++)
+        {
+          if (gaps.start[j] == gaps.start[j - 1])
+            continue;
+
+          set_gap (state, gaps.start[j], gaps.end[j]);
+          update_ellipsis_shape (state);
+
+          if (state->ellipsis_width != ellipsis_width)
+            break;
+        }
+
+      if (j > fit)
+        {
+          k = fit;
+          break;
+        }
+
+      k = j;
     }
 
-  return TRUE;
+  set_gap (state, gaps.start[k], gaps.end[k]);
+
+  g_free (gaps.start);
+  g_free (gaps.end);
 }
 
 /* Fixes up the properties of the ellipsis run once we've determined the final extents
@@ -759,13 +955,8 @@ _pango_layout_line_ellipsize (PangoLayoutLine *line,
   if (state.total_width <= goal_width)
     goto out;
 
-  find_initial_span (&state);
-
-  while (current_width (&state) > goal_width)
-    {
-      if (!remove_one_span (&state))
-	break;
-    }
+  init_clusters (&state);
+  find_gap (&state, goal_width);
 
   fixup_ellipsis_run (&state, MAX (goal_width - current_width (&state), 0));
 
@@ -1761,6 +1761,22 @@ pango_font_default_get_matrix (PangoFont   *font,
   *matrix = (PangoMatrix) PANGO_MATRIX_INIT;
 }
 
+static void
+pango_font_default_get_glyphs_extents (PangoFont            *font,
+                                       const PangoGlyphInfo *glyphs,
+                                       int                   n_glyphs,
+                                       PangoRectangle       *ink_rects,
+                                       PangoRectangle       *logical_rects)
+{
+  PangoFontClass *class = PANGO_FONT_GET_CLASS (font);
+  int i;
+
+  for (i = 0; i < n_glyphs; i++)
+    class->get_glyph_extents (font, glyphs[i].glyph,
+                              ink_rects ? &ink_rects[i] : NULL,
+                              logical_rects ? &logical_rects[i] : NULL);
+}
+
 static void
 pango_font_class_init (PangoFontClass *class G_GNUC_UNUSED)
 {
@@ -1777,6 +1793,7 @@ pango_font_class_init (PangoFontClass *class G_GNUC_UNUSED)
   pclass->has_char = pango_font_default_has_char;
   pclass->get_face = pango_font_default_get_face;
   pclass->get_matrix = pango_font_default_get_matrix;
+  pclass->get_glyphs_extents = pango_font_default_get_glyphs_extents;
 }
 
 static void
@@ -1916,6 +1933,44 @@ pango_font_get_glyph_extents  (PangoFont      *font,
   PANGO_FONT_GET_CLASS (font)->get_glyph_extents (font, glyph, ink_rect, logical_rect);
 }
 
+/*< private >
+ * pango_font_get_glyphs_extents:
+ * @font: (nullable): a `PangoFont`
+ * @glyphs: (array length=n_glyphs): the glyphs
+ * @n_glyphs: the number of glyphs
+ * @ink_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   rectangles used to store the extents of the glyphs as drawn
+ * @logical_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   rectangles used to store the logical extents of the glyphs
+ *
+ * Gets the extents of many glyphs at once.
+ *
+ * This is the same as calling [method@Pango.Font.get_glyph_extents]
+ * for each of the glyphs, but lets font backends avoid the per-glyph
+ * overhead.
+ */
+void
+pango_font_get_glyphs_extents (PangoFont            *font,
+                               const PangoGlyphInfo *glyphs,
+                               int                   n_glyphs,
+                               PangoRectangle       *ink_rects,
+                               PangoRectangle       *logical_rects)
+{
+  int i;
+
+  if (G_UNLIKELY (!font))
+    {
+      for (i = 0; i < n_glyphs; i++)
+        pango_font_get_glyph_extents (NULL, glyphs[i].glyph,
+                                      ink_rects ? &ink_rects[i] : NULL,
+                                      logical_rects ? &logical_rects[i] : NULL);
+      return;
+    }
+
+  PANGO_FONT_GET_CLASS_PRIVATE (font)->get_glyphs_extents (font, glyphs, n_glyphs,
+                                                           ink_rects, logical_rects);
+}
+
 /**
  * pango_font_get_metrics:
  * @font: (nullable): a `PangoFont`
@@ -2042,6 +2097,106 @@ pango_font_get_hb_font (PangoFont *font)
   return priv->hb_font;
 }
 
+static int
+get_nominal_advance (PangoFont *font,
+                     hb_font_t *hb_font,
+                     gunichar   wc)
+{
+  hb_codepoint_t glyph;
+  PangoRectangle logical;
+
+  if (!hb_font_get_nominal_glyph (hb_font, wc, &glyph))
+    return -1;
+
+  pango_font_get_glyph_extents (font, glyph, NULL, &logical);
+
+  /* Layouts round glyph positions by default */
+  return PANGO_UNITS_ROUND (logical.width);
+}
+
+/* The xAvgCharWidth field of the OS/2 table, scaled to the font */
+static int
+get_average_char_width (hb_font_t *hb_font)
+{
+  hb_face_t *face = hb_font_get_face (hb_font);
+  hb_blob_t *blob;
+  const char *data;
+  unsigned int length;
+  int width = 0;
+
+  blob = hb_face_reference_table (face, HB_TAG ('O', 'S', '/', '2'));
+  data = hb_blob_get_data (blob, &length);
+
+  if (length >= 4)
+    {
+      gint16 avg_width = (gint16) (((guint8) data[2] << 8) | (guint8) data[3]);
+      int x_scale, y_scale;
+
+      hb_font_get_scale (hb_font, &x_scale, &y_scale);
+      width = (gint64) avg_width * x_scale / hb_face_get_upem (face);
+    }
+
+  hb_blob_destroy (blob);
+
+  return MAX (width, 0);
+}
+
+/*
+ * pango_font_get_approximate_widths:
+ * @font: a `PangoFont`
+ * @sample_str: the sample string of a language
+ * @char_width: (out): return location for the approximate character width
+ * @digit_width: (out): return location for the approximate digit width
+ *
+ * Computes the approximate character and digit widths for
+ * `PangoFontMetrics` from the advances of the nominal glyphs
+ * of @sample_str and of the digits, without laying them out.
+ *
+ * Characters that the font does not cover are ignored. If it
+ * covers none of them, the average character width from the
+ * OS/2 table is used.
+ */
+void
+pango_font_get_approximate_widths (PangoFont  *font,
+                                   const char *sample_str,
+                                   int        *char_width,
+                                   int        *digit_width)
+{
+  hb_font_t *hb_font = pango_font_get_hb_font (font);
+  const char *p;
+  int width = 0;
+  int n_cells = 0;
+  int max_digit_width = 0;
+  gunichar wc;
+
+  for (p = sample_str; *p; p = g_utf8_next_char (p))
+    {
+      int cells, advance;
+
+      wc = g_utf8_get_char (p);
+      cells = pango_unichar_width (wc);
+      if (cells == 0)
+        continue;
+
+      advance = get_nominal_advance (font, hb_font, wc);
+      if (advance < 0)
+        continue;
+
+      width += advance;
+      n_cells += cells;
+    }
+
+  for (wc = '0'; wc <= '9'; wc++)
+    max_digit_width = MAX (max_digit_width, get_nominal_advance (font, hb_font, wc));
+
+  if (n_cells > 0)
+    *char_width = width / n_cells;
+  else
+    *char_width = get_average_char_width (hb_font);
+
+  *digit_width = max_digit_width > 0 ? max_digit_width : *char_width;
+}
+
 G_DEFINE_BOXED_TYPE (PangoFontMetrics, pango_font_metrics,
                      pango_font_metrics_ref,
                      pango_font_metrics_unref);
@@ -22,6 +22,8 @@
 
 #include "gtkjsonprinterprivate.h"
 
+#include <math.h>
+
 typedef struct _GtkJsonBlock GtkJsonBlock;
 
 typedef enum {
@@ -36,10 +38,16 @@ struct _GtkJsonBlock
   gsize n_elements; /* number of elements already written */
 };
 
+/* Output is collected here and handed to the write func in
+ * large chunks instead of one call per token.
+ */
+#define GTK_JSON_PRINTER_BUFFER_SIZE 4096
+
 struct _GtkJsonPrinter
 {
   GtkJsonPrinterFlags flags;
   char *indentation;
+  gsize indentation_len;
 
   GtkJsonPrinterWriteFunc write_func;
   gpointer user_data;
@@ -49,6 +57,9 @@ struct _GtkJsonPrinter
   GtkJsonBlock *blocks; /* blocks array */
   GtkJsonBlock *blocks_end; /* blocks array */
   GtkJsonBlock blocks_preallocated[128]; /* preallocated */
+
+  gsize buffer_len;
+  char buffer[GTK_JSON_PRINTER_BUFFER_SIZE];
 };
 
 static void
@@ -85,6 +96,64 @@ gtk_json_printer_pop_block (GtkJsonPrinter *self)
   self->block--;
 }
 
+static void
+gtk_json_printer_flush (GtkJsonPrinter *self)
+{
+  if (self->buffer_len == 0)
+    return;
+
+  self->buffer[self->buffer_len] = '\0';
+  self->write_func (self, self->buffer, self->user_data);
+  self->buffer_len = 0;
+}
+
+static void
+gtk_json_printer_write_len (GtkJsonPrinter *self,
+                            const char     *s,
+                            gsize           len)
+{
+  /* Keep room for the terminating nul */
+  if (G_LIKELY (self->buffer_len + len < GTK_JSON_PRINTER_BUFFER_SIZE))
+    {
+      memcpy (self->buffer + self->buffer_len, s, len);
+      self->buffer_len += len;
+      return;
+    }
+
+  while (len > 0)
+    {
+      gsize n = MIN (len, GTK_JSON_PRINTER_BUFFER_SIZE - 1 - self->buffer_len);
+
+      memcpy (self->buffer + self->buffer_len, s, n);
+      self->buffer_len += n;
+      s += n;
+      len -= n;
+
+      if (self->buffer_len == GTK_JSON_PRINTER_BUFFER_SIZE - 1)
+        gtk_json_printer_flush (self);
+    }
+}
+
+static inline void
+gtk_json_printer_write_c (GtkJsonPrinter *self,
+                          char            c)
+{
+  if (G_UNLIKELY (self->buffer_len + 1 >= GTK_JSON_PRINTER_BUFFER_SIZE))
+    gtk_json_printer_flush (self);
+
+  self->buffer[self->buffer_len++] = c;
+}
+
+/* Values at the toplevel complete the document, so make sure
+ * the write func has seen all of it.
+ */
+static void
+gtk_json_printer_end_value (GtkJsonPrinter *self)
+{
+  if (self->block->type == GTK_JSON_BLOCK_TOPLEVEL)
+    gtk_json_printer_flush (self);
+}
+
 GtkJsonPrinter *
 gtk_json_printer_new (GtkJsonPrinterWriteFunc write_func,
                       gpointer                data,
@@ -98,6 +167,7 @@ gtk_json_printer_new (GtkJsonPrinterWriteFunc write_func,
 
   self->flags = 0;
   self->indentation = g_strdup ("  ");
+  self->indentation_len = 2;
 
   self->write_func = write_func;
   self->user_data = data;
@@ -116,6 +186,8 @@ gtk_json_printer_free (GtkJsonPrinter *self)
 {
   g_return_if_fail (self != NULL);
 
+  gtk_json_printer_flush (self);
+
   g_free (self->indentation);
 
   if (self->user_destroy)
@@ -174,6 +246,7 @@ gtk_json_printer_set_indentation (GtkJsonPrinter *self,
   self->indentation = g_malloc (amount + 1);
   memset (self->indentation, ' ', amount);
   self->indentation[amount] = 0;
+  self->indentation_len = amount;
 }
 
 gsize
@@ -181,65 +254,87 @@ gtk_json_printer_get_indentation (GtkJsonPrinter *self)
 {
   g_return_val_if_fail (self != NULL, 2);
 
-  return strlen (self->indentation);
+  return self->indentation_len;
 }
 
 static void
 gtk_json_printer_write (GtkJsonPrinter *self,
                         const char     *s)
 {
-  self->write_func (self, s, self->user_data);
+  gtk_json_printer_write_len (self, s, strlen (s));
 }
 
-static char *
-gtk_json_printer_escape_string (GtkJsonPrinter *self,
+/* Whether a byte can be copied into a string literal as-is */
+static inline gboolean
+gtk_json_printer_is_plain (GtkJsonPrinter *self,
+                           guchar          c)
+{
+  if (c < 0x20 || c == '"' || c == '\\')
+    return FALSE;
+
+  if (c >= 0x80)
+    return !gtk_json_printer_has_flag (self, GTK_JSON_PRINTER_ASCII);
+
+  return TRUE;
+}
+
+static void
+gtk_json_printer_write_escaped (GtkJsonPrinter *self,
                                 const char     *str)
 {
-  GString *string;
+  const char *run;
 
-  string = g_string_new (NULL);
-  string = g_string_append_c (string, '"');
+  gtk_json_printer_write_c (self, '"');
 
-  for (; *str != '\0'; str = g_utf8_next_char (str))
+  while (*str != '\0')
     {
+      /* Copy runs of characters that need no escaping in one go */
+      for (run = str; *str != '\0' && gtk_json_printer_is_plain (self, *str); str++)
+        ;
+
+      if (str > run)
+        gtk_json_printer_write_len (self, run, str - run);
+
+      if (*str == '\0')
+        break;
+
       switch (*str)
         {
           case '"':
-            g_string_append (string, "\\\"");
+            gtk_json_printer_write_len (self, "\\\"", 2);
             break;
           case '\\':
-            g_string_append (string, "\\\\");
+            gtk_json_printer_write_len (self, "\\\\", 2);
             break;
           case '\b':
-            g_string_append (string, "\\b");
+            gtk_json_printer_write_len (self, "\\b", 2);
             break;
           case '\f':
-            g_string_append (string, "\\f");
+            gtk_json_printer_write_len (self, "\\f", 2);
             break;
           case '\n':
-            g_string_append (string, "\\n");
+            gtk_json_printer_write_len (self, "\\n", 2);
             break;
           case '\r':
-            g_string_append (string, "\\r");
+            gtk_json_printer_write_len (self, "\\r", 2);
             break;
           case '\t':
-            g_string_append (string, "\\t");
+            gtk_json_printer_write_len (self, "\\t", 2);
             break;
           default:
-            if ((int) *str < 0x20)
-              {
-                if ((guint) *str < 0x20 || gtk_json_printer_has_flag (self, GTK_JSON_PRINTER_ASCII))
-                  g_string_append_printf (string, "\\u%04x", g_utf8_get_char (str));
-                else
-                  g_string_append_unichar (string, g_utf8_get_char (str));
-              }
-            else
-              g_string_append_c (string, *str);
+            {
+              char buf[16];
+              int len;
+
+              len = g_snprintf (buf, sizeof (buf), "\\u%04x", g_utf8_get_char (str));
+              gtk_json_printer_write_len (self, buf, len);
+            }
         }
+
+      str = g_utf8_next_char (str);
     }
 
-  string = g_string_append_c (string, '"');
-  return g_string_free (string, FALSE);
+  gtk_json_printer_write_c (self, '"');
 }
 
 static void
@@ -250,9 +345,9 @@ gtk_json_printer_newline (GtkJsonPrinter *self)
   if (!gtk_json_printer_has_flag (self, GTK_JSON_PRINTER_PRETTY))
     return;
 
-  gtk_json_printer_write (self, "\n");
+  gtk_json_printer_write_c (self, '\n');
   for (depth = gtk_json_printer_get_depth (self); depth-->0;)
-    gtk_json_printer_write (self, self->indentation);
+    gtk_json_printer_write_len (self, self->indentation, self->indentation_len);
 }
 
 static void
@@ -260,7 +355,7 @@ gtk_json_printer_begin_member (GtkJsonPrinter *self,
                                const char     *name)
 {
   if (gtk_json_printer_get_n_elements (self) > 0)
-    gtk_json_printer_write (self, ",");
+    gtk_json_printer_write_c (self, ',');
   if (self->block->type != GTK_JSON_BLOCK_TOPLEVEL || gtk_json_printer_get_n_elements (self) > 0)
     gtk_json_printer_newline (self);
 
@@ -268,14 +363,33 @@ gtk_json_printer_begin_member (GtkJsonPrinter *self,
 
   if (name)
     {
-      char *escaped = gtk_json_printer_escape_string (self, name);
-      gtk_json_printer_write (self, escaped);
-      g_free (escaped);
+      gtk_json_printer_write_escaped (self, name);
       if (gtk_json_printer_has_flag (self, GTK_JSON_PRINTER_PRETTY))
-        gtk_json_printer_write (self, " : ");
+        gtk_json_printer_write_len (self, " : ", 3);
       else
-        gtk_json_printer_write (self, ":");
+        gtk_json_printer_write_c (self, ':');
+    }
+}
+
+/* Formats @value into the end of @buf and returns the start */
+static char *
+format_integer (char   *buf_end,
+                gint64  value)
+{
+  char *p = buf_end;
+  guint64 v = value < 0 ? - (guint64) value : (guint64) value;
+
+  do
+    {
+      *--p = '0' + v % 10;
+      v /= 10;
     }
+  while (v != 0);
+
+  if (value < 0)
+    *--p = '-';
+
+  return p;
 }
 
 void
@@ -287,7 +401,11 @@ gtk_json_printer_add_boolean (GtkJsonPrinter *self,
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  gtk_json_printer_write (self, value ? "true" : "false");
+  if (value)
+    gtk_json_printer_write_len (self, "true", 4);
+  else
+    gtk_json_printer_write_len (self, "false", 5);
+  gtk_json_printer_end_value (self);
 }
 
 void
@@ -301,8 +419,26 @@ gtk_json_printer_add_number (GtkJsonPrinter *self,
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  g_ascii_dtostr (buf, G_ASCII_DTOSTR_BUF_SIZE, value);
-  gtk_json_printer_write (self, buf);
+
+  /* Most numbers we write are integral, and g_ascii_dtostr()
+   * prints those exactly like integers, so avoid the generic
+   * formatting code for them.
+   */
+  if (value > -1e15 && value < 1e15 &&
+      value == (double) (gint64) value &&
+      (value != 0 || !signbit (value)))
+    {
+      char *end = buf + sizeof (buf);
+      char *start = format_integer (end, (gint64) value);
+      gtk_json_printer_write_len (self, start, end - start);
+    }
+  else
+    {
+      g_ascii_dtostr (buf, G_ASCII_DTOSTR_BUF_SIZE, value);
+      gtk_json_printer_write (self, buf);
+    }
+
+  gtk_json_printer_end_value (self);
 }
 
 void
@@ -310,14 +446,16 @@ gtk_json_printer_add_integer (GtkJsonPrinter *self,
                               const char     *name,
                               int             value)
 {
-  char buf[128];
+  char buf[32];
+  char *start;
 
   g_return_if_fail (self != NULL);
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  g_snprintf (buf, sizeof (buf), "%d", value);
-  gtk_json_printer_write (self, buf);
+  start = format_integer (buf + sizeof (buf), value);
+  gtk_json_printer_write_len (self, start, buf + sizeof (buf) - start);
+  gtk_json_printer_end_value (self);
 }
 
 void
@@ -325,16 +463,13 @@ gtk_json_printer_add_string (GtkJsonPrinter *self,
                              const char     *name,
                              const char     *s)
 {
-  char *escaped;
-
   g_return_if_fail (self != NULL);
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
   g_return_if_fail (s != NULL);
 
   gtk_json_printer_begin_member (self, name);
-  escaped = gtk_json_printer_escape_string (self, s);
-  gtk_json_printer_write (self, escaped);
-  g_free (escaped);
+  gtk_json_printer_write_escaped (self, s);
+  gtk_json_printer_end_value (self);
 }
 
 void
@@ -345,7 +480,8 @@ gtk_json_printer_add_null (GtkJsonPrinter *self,
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  gtk_json_printer_write (self, "null");
+  gtk_json_printer_write_len (self, "null", 4);
+  gtk_json_printer_end_value (self);
 }
 
 void
@@ -356,7 +492,7 @@ gtk_json_printer_start_object (GtkJsonPrinter *self,
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  gtk_json_printer_write (self, "{");
+  gtk_json_printer_write_c (self, '{');
   gtk_json_printer_push_block (self, GTK_JSON_BLOCK_OBJECT);
 }
 
@@ -368,14 +504,14 @@ gtk_json_printer_start_array (GtkJsonPrinter *self,
   g_return_if_fail ((self->block->type == GTK_JSON_BLOCK_OBJECT) == (name != NULL));
 
   gtk_json_printer_begin_member (self, name);
-  gtk_json_printer_write (self, "[");
+  gtk_json_printer_write_c (self, '[');
   gtk_json_printer_push_block (self, GTK_JSON_BLOCK_ARRAY);
 }
 
 void
 gtk_json_printer_end (GtkJsonPrinter *self)
 {
-  const char *bracket;
+  char bracket;
   gboolean empty;
 
   g_return_if_fail (self != NULL);
@@ -383,10 +519,10 @@ gtk_json_printer_end (GtkJsonPrinter *self)
   switch (self->block->type)
     {
     case GTK_JSON_BLOCK_OBJECT:
-      bracket = "}";
+      bracket = '}';
       break;
     case GTK_JSON_BLOCK_ARRAY:
-      bracket = "]";
+      bracket = ']';
       break;
     case GTK_JSON_BLOCK_TOPLEVEL:
     default:
@@ -400,6 +536,6 @@ gtk_json_printer_end (GtkJsonPrinter *self)
     {
       gtk_json_printer_newline (self);
     }
-  gtk_json_printer_write (self, bracket);
+  gtk_json_printer_write_c (self, bracket);
+  gtk_json_printer_end_value (self);
 }
-
@@ -45,9 +45,11 @@ struct _PangoContext
 
   PangoFontMap *font_map;
 
-  PangoFontMetrics *metrics;
+  GQueue metrics_cache; /* Recently used metrics, most recent first */
 
   gboolean round_glyph_positions;
+
+  char *font_options; /* Backend font options as a string, for serialization */
 };
 
 G_END_DECLS
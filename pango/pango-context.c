@@ -70,6 +70,7 @@ pango_context_init (PangoContext *context)
   context->language = pango_language_get_default ();
   context->font_map = NULL;
   context->round_glyph_positions = TRUE;
+  context->font_options = NULL;
 
   context->font_desc = pango_font_description_new ();
   pango_font_description_set_family_static (context->font_desc, "serif");
@@ -88,6 +89,78 @@ pango_context_class_init (PangoContextClass *klass)
   object_class->finalize = pango_context_finalize;
 }
 
+/* The metrics of the most recently used font
+ * descriptions and languages are cached
+ */
+#define N_CACHED_METRICS 8
+
+typedef struct
+{
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoFontMetrics *metrics;
+} MetricsCacheEntry;
+
+static void
+metrics_cache_entry_free (MetricsCacheEntry *entry)
+{
+  pango_font_description_free (entry->desc);
+  pango_font_metrics_unref (entry->metrics);
+  g_slice_free (MetricsCacheEntry, entry);
+}
+
+static PangoFontMetrics *
+metrics_cache_lookup (PangoContext               *context,
+                      const PangoFontDescription *desc,
+                      PangoLanguage              *language)
+{
+  GList *l;
+
+  for (l = context->metrics_cache.head; l; l = l->next)
+    {
+      MetricsCacheEntry *entry = l->data;
+
+      if (entry->language == language &&
+          pango_font_description_equal (entry->desc, desc))
+        {
+          if (l != context->metrics_cache.head)
+            {
+              g_queue_unlink (&context->metrics_cache, l);
+              g_queue_push_head_link (&context->metrics_cache, l);
+            }
+
+          return entry->metrics;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+metrics_cache_insert (PangoContext               *context,
+                      const PangoFontDescription *desc,
+                      PangoLanguage              *language,
+                      PangoFontMetrics           *metrics)
+{
+  MetricsCacheEntry *entry;
+
+  entry = g_slice_new (MetricsCacheEntry);
+  entry->desc = pango_font_description_copy (desc);
+  entry->language = language;
+  entry->metrics = pango_font_metrics_ref (metrics);
+
+  g_queue_push_head (&context->metrics_cache, entry);
+
+  if (context->metrics_cache.length > N_CACHED_METRICS)
+    metrics_cache_entry_free (g_queue_pop_tail (&context->metrics_cache));
+}
+
+static void
+metrics_cache_clear (PangoContext *context)
+{
+  g_queue_clear_full (&context->metrics_cache, (GDestroyNotify) metrics_cache_entry_free);
+}
+
 static void
 pango_context_finalize (GObject *object)
 {
@@ -101,9 +174,9 @@ pango_context_finalize (GObject *object)
   pango_font_description_free (context->font_desc);
   if (context->matrix)
     pango_matrix_free (context->matrix);
+  g_free (context->font_options);
 
-  if (context->metrics)
-    pango_font_metrics_unref (context->metrics);
+  metrics_cache_clear (context);
 
   G_OBJECT_CLASS (pango_context_parent_class)->finalize (object);
 }
@@ -703,10 +776,9 @@ pango_context_get_metrics (PangoContext               *context,
   if (!language)
     language = context->language;
 
-  if (desc == context->font_desc &&
-      language == context->language &&
-      context->metrics != NULL)
-    return pango_font_metrics_ref (context->metrics);
+  metrics = metrics_cache_lookup (context, desc, language);
+  if (metrics)
+    return pango_font_metrics_ref (metrics);
 
   current_fonts = pango_font_map_load_fontset (context->font_map, context, desc, language);
   metrics = get_base_metrics (current_fonts);
@@ -725,9 +797,7 @@ pango_context_get_metrics (PangoContext               *context,
 
   g_object_unref (current_fonts);
 
-  if (desc == context->font_desc &&
-      language == context->language)
-    context->metrics = pango_font_metrics_ref (metrics);
+  metrics_cache_insert (context, desc, language, metrics);
 
   return metrics;
 }
@@ -739,7 +809,7 @@ context_changed (PangoContext *context)
   if (context->serial == 0)
     context->serial++;
 
-  g_clear_pointer (&context->metrics, pango_font_metrics_unref);
+  metrics_cache_clear (context);
 }
 
 /**
@@ -24,6 +24,7 @@
 
 #include <pango/pango-font.h>
 #include <pango/pango-coverage.h>
+#include <pango/pango-glyph.h>
 #include <pango/pango-types.h>
 
 #include <glib-object.h>
@@ -47,6 +48,11 @@ typedef struct {
   PangoFontFace *  (* get_face) (PangoFont *font);
   void             (* get_matrix) (PangoFont   *font,
                                    PangoMatrix *matrix);
+  void             (* get_glyphs_extents) (PangoFont            *font,
+                                           const PangoGlyphInfo *glyphs,
+                                           int                   n_glyphs,
+                                           PangoRectangle       *ink_rects,
+                                           PangoRectangle       *logical_rects);
 } PangoFontClassPrivate;
 
 gboolean pango_font_is_hinted         (PangoFont *font);
@@ -55,6 +61,17 @@ void     pango_font_get_scale_factors (PangoFont *font,
                                        double    *y_scale);
 void     pango_font_get_matrix        (PangoFont   *font,
                                        PangoMatrix *matrix);
+void     pango_font_get_glyphs_extents (PangoFont            *font,
+                                        const PangoGlyphInfo *glyphs,
+                                        int                   n_glyphs,
+                                        PangoRectangle       *ink_rects,
+                                        PangoRectangle       *logical_rects);
+
+PANGO_AVAILABLE_IN_ALL
+void     pango_font_get_approximate_widths (PangoFont  *font,
+                                            const char *sample_str,
+                                            int        *char_width,
+                                            int        *digit_width);
 
 
 G_END_DECLS
@@ -0,0 +1,308 @@
+/* Pango
+ * pango-glyph-export.c: Exporting positioned glyphs of layouts
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include "pango-glyph-export.h"
+#include "pango-renderer.h"
+
+/* PangoExportRenderer is a private renderer that writes
+ * the glyphs and trapezoids it is asked to draw into a
+ * PangoGlyphExport. It relies on the default implementations
+ * of PangoRenderer to transform everything to device space.
+ */
+
+typedef struct _PangoExportRenderer PangoExportRenderer;
+typedef struct _PangoExportRendererClass PangoExportRendererClass;
+
+struct _PangoExportRenderer
+{
+  PangoRenderer parent_instance;
+
+  PangoGlyphExport *buffer;
+  gboolean overflow;
+
+  /* All fonts and colors seen so far, including the
+   * ones that did not fit into the buffer
+   */
+  GPtrArray *fonts;
+  GArray *colors;
+
+  PangoFont *last_font;
+  guint16 last_font_id;
+};
+
+struct _PangoExportRendererClass
+{
+  PangoRendererClass parent_class;
+};
+
+typedef struct {
+  PangoColor color;
+  guint16 alpha;
+} ExportColor;
+
+static GType pango_export_renderer_get_type (void);
+
+G_DEFINE_TYPE (PangoExportRenderer, pango_export_renderer, PANGO_TYPE_RENDERER)
+
+static guint16
+get_font_id (PangoExportRenderer *renderer,
+             PangoFont           *font)
+{
+  PangoGlyphExport *buffer = renderer->buffer;
+  guint i;
+
+  if (font == renderer->last_font)
+    return renderer->last_font_id;
+
+  for (i = 0; i < renderer->fonts->len; i++)
+    {
+      if (g_ptr_array_index (renderer->fonts, i) == font)
+        break;
+    }
+
+  if (i == renderer->fonts->len)
+    {
+      if (i >= G_MAXUINT16)
+        {
+          renderer->overflow = TRUE;
+          return G_MAXUINT16;
+        }
+
+      g_ptr_array_add (renderer->fonts, font);
+
+      if (i < buffer->max_fonts)
+        buffer->fonts[i] = font;
+      else
+        renderer->overflow = TRUE;
+    }
+
+  renderer->last_font = font;
+  renderer->last_font_id = i;
+
+  return i;
+}
+
+static guint16
+get_color_id (PangoExportRenderer *renderer,
+              PangoRenderPart      part)
+{
+  PangoGlyphExport *buffer = renderer->buffer;
+  PangoColor *color;
+  ExportColor c;
+  guint i;
+
+  color = pango_renderer_get_color ((PangoRenderer *) renderer, part);
+  c.alpha = pango_renderer_get_alpha ((PangoRenderer *) renderer, part);
+
+  if (!color && !c.alpha)
+    return PANGO_GLYPH_EXPORT_NO_COLOR;
+
+  if (color)
+    c.color = *color;
+  else
+    c.color.red = c.color.green = c.color.blue = 0;
+
+  for (i = 0; i < renderer->colors->len; i++)
+    {
+      ExportColor *other = &g_array_index (renderer->colors, ExportColor, i);
+
+      if (other->color.red == c.color.red &&
+          other->color.green == c.color.green &&
+          other->color.blue == c.color.blue &&
+          other->alpha == c.alpha)
+        return i;
+    }
+
+  if (i >= PANGO_GLYPH_EXPORT_NO_COLOR)
+    {
+      renderer->overflow = TRUE;
+      return PANGO_GLYPH_EXPORT_NO_COLOR;
+    }
+
+  g_array_append_val (renderer->colors, c);
+
+  if (i < buffer->max_colors)
+    {
+      buffer->colors[i] = c.color;
+      buffer->alphas[i] = c.alpha;
+    }
+  else
+    renderer->overflow = TRUE;
+
+  return i;
+}
+
+static void
+pango_export_renderer_draw_glyph (PangoRenderer *renderer,
+                                  PangoFont     *font,
+                                  PangoGlyph     glyph,
+                                  double         x,
+                                  double         y)
+{
+  PangoExportRenderer *erenderer = (PangoExportRenderer *) renderer;
+  PangoGlyphExport *buffer = erenderer->buffer;
+  guint16 font_id, color_id;
+  guint n;
+
+  if (glyph == PANGO_GLYPH_EMPTY)
+    return;
+
+  font_id = get_font_id (erenderer, font);
+  color_id = get_color_id (erenderer, PANGO_RENDER_PART_FOREGROUND);
+
+  n = buffer->n_glyphs++;
+  if (n >= buffer->max_glyphs)
+    {
+      erenderer->overflow = TRUE;
+      return;
+    }
+
+  buffer->glyphs[n] = glyph;
+  buffer->glyph_fonts[n] = font_id;
+  buffer->glyph_colors[n] = color_id;
+  buffer->glyph_x[n] = x;
+  buffer->glyph_y[n] = y;
+}
+
+static void
+pango_export_renderer_draw_trapezoid (PangoRenderer   *renderer,
+                                      PangoRenderPart  part,
+                                      double           y1_,
+                                      double           x11,
+                                      double           x21,
+                                      double           y2,
+                                      double           x12,
+                                      double           x22)
+{
+  PangoExportRenderer *erenderer = (PangoExportRenderer *) renderer;
+  PangoGlyphExport *buffer = erenderer->buffer;
+  guint16 color_id;
+  double *t;
+  guint n;
+
+  color_id = get_color_id (erenderer, part);
+
+  n = buffer->n_trapezoids++;
+  if (n >= buffer->max_trapezoids)
+    {
+      erenderer->overflow = TRUE;
+      return;
+    }
+
+  t = &buffer->trapezoids[6 * n];
+  t[0] = y1_;
+  t[1] = x11;
+  t[2] = x21;
+  t[3] = y2;
+  t[4] = x12;
+  t[5] = x22;
+
+  buffer->trapezoid_colors[n] = color_id;
+}
+
+static void
+pango_export_renderer_init (PangoExportRenderer *renderer)
+{
+  renderer->fonts = g_ptr_array_new ();
+  renderer->colors = g_array_new (FALSE, FALSE, sizeof (ExportColor));
+}
+
+static void
+pango_export_renderer_finalize (GObject *object)
+{
+  PangoExportRenderer *renderer = (PangoExportRenderer *) object;
+
+  g_ptr_array_unref (renderer->fonts);
+  g_array_unref (renderer->colors);
+
+  G_OBJECT_CLASS (pango_export_renderer_parent_class)->finalize (object);
+}
+
+static void
+pango_export_renderer_class_init (PangoExportRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (klass);
+
+  object_class->finalize = pango_export_renderer_finalize;
+
+  renderer_class->draw_glyph = pango_export_renderer_draw_glyph;
+  renderer_class->draw_trapezoid = pango_export_renderer_draw_trapezoid;
+}
+
+/**
+ * pango_layout_export_glyphs:
+ * @layout: a `PangoLayout`
+ * @x: X position of the left edge of the layout, in Pango units
+ * @y: Y position of the top edge of the layout, in Pango units
+ * @buffer: the `PangoGlyphExport` to fill in
+ *
+ * Writes the positioned glyphs and decorations of @layout
+ * into caller-provided arrays.
+ *
+ * Positions are transformed to device space with the matrix of
+ * the context of @layout, the same way as when drawing @layout
+ * with a `PangoRenderer`. Empty glyphs are left out, glyphs with
+ * `PANGO_GLYPH_UNKNOWN_FLAG` set are included.
+ *
+ * This is meant for compositors that keep their own glyph
+ * caches, and would otherwise need to implement a `PangoRenderer`
+ * to get at the glyphs one run at a time.
+ *
+ * If the arrays of @buffer are too small, the `n_` fields are
+ * still set to the sizes that would be needed, so the call can be
+ * repeated with bigger arrays.
+ *
+ * The fonts in @buffer are owned by @layout, and are only valid as
+ * long as it is not changed.
+ *
+ * Return value: %TRUE if everything fit into @buffer
+ *
+ * Since: 1.52
+ */
+gboolean
+pango_layout_export_glyphs (PangoLayout      *layout,
+                            int               x,
+                            int               y,
+                            PangoGlyphExport *buffer)
+{
+  PangoExportRenderer *renderer;
+  gboolean overflow;
+
+  g_return_val_if_fail (PANGO_IS_LAYOUT (layout), FALSE);
+  g_return_val_if_fail (buffer != NULL, FALSE);
+
+  buffer->n_glyphs = 0;
+  buffer->n_trapezoids = 0;
+
+  renderer = g_object_new (pango_export_renderer_get_type (), NULL);
+  renderer->buffer = buffer;
+
+  pango_renderer_draw_layout ((PangoRenderer *) renderer, layout, x, y);
+
+  buffer->n_fonts = renderer->fonts->len;
+  buffer->n_colors = renderer->colors->len;
+  overflow = renderer->overflow;
+
+  g_object_unref (renderer);
+
+  return !overflow;
+}
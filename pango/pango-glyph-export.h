@@ -0,0 +1,115 @@
+/* Pango
+ * pango-glyph-export.h: Exporting positioned glyphs of layouts
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_GLYPH_EXPORT_H__
+#define __PANGO_GLYPH_EXPORT_H__
+
+#include <pango/pango-layout.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PANGO_GLYPH_EXPORT_NO_COLOR:
+ *
+ * The color index that is used in a `PangoGlyphExport` for glyphs
+ * and decorations that don't have a color set.
+ *
+ * Such glyphs should be drawn in the default color of the compositor.
+ *
+ * Since: 1.52
+ */
+#define PANGO_GLYPH_EXPORT_NO_COLOR G_MAXUINT16
+
+typedef struct _PangoGlyphExport PangoGlyphExport;
+
+/**
+ * PangoGlyphExport:
+ * @n_glyphs: the number of glyphs
+ * @max_glyphs: the size of the glyph arrays
+ * @glyphs: (array length=max_glyphs): glyph ids
+ * @glyph_fonts: (array length=max_glyphs): indices into @fonts
+ * @glyph_colors: (array length=max_glyphs): indices into @colors and
+ *   @alphas, or `PANGO_GLYPH_EXPORT_NO_COLOR`
+ * @glyph_x: (array length=max_glyphs): X positions of the glyph origins,
+ *   in device units
+ * @glyph_y: (array length=max_glyphs): Y positions of the glyph origins,
+ *   in device units
+ * @n_trapezoids: the number of decoration trapezoids
+ * @max_trapezoids: the size of the trapezoid arrays
+ * @trapezoids: (array): 6 values per trapezoid, in device units: the y
+ *   coordinate of the top edge, the x coordinates of its left and right
+ *   ends, the y coordinate of the bottom edge and the x coordinates of
+ *   its left and right ends
+ * @trapezoid_colors: (array length=max_trapezoids): indices into @colors
+ *   and @alphas, or `PANGO_GLYPH_EXPORT_NO_COLOR`
+ * @n_fonts: the number of distinct fonts
+ * @max_fonts: the size of @fonts
+ * @fonts: (array length=max_fonts): the fonts that are used
+ * @n_colors: the number of distinct colors
+ * @max_colors: the size of @colors and @alphas
+ * @colors: (array length=max_colors): the colors that are used
+ * @alphas: (array length=max_colors): the alpha values that go
+ *   with @colors, 0 meaning opaque
+ *
+ * A `PangoGlyphExport` is a flat description of the glyphs and
+ * decorations of a layout, as filled in by [method@Pango.Layout.export_glyphs].
+ *
+ * The arrays are provided by the caller, with their sizes in the
+ * `max_` fields. Pango fills them in and sets the `n_` fields.
+ *
+ * Decorations like underlines and strikethrough lines are exported
+ * as trapezoids with horizontal top and bottom edges, which can
+ * represent them exactly under any transformation.
+ *
+ * Since: 1.52
+ */
+struct _PangoGlyphExport
+{
+  guint n_glyphs;
+  guint max_glyphs;
+  PangoGlyph *glyphs;
+  guint16 *glyph_fonts;
+  guint16 *glyph_colors;
+  double *glyph_x;
+  double *glyph_y;
+
+  guint n_trapezoids;
+  guint max_trapezoids;
+  double *trapezoids;
+  guint16 *trapezoid_colors;
+
+  guint n_fonts;
+  guint max_fonts;
+  PangoFont **fonts;
+
+  guint n_colors;
+  guint max_colors;
+  PangoColor *colors;
+  guint16 *alphas;
+};
+
+PANGO_AVAILABLE_IN_1_52
+gboolean        pango_layout_export_glyphs      (PangoLayout      *layout,
+                                                 int               x,
+                                                 int               y,
+                                                 PangoGlyphExport *buffer);
+
+G_END_DECLS
+
+#endif /* __PANGO_GLYPH_EXPORT_H__ */
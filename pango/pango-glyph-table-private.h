@@ -0,0 +1,189 @@
+/* Pango
+ * pango-glyph-table-private.h: Per-glyph data of fonts
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string.h>
+#include <glib.h>
+#include <pango/pango-glyph.h>
+
+G_BEGIN_DECLS
+
+/* A sparse array of fixed-size entries, indexed by glyph.
+ *
+ * Glyph ids in fonts are small and dense, so they index pages
+ * of PANGO_GLYPH_TABLE_PAGE_SIZE entries directly. Pages are
+ * allocated zeroed, on first use, and never move, so pointers
+ * to entries stay valid until the entry is removed. The few
+ * larger ids, like unknown glyphs, go to an overflow hash table.
+ *
+ * Entries start out zeroed, so users need a field in their
+ * entries that tells whether they have been filled in.
+ *
+ * This is header-only, since it is used by several of the
+ * font backends.
+ */
+typedef struct _PangoGlyphTable PangoGlyphTable;
+
+struct _PangoGlyphTable
+{
+  gsize entry_size;
+  guint n_pages;
+  guint8 **pages;
+  GHashTable *overflow;
+};
+
+#define PANGO_GLYPH_TABLE_PAGE_BITS 8
+#define PANGO_GLYPH_TABLE_PAGE_SIZE (1 << PANGO_GLYPH_TABLE_PAGE_BITS)
+#define PANGO_GLYPH_TABLE_MAX_PAGES 256
+
+static inline void
+pango_glyph_table_init (PangoGlyphTable *table,
+                        gsize            entry_size)
+{
+  table->entry_size = entry_size;
+  table->n_pages = 0;
+  table->pages = NULL;
+  table->overflow = NULL;
+}
+
+/* Calls @func on all entries that may have been filled in */
+static inline void
+pango_glyph_table_foreach (PangoGlyphTable *table,
+                           GFunc            func,
+                           gpointer         data)
+{
+  guint i, j;
+
+  for (i = 0; i < table->n_pages; i++)
+    {
+      if (!table->pages[i])
+        continue;
+
+      for (j = 0; j < PANGO_GLYPH_TABLE_PAGE_SIZE; j++)
+        func (table->pages[i] + j * table->entry_size, data);
+    }
+
+  if (table->overflow)
+    {
+      GHashTableIter iter;
+      gpointer value;
+
+      g_hash_table_iter_init (&iter, table->overflow);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        func (value, data);
+    }
+}
+
+static inline void
+pango_glyph_table_clear (PangoGlyphTable *table)
+{
+  guint i;
+
+  for (i = 0; i < table->n_pages; i++)
+    g_free (table->pages[i]);
+  g_free (table->pages);
+
+  if (table->overflow)
+    g_hash_table_unref (table->overflow);
+
+  pango_glyph_table_init (table, table->entry_size);
+}
+
+/* Returns the entry for @glyph, or %NULL if @create is %FALSE
+ * and no storage has been allocated for it yet
+ */
+static inline gpointer
+pango_glyph_table_lookup (PangoGlyphTable *table,
+                          PangoGlyph       glyph,
+                          gboolean         create)
+{
+  guint page = glyph >> PANGO_GLYPH_TABLE_PAGE_BITS;
+  gpointer entry;
+
+  if (G_LIKELY (page < table->n_pages && table->pages[page]))
+    return table->pages[page] + (glyph & (PANGO_GLYPH_TABLE_PAGE_SIZE - 1)) * table->entry_size;
+
+  if (page < PANGO_GLYPH_TABLE_MAX_PAGES)
+    {
+      if (!create)
+        return NULL;
+
+      if (page >= table->n_pages)
+        {
+          guint n_pages = MIN (MAX (2 * table->n_pages, page + 1), PANGO_GLYPH_TABLE_MAX_PAGES);
+
+          table->pages = g_renew (guint8 *, table->pages, n_pages);
+          memset (table->pages + table->n_pages, 0, (n_pages - table->n_pages) * sizeof (guint8 *));
+          table->n_pages = n_pages;
+        }
+
+      table->pages[page] = g_malloc0 (PANGO_GLYPH_TABLE_PAGE_SIZE * table->entry_size);
+
+      return table->pages[page] + (glyph & (PANGO_GLYPH_TABLE_PAGE_SIZE - 1)) * table->entry_size;
+    }
+
+  if (table->overflow)
+    {
+      entry = g_hash_table_lookup (table->overflow, GUINT_TO_POINTER (glyph));
+      if (entry)
+        return entry;
+    }
+
+  if (!create)
+    return NULL;
+
+  if (!table->overflow)
+    table->overflow = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  entry = g_malloc0 (table->entry_size);
+  g_hash_table_insert (table->overflow, GUINT_TO_POINTER (glyph), entry);
+
+  return entry;
+}
+
+/* Resets the entry for @glyph to zeros, freeing it
+ * if it is in the overflow table
+ */
+static inline void
+pango_glyph_table_remove (PangoGlyphTable *table,
+                          PangoGlyph       glyph)
+{
+  guint page = glyph >> PANGO_GLYPH_TABLE_PAGE_BITS;
+
+  if (page < table->n_pages && table->pages[page])
+    memset (table->pages[page] + (glyph & (PANGO_GLYPH_TABLE_PAGE_SIZE - 1)) * table->entry_size,
+            0, table->entry_size);
+  else if (page >= PANGO_GLYPH_TABLE_MAX_PAGES && table->overflow)
+    g_hash_table_remove (table->overflow, GUINT_TO_POINTER (glyph));
+}
+
+/* Frees the page with index @page, and all its entries.
+ * Pages at or beyond PANGO_GLYPH_TABLE_MAX_PAGES all refer
+ * to the overflow table.
+ */
+static inline void
+pango_glyph_table_remove_page (PangoGlyphTable *table,
+                               guint            page)
+{
+  if (page < table->n_pages)
+    g_clear_pointer (&table->pages[page], g_free);
+  else if (page >= PANGO_GLYPH_TABLE_MAX_PAGES && table->overflow)
+    g_clear_pointer (&table->overflow, g_hash_table_unref);
+}
+
+G_END_DECLS
@@ -264,6 +264,13 @@ void                    pango_shape_item                        (PangoItem
                                                                  PangoGlyphString    *glyphs,
                                                                  PangoShapeFlags      flags);
 
+PANGO_AVAILABLE_IN_1_52
+void                    pango_shape_grid                        (const char          *text,
+                                                                 int                  length,
+                                                                 const PangoAnalysis *analysis,
+                                                                 int                  cell_width,
+                                                                 PangoGlyphString    *glyphs);
+
 
 G_END_DECLS
 
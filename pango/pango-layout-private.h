@@ -66,6 +66,7 @@ struct _PangoLayout
   guint is_wrapped : 1;		/* Whether the layout has any wrapped lines */
   guint ellipsize : 2;		/* PangoEllipsizeMode */
   guint is_ellipsized : 1;	/* Whether the layout has any ellipsized lines */
+  guint measure_only : 1;	/* Whether to skip work that only matters for rendering */
   int unknown_glyphs_count;	/* number of unknown glyphs */
 
   /* some caching */
@@ -83,6 +84,8 @@ struct _PangoLayout
   PangoLogAttr *log_attrs;	/* Logical attributes for layout's text */
   GSList *lines;
   guint line_count;		/* Number of lines in @lines. 0 if lines is %NULL */
+  GSList **line_links;		/* The links of @lines as an array, built on demand */
+  struct _ExtentsCache *extents_cache; /* Line extents, computed on demand */
 };
 
 typedef struct _Extents Extents;
@@ -91,11 +94,34 @@ struct _Extents
   /* Vertical position of the line's baseline in layout coords */
   int baseline;
 
-  /* Line extents in layout coords */
-  PangoRectangle ink_rect;
+  /* Logical line extents in layout coords */
   PangoRectangle logical_rect;
 };
 
+/* The extents of the lines of a layout, shared by the layout
+ * and its iterators. They are computed line by line, as far as
+ * they are needed. The layout drops its reference when the lines
+ * change; iterators keep the one they were created with.
+ */
+typedef struct _ExtentsCache ExtentsCache;
+struct _ExtentsCache
+{
+  gatomicrefcount ref_count;
+  PangoLayout *layout;
+  int n_lines;
+  int layout_width;             /* Width used to align the lines */
+
+  int n_valid;                  /* Number of lines computed so far */
+  int n_allocated;
+  Extents *line_extents;        /* Extents of each line */
+  int *y_end;                   /* Bottom of the lowest y range among lines 0 to i */
+
+  /* State for computing the next line */
+  GSList *next_line;
+  int y_offset;
+  int baseline;
+};
+
 struct _PangoLayoutIter
 {
   PangoLayout *layout;
@@ -109,8 +135,8 @@ struct _PangoLayoutIter
   PangoLayoutRun *run; /* FIXME nuke this, just keep the link */
   int index;
 
-  /* list of Extents for each line in layout coordinates */
-  Extents *line_extents;
+  /* Extents for each line in layout coordinates */
+  ExtentsCache *extents_cache;
   int line_index;
 
   /* Position of the current run */
@@ -155,6 +181,14 @@ void     _pango_layout_get_iter (PangoLayout     *layout,
 
 void     _pango_layout_iter_destroy (PangoLayoutIter *iter);
 
+PangoLayoutLine * _pango_layout_line_new (PangoLayout *layout);
+
+void     _pango_layout_set_output   (PangoLayout     *layout,
+                                     GSList          *lines,
+                                     PangoLogAttr    *log_attrs,
+                                     gboolean         is_wrapped,
+                                     gboolean         is_ellipsized);
+
 G_END_DECLS
 
 #endif /* __PANGO_LAYOUT_PRIVATE_H__ */
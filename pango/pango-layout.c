@@ -88,6 +88,7 @@
 
 #include "pango-layout-private.h"
 #include "pango-attributes-private.h"
+#include "pango-markup-private.h"
 
 
 typedef struct _ItemProperties ItemProperties;
@@ -186,6 +187,19 @@ static void              pango_layout_line_postprocess (PangoLayoutLine *line,
 
 static void pango_layout_line_leaked (PangoLayoutLine *line);
 
+static void extents_cache_unref (ExtentsCache *cache);
+static ExtentsCache * get_extents_cache (PangoLayout *layout);
+static void extents_cache_ensure (ExtentsCache *cache,
+                                  int           line_index);
+static void get_line_yrange (PangoLayout  *layout,
+                             ExtentsCache *cache,
+                             int           line_index,
+                             int          *y0,
+                             int          *y1);
+static void iter_init_at_line (PangoLayout     *layout,
+                               PangoLayoutIter *iter,
+                               int              line_index);
+
 /* doesn't leak line */
 static PangoLayoutLine * _pango_layout_iter_get_line (PangoLayoutIter *iter);
 static PangoLayoutRun *  _pango_layout_iter_get_run  (PangoLayoutIter *iter);
@@ -226,6 +240,8 @@ pango_layout_init (PangoLayout *layout)
   layout->log_attrs = NULL;
   layout->lines = NULL;
   layout->line_count = 0;
+  layout->line_links = NULL;
+  layout->extents_cache = NULL;
 
   layout->tab_width = -1;
   layout->decimal = 0;
@@ -903,6 +919,69 @@ pango_layout_get_justify_last_line (PangoLayout *layout)
   return layout->justify_last_line;
 }
 
+/**
+ * pango_layout_set_measure_only:
+ * @layout: a `PangoLayout`
+ * @measure_only: whether the layout is only used for measuring
+ *
+ * Sets whether the layout is only used to determine its size.
+ *
+ * When this is set, attributes that only affect rendering, such
+ * as colors, are not applied to the runs of the layout. Runs are
+ * then not split at the boundaries of such attributes, which is
+ * a large part of the cost of formatting heavily styled text.
+ * The layout should not be rendered in this mode.
+ *
+ * The text is still itemized and shaped, and lines and runs
+ * are still built and justified, since the extents of the
+ * layout are computed from them. Layouts with few attributes
+ * therefore gain little from this.
+ *
+ * This is useful when measuring many styled layouts, for
+ * example to find the width of a table column.
+ *
+ * Unsetting this causes the layout to be formatted again
+ * when it is used next.
+ *
+ * The default value is %FALSE.
+ *
+ * Since: 1.52
+ */
+void
+pango_layout_set_measure_only (PangoLayout *layout,
+                               gboolean     measure_only)
+{
+  g_return_if_fail (layout != NULL);
+
+  if (measure_only != layout->measure_only)
+    {
+      layout->measure_only = measure_only;
+
+      /* Lines formatted for measuring lack attributes */
+      if (!measure_only)
+        layout_changed (layout);
+    }
+}
+
+/**
+ * pango_layout_get_measure_only:
+ * @layout: a `PangoLayout`
+ *
+ * Gets whether the layout is only used to determine its size.
+ *
+ * See [method@Pango.Layout.set_measure_only].
+ *
+ * Return value: the measure-only value
+ *
+ * Since: 1.52
+ */
+gboolean
+pango_layout_get_measure_only (PangoLayout *layout)
+{
+  g_return_val_if_fail (layout != NULL, FALSE);
+  return layout->measure_only;
+}
+
 /**
  * pango_layout_set_auto_dir:
  * @layout: a `PangoLayout`
@@ -1378,6 +1457,9 @@ pango_layout_set_markup (PangoLayout *layout,
  * and the first character so marked will be returned in @accel_char.
  * Two @accel_marker characters following each other produce a single
  * literal @accel_marker character.
+ *
+ * If the markup cache is enabled with [func@Pango.markup_cache_set_max_entries],
+ * markup that was parsed before is not parsed again.
  */
 void
 pango_layout_set_markup_with_accel (PangoLayout *layout,
@@ -1394,11 +1476,11 @@ pango_layout_set_markup_with_accel (PangoLayout *layout,
   g_return_if_fail (markup != NULL);
 
   error = NULL;
-  if (!pango_parse_markup (markup, length,
-                           accel_marker,
-                           &list, &text,
-                           accel_char,
-                           &error))
+  if (!_pango_parse_markup_cached (markup, length,
+                                   accel_marker,
+                                   &list, &text,
+                                   accel_char,
+                                   &error))
     {
       g_warning ("pango_layout_set_markup_with_accel: %s", error->message);
       g_error_free (error);
@@ -1408,7 +1490,7 @@ pango_layout_set_markup_with_accel (PangoLayout *layout,
   pango_layout_set_text (layout, text, -1);
   pango_layout_set_attributes (layout, list);
   pango_attr_list_unref (list);
-  g_free (text);
+  g_ref_string_release (text);
 }
 
 /**
@@ -1685,6 +1767,27 @@ pango_layout_get_lines_readonly (PangoLayout *layout)
   return layout->lines;
 }
 
+/* The lines are kept in a GSList for pango_layout_get_lines(),
+ * but indexed access goes through an array of its links that is
+ * built the first time it is needed after the lines have been
+ * computed
+ */
+static GSList **
+get_line_links (PangoLayout *layout)
+{
+  if (!layout->line_links)
+    {
+      GSList *l;
+      int i;
+
+      layout->line_links = g_new (GSList *, layout->line_count);
+      for (l = layout->lines, i = 0; l; l = l->next, i++)
+        layout->line_links[i] = l;
+    }
+
+  return layout->line_links;
+}
+
 /**
  * pango_layout_get_line:
  * @layout: a `PangoLayout`
@@ -1705,25 +1808,15 @@ PangoLayoutLine *
 pango_layout_get_line (PangoLayout *layout,
                        int          line)
 {
-  GSList *list_item;
-  g_return_val_if_fail (layout != NULL, NULL);
-
-  if (line < 0)
-    return NULL;
-
-  pango_layout_check_lines (layout);
+  PangoLayoutLine *result;
 
-  list_item = g_slist_nth (layout->lines, line);
+  g_return_val_if_fail (layout != NULL, NULL);
 
-  if (list_item)
-    {
-      PangoLayoutLine *line = list_item->data;
+  result = pango_layout_get_line_readonly (layout, line);
+  if (result)
+    pango_layout_line_leaked (result);
 
-      pango_layout_line_leaked (line);
-      return line;
-    }
-
-  return NULL;
+  return result;
 }
 
 /**
@@ -1749,7 +1842,6 @@ PangoLayoutLine *
 pango_layout_get_line_readonly (PangoLayout *layout,
                                 int          line)
 {
-  GSList *list_item;
   g_return_val_if_fail (layout != NULL, NULL);
 
   if (line < 0)
@@ -1757,15 +1849,10 @@ pango_layout_get_line_readonly (PangoLayout *layout,
 
   pango_layout_check_lines (layout);
 
-  list_item = g_slist_nth (layout->lines, line);
-
-  if (list_item)
-    {
-      PangoLayoutLine *line = list_item->data;
-      return line;
-    }
+  if ((guint) line >= layout->line_count)
+    return NULL;
 
-  return NULL;
+  return get_line_links (layout)[line]->data;
 }
 
 /**
@@ -1845,6 +1932,33 @@ pango_layout_line_index_to_x (PangoLayoutLine *line,
     *x_pos = width;
 }
 
+/* Returns the index of the last line starting at or before @index,
+ * or -1. If @index is in paragraph delimiters, this is the line
+ * before them.
+ */
+static int
+find_line_for_index (PangoLayout *layout,
+                     int          index)
+{
+  GSList **links = get_line_links (layout);
+  int lo, hi;
+
+  lo = 0;
+  hi = layout->line_count;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      PangoLayoutLine *line = links[mid]->data;
+
+      if (line->start_index > index)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return lo - 1;
+}
+
 static PangoLayoutLine *
 pango_layout_index_to_line (PangoLayout      *layout,
                             int               index,
@@ -1852,41 +1966,22 @@ pango_layout_index_to_line (PangoLayout      *layout,
                             PangoLayoutLine **line_before,
                             PangoLayoutLine **line_after)
 {
-  GSList *tmp_list;
-  GSList *line_list;
-  PangoLayoutLine *line = NULL;
-  PangoLayoutLine *prev_line = NULL;
-  int i = -1;
-
-  line_list = tmp_list = layout->lines;
-  while (tmp_list)
-    {
-      PangoLayoutLine *tmp_line = tmp_list->data;
-
-      if (tmp_line->start_index > index)
-        break; /* index was in paragraph delimiters */
-
-      prev_line = line;
-      line = tmp_line;
-      line_list = tmp_list;
-      i++;
-
-      if (line->start_index + line->length > index)
-        break;
+  GSList **links;
+  int i;
 
-      tmp_list = tmp_list->next;
-    }
+  i = find_line_for_index (layout, index);
+  links = get_line_links (layout);
 
   if (line_nr)
     *line_nr = i;
 
   if (line_before)
-    *line_before = prev_line;
+    *line_before = i > 0 ? links[i - 1]->data : NULL;
 
   if (line_after)
-    *line_after = (line_list && line_list->next) ? line_list->next->data : NULL;
+    *line_after = i >= 0 && (guint) (i + 1) < layout->line_count ? links[i + 1]->data : NULL;
 
-  return line;
+  return i >= 0 ? links[i]->data : NULL;
 }
 
 static PangoLayoutLine *
@@ -1896,50 +1991,39 @@ pango_layout_index_to_line_and_extents (PangoLayout     *layout,
                                         PangoRectangle  *run_rect)
 {
   PangoLayoutIter iter;
-  PangoLayoutLine *line = NULL;
-
-  _pango_layout_get_iter (layout, &iter);
-
-  if (!ITER_IS_INVALID (&iter))
-    while (TRUE)
-      {
-        PangoLayoutLine *tmp_line = _pango_layout_iter_get_line (&iter);
+  PangoLayoutLine *line;
+  int i;
 
-        if (tmp_line->start_index > index)
-          break; /* index was in paragraph delimiters */
+  pango_layout_check_lines (layout);
 
-        line = tmp_line;
+  i = find_line_for_index (layout, index);
+  if (i < 0)
+    return NULL;
 
-        pango_layout_iter_get_line_extents (&iter, NULL, line_rect);
+  iter_init_at_line (layout, &iter, i);
 
-        if (!iter.line_list_link->next ||
-            ((PangoLayoutLine *)iter.line_list_link->next->data)->start_index > index)
-          {
-            if (run_rect)
-              {
-                while (TRUE)
-                  {
-                    PangoLayoutRun *run = _pango_layout_iter_get_run (&iter);
+  line = _pango_layout_iter_get_line (&iter);
 
-                    pango_layout_iter_get_run_extents (&iter, NULL, run_rect);
+  pango_layout_iter_get_line_extents (&iter, NULL, line_rect);
 
-                    if (!run)
-                      break;
+  if (run_rect)
+    {
+      while (TRUE)
+        {
+          PangoLayoutRun *run = _pango_layout_iter_get_run (&iter);
 
-                    if (run->item->offset <= index && index < run->item->offset + run->item->length)
-                      break;
+          pango_layout_iter_get_run_extents (&iter, NULL, run_rect);
 
-                    if (!pango_layout_iter_next_run (&iter))
-                      break;
-                  }
-              }
+          if (!run)
+            break;
 
+          if (run->item->offset <= index && index < run->item->offset + run->item->length)
             break;
-          }
 
-        if (!pango_layout_iter_next_line (&iter))
-          break; /* Use end of last line */
-      }
+          if (!pango_layout_iter_next_run (&iter))
+            break;
+        }
+    }
 
   _pango_layout_iter_destroy (&iter);
 
@@ -2299,74 +2383,63 @@ pango_layout_xy_to_index (PangoLayout *layout,
                           int         *index,
                           gint        *trailing)
 {
-  PangoLayoutIter iter;
-  PangoLayoutLine *prev_line = NULL;
-  PangoLayoutLine *found = NULL;
-  int found_line_x = 0;
-  int prev_last = 0;
-  int prev_line_x = 0;
+  ExtentsCache *cache;
+  int found;
+  int lo, hi;
   gboolean retval = FALSE;
   gboolean outside = FALSE;
 
   g_return_val_if_fail (PANGO_IS_LAYOUT (layout), FALSE);
 
-  _pango_layout_get_iter (layout, &iter);
+  cache = get_extents_cache (layout);
 
-  do
+  /* Compute line extents until we are past y */
+  while (cache->n_valid < cache->n_lines &&
+         (cache->n_valid == 0 || cache->y_end[cache->n_valid - 1] <= y))
+    extents_cache_ensure (cache, cache->n_valid);
+
+  /* Find the first line whose y range ends below y */
+  lo = 0;
+  hi = cache->n_valid;
+  while (lo < hi)
     {
-      PangoRectangle line_logical;
-      int first_y, last_y;
+      int mid = (lo + hi) / 2;
 
-      g_assert (!ITER_IS_INVALID (&iter));
+      if (cache->y_end[mid] > y)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
 
-      pango_layout_iter_get_line_extents (&iter, NULL, &line_logical);
-      pango_layout_iter_get_line_yrange (&iter, &first_y, &last_y);
+  if (lo == cache->n_valid)
+    {
+      /* Off the bottom of the layout */
+      outside = TRUE;
+      found = cache->n_valid - 1;
+    }
+  else
+    {
+      int first_y, prev_last;
+
+      get_line_yrange (layout, cache, lo, &first_y, NULL);
 
+      found = lo;
       if (y < first_y)
         {
-          if (prev_line && y < (prev_last + (first_y - prev_last) / 2))
+          /* In the gap above the line; pick the closer one */
+          if (lo > 0)
             {
-              found = prev_line;
-              found_line_x = prev_line_x;
+              get_line_yrange (layout, cache, lo - 1, NULL, &prev_last);
+              if (y < (prev_last + (first_y - prev_last) / 2))
+                found = lo - 1;
             }
           else
-            {
-              if (prev_line == NULL)
-                outside = TRUE; /* off the top */
-
-              found = _pango_layout_iter_get_line (&iter);
-              found_line_x = x - line_logical.x;
-            }
-        }
-      else if (y >= first_y &&
-               y < last_y)
-        {
-          found = _pango_layout_iter_get_line (&iter);
-          found_line_x = x - line_logical.x;
+            outside = TRUE; /* off the top */
         }
-
-      prev_line = _pango_layout_iter_get_line (&iter);
-      prev_last = last_y;
-      prev_line_x = x - line_logical.x;
-
-      if (found != NULL)
-        break;
-    }
-  while (pango_layout_iter_next_line (&iter));
-
-  _pango_layout_iter_destroy (&iter);
-
-  if (found == NULL)
-    {
-      /* Off the bottom of the layout */
-      outside = TRUE;
-
-      found = prev_line;
-      found_line_x = prev_line_x;
     }
 
-  retval = pango_layout_line_x_to_index (found,
-                                         found_line_x,
+  retval = pango_layout_line_x_to_index (get_line_links (layout)[found]->data,
+                                         x - cache->line_extents[found].logical_rect.x,
                                          index, trailing);
 
   if (outside)
@@ -2399,63 +2472,49 @@ pango_layout_index_to_pos (PangoLayout    *layout,
   PangoLayoutIter iter;
   PangoLayoutLine *layout_line = NULL;
   int x_pos;
+  int i;
 
   g_return_if_fail (layout != NULL);
   g_return_if_fail (index >= 0);
   g_return_if_fail (pos != NULL);
 
-  _pango_layout_get_iter (layout, &iter);
+  pango_layout_check_lines (layout);
 
-  if (!ITER_IS_INVALID (&iter))
-    {
-      while (TRUE)
-        {
-          PangoLayoutLine *tmp_line = _pango_layout_iter_get_line (&iter);
+  /* The first line’s start_index is always 0 */
+  i = find_line_for_index (layout, index);
+  g_assert (i >= 0);
 
-          if (tmp_line->start_index > index)
-            {
-              /* index is in the paragraph delimiters, move to
-               * end of previous line
-               *
-               * This shouldn’t occur in the first loop iteration as the first
-               * line’s start_index should always be 0.
-               */
-              g_assert (layout_line != NULL);
-              index = layout_line->start_index + layout_line->length;
-              break;
-            }
+  iter_init_at_line (layout, &iter, i);
 
-          pango_layout_iter_get_line_extents (&iter, NULL, &line_logical_rect);
+  if (!ITER_IS_INVALID (&iter))
+    {
+      layout_line = _pango_layout_iter_get_line (&iter);
 
-          layout_line = tmp_line;
+      pango_layout_iter_get_line_extents (&iter, NULL, &line_logical_rect);
 
-          if (layout_line->start_index + layout_line->length >= index)
+      if (layout_line->start_index + layout_line->length >= index)
+        {
+          do
             {
-              do
-                {
-                  PangoLayoutRun *run = _pango_layout_iter_get_run (&iter);
-
-                  pango_layout_iter_get_run_extents (&iter, NULL, &run_logical_rect);
-
-                  if (!run)
-                    break;
+              PangoLayoutRun *run = _pango_layout_iter_get_run (&iter);
 
-                  if (run->item->offset <= index && index < run->item->offset + run->item->length)
-                    break;
-                 }
-               while (pango_layout_iter_next_run (&iter));
+              pango_layout_iter_get_run_extents (&iter, NULL, &run_logical_rect);
 
-              if (layout_line->start_index + layout_line->length > index)
+              if (!run)
                 break;
-            }
 
-          if (!pango_layout_iter_next_line (&iter))
-            {
-              index = layout_line->start_index + layout_line->length;
-              break;
+              if (run->item->offset <= index && index < run->item->offset + run->item->length)
+                break;
             }
+          while (pango_layout_iter_next_run (&iter));
         }
 
+      /* If index is in the paragraph delimiters, or past the
+       * last line, move to the end of the line
+       */
+      if (layout_line->start_index + layout_line->length < index)
+        index = layout_line->start_index + layout_line->length;
+
       pos->y = run_logical_rect.y;
       pos->height = run_logical_rect.height;
 
@@ -2901,20 +2960,15 @@ get_line_extents_layout_coords (PangoLayout     *layout,
     *baseline = new_baseline;
 }
 
-/* if non-NULL line_extents returns a list of line extents
- * in layout coordinates
- */
 static void
 pango_layout_get_extents_internal (PangoLayout    *layout,
                                    PangoRectangle *ink_rect,
-                                   PangoRectangle *logical_rect,
-                                   Extents        **line_extents)
+                                   PangoRectangle *logical_rect)
 {
   GSList *line_list;
   int y_offset = 0;
   int width;
   gboolean need_width = FALSE;
-  int line_index = 0;
   int baseline;
 
   g_return_if_fail (layout != NULL);
@@ -2931,12 +2985,12 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
       *logical_rect = layout->logical_rect;
       logical_rect = NULL;
     }
-  if (!ink_rect && !logical_rect && !line_extents)
+  if (!ink_rect && !logical_rect)
     return;
 
   /* When we are not wrapping, we need the overall width of the layout to
    * figure out the x_offsets of each line. However, we only need the
-   * x_offsets if we are computing the ink_rect or individual line extents.
+   * x_offsets if we are computing the ink_rect.
    */
   width = layout->width;
 
@@ -2960,11 +3014,11 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
   else if (layout->alignment != PANGO_ALIGN_LEFT)
     need_width = TRUE;
 
-  if (width == -1 && need_width && (ink_rect || line_extents))
+  if (width == -1 && need_width && ink_rect)
     {
       PangoRectangle overall_logical;
 
-      pango_layout_get_extents_internal (layout, NULL, &overall_logical, NULL);
+      pango_layout_get_extents_internal (layout, NULL, &overall_logical);
       width = overall_logical.width;
     }
 
@@ -2977,11 +3031,6 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
     }
 
 
-  if (line_extents && layout->line_count > 0)
-    {
-      *line_extents = g_malloc (sizeof (Extents) * layout->line_count);
-    }
-
   baseline = 0;
   line_list = layout->lines;
   while (line_list)
@@ -3000,14 +3049,6 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
                                         &baseline,
                                         ink_rect ? &line_ink_layout : NULL,
                                         &line_logical_layout);
-
-        if (line_extents && layout->line_count > 0)
-          {
-            Extents *ext = &(*line_extents)[line_index];
-            ext->baseline = baseline;
-            ext->ink_rect = line_ink_layout;
-            ext->logical_rect = line_logical_layout;
-          }
       }
 
       if (ink_rect)
@@ -3071,7 +3112,6 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
 
       y_offset = line_logical_layout.y + line_logical_layout.height + layout->spacing;
       line_list = line_list->next;
-      line_index ++;
     }
 
   if (ink_rect)
@@ -3086,6 +3126,157 @@ pango_layout_get_extents_internal (PangoLayout    *layout,
     }
 }
 
+static void
+get_line_yrange (PangoLayout  *layout,
+                 ExtentsCache *cache,
+                 int           line_index,
+                 int          *y0,
+                 int          *y1)
+{
+  const Extents *ext = &cache->line_extents[line_index];
+  int half_spacing = layout->spacing / 2;
+
+  /* Note that if layout->spacing is odd, the remainder spacing goes
+   * above the line (this is pretty arbitrary of course)
+   */
+
+  if (y0)
+    {
+      /* No spacing above the first line */
+
+      if (line_index == 0)
+        *y0 = ext->logical_rect.y;
+      else
+        *y0 = ext->logical_rect.y - (layout->spacing - half_spacing);
+    }
+
+  if (y1)
+    {
+      /* No spacing below the last line */
+      if (line_index == cache->n_lines - 1)
+        *y1 = ext->logical_rect.y + ext->logical_rect.height;
+      else
+        *y1 = ext->logical_rect.y + ext->logical_rect.height + half_spacing;
+    }
+}
+
+static ExtentsCache *
+extents_cache_new (PangoLayout *layout)
+{
+  ExtentsCache *cache;
+  gboolean need_width = FALSE;
+
+  cache = g_new (ExtentsCache, 1);
+  g_atomic_ref_count_init (&cache->ref_count);
+  cache->layout = layout;
+  cache->n_lines = layout->line_count;
+  cache->n_valid = 0;
+  cache->n_allocated = 0;
+  cache->line_extents = NULL;
+  cache->y_end = NULL;
+  cache->next_line = layout->lines;
+  cache->y_offset = 0;
+  cache->baseline = 0;
+
+  /* The line offsets only depend on the overall width if some
+   * line is not left aligned, see pango_layout_get_extents_internal()
+   */
+  if (layout->auto_dir)
+    {
+      GSList *l;
+
+      for (l = layout->lines; l && !need_width; l = l->next)
+        need_width = get_alignment (layout, l->data) != PANGO_ALIGN_LEFT;
+    }
+  else
+    need_width = layout->alignment != PANGO_ALIGN_LEFT;
+
+  cache->layout_width = layout->width;
+  if (layout->width == -1 && need_width)
+    {
+      PangoRectangle logical_rect;
+
+      pango_layout_get_extents_internal (layout, NULL, &logical_rect);
+      cache->layout_width = logical_rect.width;
+    }
+
+  return cache;
+}
+
+/* Computes the extents of the lines up to and including line_index */
+static void
+extents_cache_ensure (ExtentsCache *cache,
+                      int           line_index)
+{
+  while (cache->n_valid <= line_index && cache->n_valid < cache->n_lines)
+    {
+      PangoLayoutLine *line = cache->next_line->data;
+      int i = cache->n_valid;
+      Extents *ext;
+      int y1;
+
+      if (i == cache->n_allocated)
+        {
+          cache->n_allocated = MIN (MAX (2 * cache->n_allocated, 16), cache->n_lines);
+          cache->line_extents = g_renew (Extents, cache->line_extents, cache->n_allocated);
+          cache->y_end = g_renew (int, cache->y_end, cache->n_allocated);
+        }
+
+      ext = &cache->line_extents[i];
+      get_line_extents_layout_coords (cache->layout, line,
+                                      cache->layout_width,
+                                      cache->y_offset,
+                                      &cache->baseline,
+                                      NULL,
+                                      &ext->logical_rect);
+      ext->baseline = cache->baseline;
+      cache->y_offset = ext->logical_rect.y + ext->logical_rect.height + cache->layout->spacing;
+
+      /* With line spacing, the y ranges of lines may overlap,
+       * so keep the running maximum to allow binary searches
+       */
+      get_line_yrange (cache->layout, cache, i, NULL, &y1);
+      cache->y_end[i] = i > 0 ? MAX (cache->y_end[i - 1], y1) : y1;
+
+      cache->next_line = cache->next_line->next;
+      cache->n_valid++;
+    }
+}
+
+static ExtentsCache *
+extents_cache_ref (ExtentsCache *cache)
+{
+  g_atomic_ref_count_inc (&cache->ref_count);
+
+  return cache;
+}
+
+static void
+extents_cache_unref (ExtentsCache *cache)
+{
+  if (!g_atomic_ref_count_dec (&cache->ref_count))
+    return;
+
+  g_free (cache->line_extents);
+  g_free (cache->y_end);
+  g_free (cache);
+}
+
+/* Returns the extents cache of the layout. This is shared by all
+ * iterators of the layout, and used for hit testing. Lines in it
+ * must be computed with extents_cache_ensure() before use.
+ */
+static ExtentsCache *
+get_extents_cache (PangoLayout *layout)
+{
+  pango_layout_check_lines (layout);
+
+  if (!layout->extents_cache)
+    layout->extents_cache = extents_cache_new (layout);
+
+  return layout->extents_cache;
+}
+
 /**
  * pango_layout_get_extents:
  * @layout: a `PangoLayout`
@@ -3112,7 +3303,7 @@ pango_layout_get_extents (PangoLayout    *layout,
 {
   g_return_if_fail (layout != NULL);
 
-  pango_layout_get_extents_internal (layout, ink_rect, logical_rect, NULL);
+  pango_layout_get_extents_internal (layout, ink_rect, logical_rect);
 }
 
 /**
@@ -3188,7 +3379,7 @@ pango_layout_get_pixel_size (PangoLayout *layout,
 {
   PangoRectangle logical_rect;
 
-  pango_layout_get_extents_internal (layout, NULL, &logical_rect, NULL);
+  pango_layout_get_extents_internal (layout, NULL, &logical_rect);
   pango_extents_to_pixels (&logical_rect, NULL);
 
   if (width)
@@ -3210,16 +3401,93 @@ pango_layout_get_pixel_size (PangoLayout *layout,
 int
 pango_layout_get_baseline (PangoLayout *layout)
 {
-  int baseline;
-  Extents *extents = NULL;
+  ExtentsCache *cache;
 
-  /* XXX this is kinda inefficient */
-  pango_layout_get_extents_internal (layout, NULL, NULL, &extents);
-  baseline = extents ? extents[0].baseline : 0;
+  cache = get_extents_cache (layout);
+  if (cache->n_lines == 0)
+    return 0;
 
-  g_free (extents);
+  extents_cache_ensure (cache, 0);
 
-  return baseline;
+  return cache->line_extents[0].baseline;
+}
+
+/**
+ * pango_layout_measure_labels:
+ * @context: a `PangoContext`
+ * @desc: (nullable): the font description to use for all texts
+ * @texts: (array length=n_texts): the texts to lay out
+ * @n_texts: the number of texts
+ * @ink_rects: (out caller-allocates) (optional) (array length=n_texts):
+ *   return location for the ink extents of each text
+ * @logical_rects: (out caller-allocates) (optional) (array length=n_texts):
+ *   return location for the logical extents of each text
+ * @runs: (out caller-allocates) (optional) (array length=n_texts) (transfer full):
+ *   return location for the runs of each text, as lists of `PangoGlyphItem`
+ *
+ * Lays out many short texts with the same parameters.
+ *
+ * Each text is laid out as a single unwrapped line, as if
+ * it was set on a `PangoLayout` in single paragraph mode.
+ *
+ * This is equivalent to creating a layout for each text. Each
+ * text is still itemized and shaped on its own; only the layout
+ * object is shared.
+ *
+ * The runs returned in @runs are in visual order, and their
+ * items refer to byte offsets in the corresponding text. They
+ * can be rendered with [method@Pango.Renderer.draw_glyph_item].
+ * Free each list with `g_slist_free_full()` and
+ * [method@Pango.GlyphItem.free].
+ *
+ * Since: 1.52
+ */
+void
+pango_layout_measure_labels (PangoContext               *context,
+                             const PangoFontDescription *desc,
+                             const char * const         *texts,
+                             int                         n_texts,
+                             PangoRectangle             *ink_rects,
+                             PangoRectangle             *logical_rects,
+                             GSList                    **runs)
+{
+  PangoLayout *layout;
+  int i;
+
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+  g_return_if_fail (texts != NULL || n_texts == 0);
+
+  if (n_texts == 0)
+    return;
+
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_single_paragraph_mode (layout, TRUE);
+
+  for (i = 0; i < n_texts; i++)
+    {
+      pango_layout_set_text (layout, texts[i], -1);
+
+      pango_layout_get_extents (layout,
+                                ink_rects ? &ink_rects[i] : NULL,
+                                logical_rects ? &logical_rects[i] : NULL);
+
+      /* The lines of the layout go away with the next text,
+       * so hand out copies of their runs
+       */
+      if (runs)
+        {
+          PangoLayoutLine *line = pango_layout_get_line_readonly (layout, 0);
+          GSList *l;
+
+          runs[i] = NULL;
+          for (l = line->runs; l; l = l->next)
+            runs[i] = g_slist_prepend (runs[i], pango_glyph_item_copy (l->data));
+          runs[i] = g_slist_reverse (runs[i]);
+        }
+    }
+
+  g_object_unref (layout);
 }
 
 static void
@@ -3240,11 +3508,13 @@ pango_layout_clear_lines (PangoLayout *layout)
       g_slist_free (layout->lines);
       layout->lines = NULL;
       layout->line_count = 0;
+      g_clear_pointer (&layout->line_links, g_free);
     }
 
   layout->unknown_glyphs_count = -1;
   layout->logical_rect_cached = FALSE;
   layout->ink_rect_cached = FALSE;
+  g_clear_pointer (&layout->extents_cache, extents_cache_unref);
   layout->is_ellipsized = FALSE;
   layout->is_wrapped = FALSE;
 }
@@ -3260,6 +3530,7 @@ pango_layout_line_leaked (PangoLayoutLine *line)
     {
       line->layout->logical_rect_cached = FALSE;
       line->layout->ink_rect_cached = FALSE;
+      g_clear_pointer (&line->layout->extents_cache, extents_cache_unref);
     }
 }
 
@@ -3589,6 +3860,16 @@ typedef enum
   BREAK_LINE_SEPARATOR
 } BreakResult;
 
+typedef struct
+{
+  int n_lines;                  /* Number of lines in the paragraph */
+  int *ends;                    /* Character offset in layout->text at which each line ends */
+  int *widths;                  /* Natural width of each line, including the break */
+  int line;                     /* Next line to fill */
+  GPtrArray *glyphs;            /* Glyphs for each item of the paragraph, taken in order */
+  int item;                     /* Next entry of glyphs to take */
+} BreakPlan;
+
 struct _ParaBreakState
 {
   /* maintained per layout */
@@ -3600,6 +3881,7 @@ struct _ParaBreakState
   GList *items;                 /* This paragraph turned into items */
   PangoDirection base_dir;      /* Current resolved base direction */
   int line_of_par;              /* Line of the paragraph, starting at 1 for first line */
+  BreakPlan *plan;              /* Breaks chosen for PANGO_WRAP_OPTIMAL; NULL for greedy breaking */
 
   PangoGlyphString *glyphs;     /* Glyphs for the first item in state->items */
   int start_offset;             /* Character offset of first item in state->items in layout->text */
@@ -3608,6 +3890,8 @@ struct _ParaBreakState
   int num_log_widths;           /* Length of log_widths */
   int log_widths_offset;        /* Offset into log_widths to the point corresponding
                                  * to the remaining portion of the first item */
+  int *log_width_sums;          /* Prefix sums of log_widths, with num_log_widths + 1 entries */
+  gboolean log_widths_nonnegative; /* Whether log_width_sums is nondecreasing */
 
   int line_start_index;         /* Start index (byte offset) of line in layout->text */
   int line_start_offset;        /* Character offset of line in layout->text */
@@ -3917,20 +4201,124 @@ debug (const char *where, PangoLayoutLine *line, ParaBreakState *state)
 # define DEBUG1(...) do { } while (0)
 #endif
 
-static inline void
-compute_log_widths (PangoLayout    *layout,
-                    ParaBreakState *state)
-{
-  PangoItem *item = state->items->data;
-  PangoGlyphItem glyph_item = { item, state->glyphs };
+static inline void
+compute_log_widths (PangoLayout    *layout,
+                    ParaBreakState *state)
+{
+  PangoItem *item = state->items->data;
+  PangoGlyphItem glyph_item = { item, state->glyphs };
+
+  int i;
+
+  if (item->num_chars > state->num_log_widths)
+    {
+      state->log_widths = g_renew (int, state->log_widths, item->num_chars);
+      state->log_width_sums = g_renew (int, state->log_width_sums, item->num_chars + 1);
+      state->num_log_widths = item->num_chars;
+    }
+
+  pango_glyph_item_get_logical_widths (&glyph_item, layout->text, state->log_widths);
+
+  state->log_widths_nonnegative = TRUE;
+  state->log_width_sums[0] = 0;
+  for (i = 0; i < item->num_chars; i++)
+    {
+      state->log_width_sums[i + 1] = state->log_width_sums[i] + state->log_widths[i];
+      if (state->log_widths[i] < 0)
+        state->log_widths_nonnegative = FALSE;
+    }
+}
+
+/* Returns the width of @num_chars characters, starting at
+ * @pos in the remaining portion of the first item
+ */
+static inline int
+log_widths_range (ParaBreakState *state,
+                  int             pos,
+                  int             num_chars)
+{
+  const int *sums = state->log_width_sums + state->log_widths_offset;
+
+  return sums[pos + num_chars] - sums[pos];
+}
+
+/* Finds where process_item() needs to start looking at break
+ * positions one by one.
+ *
+ * As long as the width up to a break position, plus the most that
+ * breaking there can add, is safely below the remaining width,
+ * process_item() accepts the break without measuring it. So we can
+ * binary search for the first position where that is no longer the
+ * case, and only need to look for the last break position before it.
+ *
+ * Returns the position to continue at, and updates the break
+ * candidate if a break position was skipped.
+ */
+static int
+skip_trivial_breaks (PangoLayout     *layout,
+                     PangoLayoutLine *line,
+                     ParaBreakState  *state,
+                     PangoWrapMode    wrap,
+                     int              end,
+                     int              safe_distance,
+                     int             *break_num_chars,
+                     int             *break_width,
+                     int             *break_extra_width)
+{
+  int hyphen_width;
+  int limit;
+  int lo, hi;
+  int pos;
+
+  if (!state->log_widths_nonnegative)
+    return 0;
+
+  /* Don't cache the hyphen width here, find_break_extra_width()
+   * determines it from the item where it is first needed.
+   */
+  if (state->hyphen_width >= 0)
+    hyphen_width = state->hyphen_width;
+  else
+    hyphen_width = find_hyphen_width (state->items->data);
+
+  limit = state->remaining_width - safe_distance - MAX (hyphen_width, 0);
+
+  lo = 0;
+  hi = end;
+  while (lo < hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+
+      if (log_widths_range (state, 0, mid) >= limit)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  /* Keep the hyphen width that the skipped positions would have determined */
+  if (state->hyphen_width < 0)
+    {
+      for (pos = 0; pos < lo; pos++)
+        if (layout->log_attrs[state->start_offset + pos].break_inserts_hyphen)
+          {
+            state->hyphen_width = hyphen_width;
+            break;
+          }
+    }
 
-  if (item->num_chars > state->num_log_widths)
+  for (pos = lo - 1; pos >= 0; pos--)
     {
-      state->log_widths = g_renew (int, state->log_widths, item->num_chars);
-      state->num_log_widths = item->num_chars;
+      if (can_break_at (layout, state->start_offset + pos, wrap) &&
+          (pos > 0 || line->runs))
+        {
+          *break_num_chars = pos;
+          *break_width = log_widths_range (state, 0, pos);
+          *break_extra_width = find_break_extra_width (layout, state, pos);
+          break;
+        }
     }
 
-  pango_glyph_item_get_logical_widths (&glyph_item, layout->text, state->log_widths);
+  return lo;
 }
 
 /* If last_tab is set, we've added a tab and remaining_width has been updated to
@@ -3975,7 +4363,9 @@ tab_width_change (ParaBreakState *state)
  *     return BREAK_ALL_FIT
  *
  * retry_break:
- *   for each position p in the item
+ *   skip the positions that are 'obviously' going to fit,
+ *     taking the last break position among them as bc
+ *   for each remaining position p in the item
  *     if adding more is 'obviously' not going to help and we have a breakpoint
  *       exit the loop
  *     if p is a possible break position
@@ -4007,7 +4397,6 @@ process_item (PangoLayout     *layout,
   int extra_width;
   int orig_extra_width;
   int length;
-  int i;
   int processing_new_item;
   int num_chars;
   int orig_width;
@@ -4072,9 +4461,7 @@ process_item (PangoLayout     *layout,
     }
   else
     {
-      width = 0;
-      for (i = 0; i < item->num_chars; i++)
-        width += state->log_widths[state->log_widths_offset + i];
+      width = log_widths_range (state, 0, item->num_chars);
     }
 
   if (layout->text[item->offset] == '\t')
@@ -4154,7 +4541,12 @@ process_item (PangoLayout     *layout,
 
 retry_break:
 
-  for (num_chars = 0, width = 0; num_chars < (no_break_at_end ? item->num_chars : (item->num_chars + 1)); num_chars++)
+  num_chars = skip_trivial_breaks (layout, line, state, wrap,
+                                   no_break_at_end ? item->num_chars : (item->num_chars + 1),
+                                   safe_distance,
+                                   &break_num_chars, &break_width, &break_extra_width);
+
+  for (width = log_widths_range (state, 0, num_chars); num_chars < (no_break_at_end ? item->num_chars : (item->num_chars + 1)); num_chars++)
     {
       extra_width = find_break_extra_width (layout, state, num_chars);
 
@@ -4439,6 +4831,382 @@ add_line (PangoLayoutLine *line,
     }
 }
 
+static int
+get_line_width (PangoLayout *layout,
+                gboolean     is_paragraph_start)
+{
+  int width = layout->width;
+
+  if (width >= 0 && layout->alignment != PANGO_ALIGN_CENTER)
+    {
+      if (is_paragraph_start && layout->indent >= 0)
+        width -= layout->indent;
+      else if (!is_paragraph_start && layout->indent < 0)
+        width += layout->indent;
+
+      if (width < 0)
+        width = 0;
+    }
+
+  return width;
+}
+
+/* For PANGO_WRAP_OPTIMAL, we choose the breaks for a whole paragraph
+ * up front, with the total-fit algorithm of Knuth and Plass: each line
+ * gets demerits that grow with the cube of its relative slack, and we
+ * keep the sequence of breaks with the smallest sum. Only the break
+ * opportunities that PANGO_WRAP_WORD would use are considered, and the
+ * widths come from the logical widths of the shaped items, like the
+ * estimates in process_item().
+ *
+ * The lines are then filled from the plan by fill_planned_line().
+ */
+
+#define LINE_PENALTY 10
+#define HYPHEN_PENALTY 50
+#define DOUBLE_HYPHEN_DEMERITS 3000
+#define OVERFULL_DEMERITS 1e10
+
+typedef struct
+{
+  int pos;                      /* Characters from the paragraph start */
+  int line;                     /* Number of lines before this break */
+  int prev;                     /* Previous break in the best sequence, or -1 */
+  gboolean hyphenated;          /* Whether the break inserts a hyphen */
+  double total;                 /* Demerits of the best sequence */
+} BreakNode;
+
+static double
+line_demerits (int      width,
+               int      avail,
+               gboolean last_line,
+               gboolean hyphenated,
+               gboolean prev_hyphenated)
+{
+  double badness = 0;
+  double demerits;
+
+  /* The last line of a paragraph may be as short as it likes */
+  if (!last_line && avail > 0)
+    {
+      double ratio = (avail - width) / (double) avail;
+
+      badness = 100 * ratio * ratio * ratio;
+    }
+
+  demerits = (LINE_PENALTY + badness) * (LINE_PENALTY + badness);
+
+  if (hyphenated)
+    {
+      demerits += HYPHEN_PENALTY * HYPHEN_PENALTY;
+      if (prev_hyphenated)
+        demerits += DOUBLE_HYPHEN_DEMERITS;
+    }
+
+  return demerits;
+}
+
+static void
+break_plan_free (BreakPlan *plan)
+{
+  g_free (plan->ends);
+  g_free (plan->widths);
+  g_ptr_array_unref (plan->glyphs);
+  g_slice_free (BreakPlan, plan);
+}
+
+/* Returns NULL if the paragraph should be broken greedily */
+static BreakPlan *
+compute_break_plan (PangoLayout     *layout,
+                    PangoLayoutLine *line,
+                    ParaBreakState  *state)
+{
+  BreakPlan *plan;
+  PangoItem *first, *last;
+  GList *l;
+  int start_offset;
+  int n_chars;
+  int pos, i;
+  int *log_widths = NULL;
+  int num_log_widths = 0;
+  int *sums;                    /* sums[i] is the width of the first i characters */
+  int *extra;                   /* extra[i] is the width added by a break at i */
+  gboolean *hyphenated;
+  gboolean nonnegative = TRUE;
+  int first_width, width;
+  GArray *nodes;
+  int *active;
+  int n_active;
+  BreakNode node;
+
+  first = state->items->data;
+  last = g_list_last (state->items)->data;
+
+  /* Tabs depend on the position in the line, and line separators
+   * force breaks, so leave those paragraphs to process_item()
+   */
+  if (memchr (layout->text + first->offset, '\t', last->offset + last->length - first->offset) ||
+      g_strstr_len (layout->text + first->offset, last->offset + last->length - first->offset, "\xe2\x80\xa8"))
+    return NULL;
+
+  n_chars = 0;
+  for (l = state->items; l; l = l->next)
+    n_chars += ((PangoItem *) l->data)->num_chars;
+
+  plan = g_slice_new0 (BreakPlan);
+  plan->glyphs = g_ptr_array_new_with_free_func ((GDestroyNotify) pango_glyph_string_free);
+
+  sums = g_new (int, n_chars + 1);
+  extra = g_new (int, n_chars + 1);
+  hyphenated = g_new (gboolean, n_chars + 1);
+
+  sums[0] = 0;
+  extra[0] = 0;
+  hyphenated[0] = FALSE;
+
+  /* shape_run() uses state->start_offset to find the log attrs */
+  start_offset = state->start_offset;
+
+  pos = 0;
+  for (l = state->items; l; l = l->next)
+    {
+      PangoItem *item = l->data;
+      PangoGlyphItem glyph_item;
+      int hyphen_width = -1;
+
+      pango_layout_get_item_properties (item, &state->properties);
+      state->start_offset = start_offset + pos;
+
+      glyph_item.item = item;
+      glyph_item.glyphs = shape_run (line, state, item);
+      g_ptr_array_add (plan->glyphs, glyph_item.glyphs);
+
+      if (item->num_chars > num_log_widths)
+        {
+          num_log_widths = item->num_chars;
+          log_widths = g_renew (int, log_widths, num_log_widths);
+        }
+
+      pango_glyph_item_get_logical_widths (&glyph_item, layout->text, log_widths);
+
+      /* This mirrors find_break_extra_width() */
+      for (i = 0; i < item->num_chars; i++)
+        {
+          PangoLogAttr *attr = &layout->log_attrs[start_offset + pos + i + 1];
+
+          if (log_widths[i] < 0)
+            nonnegative = FALSE;
+
+          sums[pos + i + 1] = sums[pos + i] + log_widths[i];
+          hyphenated[pos + i + 1] = attr->break_inserts_hyphen;
+
+          if (attr->break_inserts_hyphen)
+            {
+              if (hyphen_width < 0)
+                hyphen_width = find_hyphen_width (item);
+
+              if (attr->break_removes_preceding)
+                extra[pos + i + 1] = hyphen_width - log_widths[i];
+              else
+                extra[pos + i + 1] = hyphen_width;
+            }
+          else if (layout->log_attrs[start_offset + pos + i].is_white)
+            extra[pos + i + 1] = - log_widths[i];
+          else
+            extra[pos + i + 1] = 0;
+        }
+
+      pos += item->num_chars;
+    }
+
+  state->start_offset = start_offset;
+  g_free (log_widths);
+
+  /* Deactivating breaks below relies on widths only growing */
+  if (!nonnegative)
+    {
+      g_free (sums);
+      g_free (extra);
+      g_free (hyphenated);
+      break_plan_free (plan);
+      return NULL;
+    }
+
+  first_width = get_line_width (layout, TRUE);
+  width = get_line_width (layout, FALSE);
+
+  nodes = g_array_new (FALSE, FALSE, sizeof (BreakNode));
+  active = g_new (int, n_chars + 1);
+
+  node.pos = 0;
+  node.line = 0;
+  node.prev = -1;
+  node.hyphenated = FALSE;
+  node.total = 0;
+  g_array_append_val (nodes, node);
+  active[0] = 0;
+  n_active = 1;
+
+  for (pos = 1; pos <= n_chars; pos++)
+    {
+      int best = -1;
+      double best_total = 0;
+      int latest = -1;
+      int n;
+
+      if (pos < n_chars && !layout->log_attrs[start_offset + pos].is_line_break)
+        continue;
+
+      n = 0;
+      for (i = 0; i < n_active; i++)
+        {
+          BreakNode *a = &g_array_index (nodes, BreakNode, active[i]);
+          int avail = a->line == 0 ? first_width : width;
+          int w;
+
+          if (latest < 0 || a->pos > g_array_index (nodes, BreakNode, latest).pos)
+            latest = active[i];
+
+          /* A line from a that does not fit with the break at pos
+           * would not fit with any later break either, since
+           * extra[pos] >= -log_widths[pos - 1]
+           */
+          if (sums[pos - 1] - sums[a->pos] > avail)
+            continue;
+
+          active[n++] = active[i];
+
+          w = sums[pos] - sums[a->pos] + extra[pos];
+          if (w <= avail)
+            {
+              double total;
+
+              total = a->total + line_demerits (w, avail, pos == n_chars,
+                                                hyphenated[pos], a->hyphenated);
+              if (best < 0 || total < best_total)
+                {
+                  best = active[i];
+                  best_total = total;
+                }
+            }
+        }
+      n_active = n;
+
+      if (best < 0 && (n_active == 0 || pos == n_chars))
+        {
+          /* Nothing fits. Accept an overfull line after the latest break,
+           * which is what PANGO_WRAP_WORD does for a word that is too long
+           */
+          BreakNode *a = &g_array_index (nodes, BreakNode, latest);
+          int avail = a->line == 0 ? first_width : width;
+
+          best = latest;
+          best_total = a->total + OVERFULL_DEMERITS +
+                       (sums[pos] - sums[a->pos] + extra[pos] - avail);
+        }
+
+      if (best >= 0)
+        {
+          node.pos = pos;
+          node.line = g_array_index (nodes, BreakNode, best).line + 1;
+          node.prev = best;
+          node.hyphenated = hyphenated[pos];
+          node.total = best_total;
+          g_array_append_val (nodes, node);
+          active[n_active++] = nodes->len - 1;
+        }
+    }
+
+  /* The last node is the one at the end of the paragraph */
+  i = nodes->len - 1;
+  plan->n_lines = g_array_index (nodes, BreakNode, i).line;
+  plan->ends = g_new (int, plan->n_lines);
+  plan->widths = g_new (int, plan->n_lines);
+
+  while (g_array_index (nodes, BreakNode, i).prev >= 0)
+    {
+      BreakNode *b = &g_array_index (nodes, BreakNode, i);
+      BreakNode *a = &g_array_index (nodes, BreakNode, b->prev);
+
+      plan->ends[b->line - 1] = start_offset + b->pos;
+      plan->widths[b->line - 1] = sums[b->pos] - sums[a->pos] + extra[b->pos];
+
+      i = b->prev;
+    }
+
+  g_array_unref (nodes);
+  g_free (active);
+  g_free (sums);
+  g_free (extra);
+  g_free (hyphenated);
+
+  return plan;
+}
+
+/* Fills the line with the items up to the next break of the plan,
+ * reusing the glyphs that were shaped for the plan where possible
+ */
+static void
+fill_planned_line (PangoLayout     *layout,
+                   PangoLayoutLine *line,
+                   ParaBreakState  *state)
+{
+  BreakPlan *plan = state->plan;
+  int end = plan->ends[plan->line];
+
+  while (state->items && state->start_offset < end)
+    {
+      PangoItem *item = state->items->data;
+      int num_chars;
+
+      if (!state->glyphs)
+        {
+          pango_layout_get_item_properties (item, &state->properties);
+          state->glyphs = g_ptr_array_index (plan->glyphs, plan->item);
+          g_ptr_array_index (plan->glyphs, plan->item) = NULL;
+          plan->item++;
+          state->log_widths_offset = 0;
+        }
+
+      num_chars = end - state->start_offset;
+
+      if (num_chars >= item->num_chars)
+        {
+          num_chars = item->num_chars;
+
+          if (state->start_offset + num_chars == end &&
+              can_break_at (layout, end, PANGO_WRAP_WORD) &&
+              break_needs_hyphen (layout, state, num_chars))
+            item->analysis.flags |= PANGO_ANALYSIS_FLAG_NEED_HYPHEN;
+
+          insert_run (line, state, item, NULL, TRUE);
+          state->items = g_list_delete_link (state->items, state->items);
+        }
+      else
+        {
+          PangoItem *new_item;
+          int length;
+
+          length = g_utf8_offset_to_pointer (layout->text + item->offset, num_chars) - (layout->text + item->offset);
+          new_item = pango_item_split (item, length, num_chars);
+
+          if (break_needs_hyphen (layout, state, num_chars))
+            new_item->analysis.flags |= PANGO_ANALYSIS_FLAG_NEED_HYPHEN;
+          else
+            new_item->analysis.flags &= ~PANGO_ANALYSIS_FLAG_NEED_HYPHEN;
+
+          insert_run (line, state, new_item, NULL, FALSE);
+          state->log_widths_offset += num_chars;
+        }
+
+      state->start_offset += num_chars;
+    }
+
+  /* Used for justification in pango_layout_line_postprocess() */
+  state->remaining_width = MAX (state->line_width - plan->widths[plan->line], 0);
+  plan->line++;
+}
+
 static void
 process_line (PangoLayout    *layout,
               ParaBreakState *state)
@@ -4456,17 +5224,7 @@ process_line (PangoLayout    *layout,
   line->is_paragraph_start = state->line_of_par == 1;
   line_set_resolved_dir (line, state->base_dir);
 
-  state->line_width = layout->width;
-  if (state->line_width >= 0 && layout->alignment != PANGO_ALIGN_CENTER)
-    {
-      if (line->is_paragraph_start && layout->indent >= 0)
-        state->line_width -= layout->indent;
-      else if (!line->is_paragraph_start && layout->indent < 0)
-        state->line_width += layout->indent;
-
-      if (state->line_width < 0)
-        state->line_width = 0;
-    }
+  state->line_width = get_line_width (layout, line->is_paragraph_start);
 
   if (G_UNLIKELY (should_ellipsize_current_line (layout, state)))
     state->remaining_width = -1;
@@ -4479,6 +5237,26 @@ process_line (PangoLayout    *layout,
 
   DEBUG ("starting to fill line", line, state);
 
+  if (layout->wrap == PANGO_WRAP_OPTIMAL &&
+      layout->ellipsize == PANGO_ELLIPSIZE_NONE &&
+      state->remaining_width >= 0 &&
+      line->is_paragraph_start)
+    state->plan = compute_break_plan (layout, line, state);
+
+  if (state->plan)
+    {
+      fill_planned_line (layout, line, state);
+      wrapped = state->items != NULL;
+
+      if (!state->items)
+        {
+          break_plan_free (state->plan);
+          state->plan = NULL;
+        }
+
+      goto done;
+    }
+
   while (state->items)
     {
       PangoItem *item = state->items->data;
@@ -4701,6 +5479,25 @@ affects_break_or_shape (PangoAttribute *attr,
     }
 }
 
+static gboolean
+affects_run_extents (PangoAttribute *attr,
+                     gpointer        data)
+{
+  switch ((int)attr->klass->type)
+    {
+    /* These are included in the ink extents of runs.
+     * Everything else that matters for extents affects
+     * itemization, breaking or shaping.
+     */
+    case PANGO_ATTR_UNDERLINE:
+    case PANGO_ATTR_OVERLINE:
+    case PANGO_ATTR_STRIKETHROUGH:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
 static void
 apply_attributes_to_items (GList         *items,
                            PangoAttrList *attrs)
@@ -4832,6 +5629,8 @@ pango_layout_check_lines (PangoLayout *layout)
     }
 
   state.log_widths = NULL;
+  state.log_width_sums = NULL;
+  state.log_widths_nonnegative = FALSE;
   state.num_log_widths = 0;
   state.baseline_shifts = NULL;
 
@@ -4913,6 +5712,7 @@ pango_layout_check_lines (PangoLayout *layout)
       state.line_start_index = start - layout->text;
 
       state.glyphs = NULL;
+      state.plan = NULL;
 
       /* for deterministic bug hunting's sake set everything! */
       state.line_width = -1;
@@ -4949,10 +5749,21 @@ pango_layout_check_lines (PangoLayout *layout)
   while (!done);
 
   g_free (state.log_widths);
+  g_free (state.log_width_sums);
   g_list_free_full (state.baseline_shifts, g_free);
 
-  apply_attributes_to_runs (layout, attrs);
+  if (layout->measure_only && attrs)
+    {
+      PangoAttrList *extents_attrs;
+
+      extents_attrs = pango_attr_list_filter (attrs, affects_run_extents, NULL);
+      apply_attributes_to_runs (layout, extents_attrs);
+      pango_attr_list_unref (extents_attrs);
+    }
+  else
+    apply_attributes_to_runs (layout, attrs);
   layout->lines = g_slist_reverse (layout->lines);
+  g_clear_pointer (&layout->line_links, g_free);
 
   if (itemize_attrs)
     {
@@ -5928,6 +6739,37 @@ pango_layout_line_new (PangoLayout *layout)
   return (PangoLayoutLine *) private;
 }
 
+PangoLayoutLine *
+_pango_layout_line_new (PangoLayout *layout)
+{
+  return pango_layout_line_new (layout);
+}
+
+/* Installs precomputed lines, e.g. from a serialized layout,
+ * instead of running the line breaker. Takes ownership of
+ * @lines and @log_attrs. The lines must have been created
+ * with _pango_layout_line_new() for @layout, and must match
+ * the current text and attributes of @layout.
+ */
+void
+_pango_layout_set_output (PangoLayout  *layout,
+                          GSList       *lines,
+                          PangoLogAttr *log_attrs,
+                          gboolean      is_wrapped,
+                          gboolean      is_ellipsized)
+{
+  check_context_changed (layout);
+  pango_layout_clear_lines (layout);
+
+  g_free (layout->log_attrs);
+  layout->log_attrs = log_attrs;
+
+  layout->lines = lines;
+  layout->line_count = g_slist_length (lines);
+  layout->is_wrapped = is_wrapped;
+  layout->is_ellipsized = is_ellipsized;
+}
+
 /**
  * pango_layout_line_get_pixel_extents:
  * @layout_line: a `PangoLayoutLine`
@@ -6892,11 +7734,22 @@ cluster_width (PangoGlyphString *gs,
   return width;
 }
 
+/* Returns the extents of the current line, computing them
+ * if no iterator has been here before.
+ */
+static inline const Extents *
+iter_line_extents (PangoLayoutIter *iter)
+{
+  extents_cache_ensure (iter->extents_cache, iter->line_index);
+
+  return &iter->extents_cache->line_extents[iter->line_index];
+}
+
 static inline void
 offset_y (PangoLayoutIter *iter,
           int             *y)
 {
-  *y += iter->line_extents[iter->line_index].baseline;
+  *y += iter_line_extents (iter)->baseline;
 }
 
 /* Sets up the iter for the start of a new cluster. cluster_start_index
@@ -6954,7 +7807,7 @@ static void
 update_run (PangoLayoutIter *iter,
             int              run_start_index)
 {
-  const Extents *line_ext = &iter->line_extents[iter->line_index];
+  const Extents *line_ext = iter_line_extents (iter);
 
   /* Note that in iter_new() the iter->run_width
    * is garbage but we don't use it since we're on the first run of
@@ -7031,13 +7884,7 @@ pango_layout_iter_copy (PangoLayoutIter *iter)
   new->run = iter->run;
   new->index = iter->index;
 
-  new->line_extents = NULL;
-  if (iter->line_extents != NULL)
-    {
-      new->line_extents = g_memdup2 (iter->line_extents,
-                                     iter->layout->line_count * sizeof (Extents));
-
-    }
+  new->extents_cache = extents_cache_ref (iter->extents_cache);
   new->line_index = iter->line_index;
 
   new->run_x = iter->run_x;
@@ -7088,15 +7935,24 @@ void
 _pango_layout_get_iter (PangoLayout    *layout,
                         PangoLayoutIter*iter)
 {
-  int run_start_index;
-
   g_return_if_fail (PANGO_IS_LAYOUT (layout));
 
+  iter_init_at_line (layout, iter, 0);
+}
+
+static void
+iter_init_at_line (PangoLayout     *layout,
+                   PangoLayoutIter *iter,
+                   int              line_index)
+{
+  ExtentsCache *cache;
+  int run_start_index;
+
   iter->layout = g_object_ref (layout);
 
-  pango_layout_check_lines (layout);
+  cache = get_extents_cache (layout);
 
-  iter->line_list_link = layout->lines;
+  iter->line_list_link = get_line_links (layout)[line_index];
   iter->line = iter->line_list_link->data;
   pango_layout_line_ref (iter->line);
 
@@ -7111,27 +7967,9 @@ _pango_layout_get_iter (PangoLayout    *layout,
   else
     iter->run = NULL;
 
-  iter->line_extents = NULL;
-
-  if (layout->width == -1)
-    {
-      PangoRectangle logical_rect;
-
-      pango_layout_get_extents_internal (layout,
-                                         NULL,
-                                         &logical_rect,
-                                         &iter->line_extents);
-      iter->layout_width = logical_rect.width;
-    }
-  else
-    {
-      pango_layout_get_extents_internal (layout,
-                                         NULL,
-                                         NULL,
-                                         &iter->line_extents);
-      iter->layout_width = layout->width;
-    }
-  iter->line_index = 0;
+  iter->extents_cache = extents_cache_ref (cache);
+  iter->layout_width = cache->layout_width;
+  iter->line_index = line_index;
 
   update_run (iter, run_start_index);
 }
@@ -7142,7 +7980,7 @@ _pango_layout_iter_destroy (PangoLayoutIter *iter)
   if (iter == NULL)
     return;
 
-  g_free (iter->line_extents);
+  extents_cache_unref (iter->extents_cache);
   pango_layout_line_unref (iter->line);
   g_object_unref (iter->layout);
 }
@@ -7793,7 +8631,7 @@ pango_layout_iter_get_line_extents (PangoLayoutIter *iter,
   if (ITER_IS_INVALID (iter))
     return;
 
-  ext = &iter->line_extents[iter->line_index];
+  ext = iter_line_extents (iter);
 
   if (ink_rect)
     {
@@ -7832,38 +8670,10 @@ pango_layout_iter_get_line_yrange (PangoLayoutIter *iter,
                                    int             *y0,
                                    int             *y1)
 {
-  const Extents *ext;
-  int half_spacing;
-
   if (ITER_IS_INVALID (iter))
     return;
 
-  ext = &iter->line_extents[iter->line_index];
-
-  half_spacing = iter->layout->spacing / 2;
-
-  /* Note that if layout->spacing is odd, the remainder spacing goes
-   * above the line (this is pretty arbitrary of course)
-   */
-
-  if (y0)
-    {
-      /* No spacing above the first line */
-
-      if (iter->line_index == 0)
-        *y0 = ext->logical_rect.y;
-      else
-        *y0 = ext->logical_rect.y - (iter->layout->spacing - half_spacing);
-    }
-
-  if (y1)
-    {
-      /* No spacing below the last line */
-      if (iter->line_index == iter->layout->line_count - 1)
-        *y1 = ext->logical_rect.y + ext->logical_rect.height;
-      else
-        *y1 = ext->logical_rect.y + ext->logical_rect.height + half_spacing;
-    }
+  get_line_yrange (iter->layout, iter->extents_cache, iter->line_index, y0, y1);
 }
 
 /**
@@ -7883,7 +8693,7 @@ pango_layout_iter_get_baseline (PangoLayoutIter *iter)
   if (ITER_IS_INVALID (iter))
     return 0;
 
-  return iter->line_extents[iter->line_index].baseline;
+  return iter_line_extents (iter)->baseline;
 }
 
 /**
@@ -7907,9 +8717,9 @@ pango_layout_iter_get_run_baseline (PangoLayoutIter *iter)
     return 0;
 
   if (!iter->run)
-    return iter->line_extents[iter->line_index].baseline;
+    return iter_line_extents (iter)->baseline;
 
-  return iter->line_extents[iter->line_index].baseline - iter->run->y_offset;
+  return iter_line_extents (iter)->baseline - iter->run->y_offset;
 }
 
 /**
@@ -70,6 +70,9 @@ typedef enum {
  * @PANGO_WRAP_CHAR: wrap lines at character boundaries.
  * @PANGO_WRAP_WORD_CHAR: wrap lines at word boundaries, but fall back to
  *   character boundaries if there is not enough space for a full word.
+ * @PANGO_WRAP_OPTIMAL: wrap lines at word boundaries, choosing the
+ *   breaks for each paragraph as a whole so that the lines are as
+ *   evenly filled as possible. Since: 1.52
  *
  * `PangoWrapMode` describes how to wrap the lines of a `PangoLayout`
  * to the desired width.
@@ -78,11 +81,18 @@ typedef enum {
  * by the Unicode line breaking algorithm. For @PANGO_WRAP_CHAR, Pango allows
  * breaking at grapheme boundaries that are determined by the Unicode text
  * segmentation algorithm.
+ *
+ * @PANGO_WRAP_OPTIMAL uses the same break opportunities as @PANGO_WRAP_WORD,
+ * but instead of filling each line greedily, it uses the Knuth-Plass
+ * algorithm to minimize the raggedness of the paragraph. Paragraphs that
+ * contain tabs or line separators, and ellipsized layouts, are wrapped
+ * like @PANGO_WRAP_WORD.
  */
 typedef enum {
   PANGO_WRAP_WORD,
   PANGO_WRAP_CHAR,
-  PANGO_WRAP_WORD_CHAR
+  PANGO_WRAP_WORD_CHAR,
+  PANGO_WRAP_OPTIMAL
 } PangoWrapMode;
 
 /**
@@ -231,6 +241,11 @@ void           pango_layout_set_justify_last_line (PangoLayout                *l
                                                    gboolean                    justify);
 PANGO_AVAILABLE_IN_1_50
 gboolean       pango_layout_get_justify_last_line (PangoLayout                *layout);
+PANGO_AVAILABLE_IN_1_52
+void           pango_layout_set_measure_only     (PangoLayout                *layout,
+                                                  gboolean                    measure_only);
+PANGO_AVAILABLE_IN_1_52
+gboolean       pango_layout_get_measure_only     (PangoLayout                *layout);
 PANGO_AVAILABLE_IN_1_4
 void           pango_layout_set_auto_dir         (PangoLayout                *layout,
 						  gboolean                    auto_dir);
@@ -338,6 +353,15 @@ void     pango_layout_get_pixel_size       (PangoLayout    *layout,
 PANGO_AVAILABLE_IN_1_22
 int      pango_layout_get_baseline         (PangoLayout    *layout);
 
+PANGO_AVAILABLE_IN_1_52
+void     pango_layout_measure_labels       (PangoContext               *context,
+                                            const PangoFontDescription *desc,
+                                            const char * const         *texts,
+                                            int                         n_texts,
+                                            PangoRectangle             *ink_rects,
+                                            PangoRectangle             *logical_rects,
+                                            GSList                    **runs);
+
 PANGO_AVAILABLE_IN_ALL
 int              pango_layout_get_line_count       (PangoLayout    *layout);
 PANGO_AVAILABLE_IN_ALL
@@ -356,6 +380,8 @@ GSList *         pango_layout_get_lines_readonly   (PangoLayout    *layout);
  * @PANGO_LAYOUT_SERIALIZE_DEFAULT: Default behavior
  * @PANGO_LAYOUT_SERIALIZE_CONTEXT: Include context information
  * @PANGO_LAYOUT_SERIALIZE_OUTPUT: Include information about the formatted output
+ * @PANGO_LAYOUT_SERIALIZE_BINARY: Use the compact binary format instead of JSON.
+ *   Since: 1.52
  *
  * Flags that influence the behavior of [method@Pango.Layout.serialize].
  *
@@ -367,6 +393,7 @@ typedef enum {
   PANGO_LAYOUT_SERIALIZE_DEFAULT = 0,
   PANGO_LAYOUT_SERIALIZE_CONTEXT = 1 << 0,
   PANGO_LAYOUT_SERIALIZE_OUTPUT = 1 << 1,
+  PANGO_LAYOUT_SERIALIZE_BINARY = 1 << 2,
 } PangoLayoutSerializeFlags;
 
 PANGO_AVAILABLE_IN_1_50
@@ -408,6 +435,9 @@ GQuark          pango_layout_deserialize_error_quark (void);
  * @PANGO_LAYOUT_DESERIALIZE_DEFAULT: Default behavior
  * @PANGO_LAYOUT_DESERIALIZE_CONTEXT: Apply context information
  *   from the serialization to the `PangoContext`
+ * @PANGO_LAYOUT_DESERIALIZE_OUTPUT: Use the serialized output instead
+ *   of formatting the layout again, if it was produced with the same fonts.
+ *   Since: 1.52
  *
  * Flags that influence the behavior of [func@Pango.Layout.deserialize].
  *
@@ -418,6 +448,7 @@ GQuark          pango_layout_deserialize_error_quark (void);
 typedef enum {
   PANGO_LAYOUT_DESERIALIZE_DEFAULT = 0,
   PANGO_LAYOUT_DESERIALIZE_CONTEXT = 1 << 0,
+  PANGO_LAYOUT_DESERIALIZE_OUTPUT  = 1 << 1,
 } PangoLayoutDeserializeFlags;
 
 PANGO_AVAILABLE_IN_1_50
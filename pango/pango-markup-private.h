@@ -0,0 +1,43 @@
+/* Pango
+ * pango-markup-private.h: Internal API for markup parsing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_MARKUP_PRIVATE_H__
+#define __PANGO_MARKUP_PRIVATE_H__
+
+#include <pango/pango-markup.h>
+
+G_BEGIN_DECLS
+
+/* Like pango_parse_markup(), but consults the markup cache
+ * if it has been enabled with pango_markup_cache_set_max_entries().
+ * @text is returned as a GRefString and must be released with
+ * g_ref_string_release(). @attr_list is shared with the cache
+ * and must not be modified.
+ */
+gboolean _pango_parse_markup_cached (const char     *markup_text,
+                                     int             length,
+                                     gunichar        accel_marker,
+                                     PangoAttrList **attr_list,
+                                     char          **text,
+                                     gunichar       *accel_char,
+                                     GError        **error);
+
+G_END_DECLS
+
+#endif /* __PANGO_MARKUP_PRIVATE_H__ */
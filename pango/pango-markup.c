@@ -31,6 +31,8 @@
 #include "pango-enum-types.h"
 #include "pango-impl-utils.h"
 #include "pango-utils-internal.h"
+#include "pango-markup-private.h"
+#include "pango-trace-private.h"
 
 /* FIXME */
 #define _(x) x
@@ -678,6 +680,292 @@ pango_parse_markup (const char                 *markup_text,
   return ret;
 }
 
+/* A bounded LRU cache of parse results, keyed by the markup
+ * string and the accel marker. Applications tend to set the
+ * same markup over and over (list rows, labels, ...), and
+ * parsing it again each time is wasteful. The cache is off
+ * by default, see pango_markup_cache_set_max_entries().
+ */
+
+typedef struct _MarkupCacheEntry MarkupCacheEntry;
+
+struct _MarkupCacheEntry
+{
+  char *markup;
+  gsize length;
+  gunichar accel_marker;
+  guint hash;
+
+  char *text;               /* GRefString */
+  PangoAttrList *attr_list;
+  gunichar accel_char;
+
+  GList link;
+};
+
+G_LOCK_DEFINE_STATIC (markup_cache);
+static GHashTable *markup_cache;
+static GQueue markup_cache_lru = G_QUEUE_INIT;
+static guint markup_cache_max_entries = 0;
+static PangoCacheStats markup_cache_stats = PANGO_CACHE_STATS_INIT ("markup cache");
+
+static guint
+markup_cache_hash (const char *markup,
+                   gsize       length,
+                   gunichar    accel_marker)
+{
+  guint32 h = 2166136261u ^ accel_marker;
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    h = (h ^ (guchar) markup[i]) * 16777619u;
+
+  return h;
+}
+
+static guint
+markup_cache_entry_hash (gconstpointer data)
+{
+  const MarkupCacheEntry *entry = data;
+
+  return entry->hash;
+}
+
+static gboolean
+markup_cache_entry_equal (gconstpointer a,
+                          gconstpointer b)
+{
+  const MarkupCacheEntry *ea = a;
+  const MarkupCacheEntry *eb = b;
+
+  return ea->hash == eb->hash &&
+         ea->length == eb->length &&
+         ea->accel_marker == eb->accel_marker &&
+         memcmp (ea->markup, eb->markup, ea->length) == 0;
+}
+
+static void
+markup_cache_entry_free (MarkupCacheEntry *entry)
+{
+  g_free (entry->markup);
+  g_ref_string_release (entry->text);
+  pango_attr_list_unref (entry->attr_list);
+  g_slice_free (MarkupCacheEntry, entry);
+}
+
+/* Must be called with the lock held */
+static void
+markup_cache_trim (guint max_entries)
+{
+  while (markup_cache_lru.length > max_entries)
+    {
+      MarkupCacheEntry *entry = g_queue_peek_tail (&markup_cache_lru);
+
+      g_queue_unlink (&markup_cache_lru, &entry->link);
+      g_hash_table_remove (markup_cache, entry);
+      pango_cache_stats_evict (&markup_cache_stats,
+                               sizeof (MarkupCacheEntry) + entry->length + strlen (entry->text));
+      markup_cache_entry_free (entry);
+    }
+}
+
+/**
+ * pango_markup_cache_set_max_entries:
+ * @max_entries: the maximum number of parsed markup strings to keep,
+ *   or 0 to disable the cache
+ *
+ * Enables or disables caching of parsed markup.
+ *
+ * When the cache is enabled, [method@Pango.Layout.set_markup] and
+ * [method@Pango.Layout.set_markup_with_accel] look up previously
+ * parsed markup with the same text and accel marker before parsing
+ * it again. The least recently used entries are dropped once more
+ * than @max_entries strings are cached.
+ *
+ * Each layout gets its own copy of the cached attributes, so
+ * changing the list returned by [method@Pango.Layout.get_attributes]
+ * does not affect other layouts. Copying an attribute list is much
+ * cheaper than parsing the markup again.
+ *
+ * The cache is disabled by default.
+ *
+ * Since: 1.52
+ */
+void
+pango_markup_cache_set_max_entries (guint max_entries)
+{
+  G_LOCK (markup_cache);
+
+  markup_cache_max_entries = max_entries;
+
+  if (markup_cache)
+    {
+      markup_cache_trim (max_entries);
+
+      if (max_entries == 0)
+        g_clear_pointer (&markup_cache, g_hash_table_unref);
+    }
+
+  G_UNLOCK (markup_cache);
+}
+
+/**
+ * pango_markup_cache_get_max_entries:
+ *
+ * Returns the maximum number of entries in the markup cache.
+ *
+ * See [func@Pango.markup_cache_set_max_entries].
+ *
+ * Return value: the maximum number of cached markup strings,
+ *   or 0 if the cache is disabled
+ *
+ * Since: 1.52
+ */
+guint
+pango_markup_cache_get_max_entries (void)
+{
+  guint max_entries;
+
+  G_LOCK (markup_cache);
+  max_entries = markup_cache_max_entries;
+  G_UNLOCK (markup_cache);
+
+  return max_entries;
+}
+
+gboolean
+_pango_parse_markup_cached (const char     *markup_text,
+                            int             length,
+                            gunichar        accel_marker,
+                            PangoAttrList **attr_list,
+                            char          **text,
+                            gunichar       *accel_char,
+                            GError        **error)
+{
+  MarkupCacheEntry key;
+  MarkupCacheEntry *entry;
+  PangoAttrList *list = NULL;
+  char *plain = NULL;
+  gunichar accel = 0;
+
+  g_return_val_if_fail (markup_text != NULL, FALSE);
+
+  if (length < 0)
+    length = strlen (markup_text);
+
+  key.markup = (char *) markup_text;
+  key.length = length;
+  key.accel_marker = accel_marker;
+
+  G_LOCK (markup_cache);
+
+  if (markup_cache_max_entries == 0)
+    {
+      G_UNLOCK (markup_cache);
+      goto parse;
+    }
+
+  key.hash = markup_cache_hash (markup_text, length, accel_marker);
+
+  if (markup_cache)
+    entry = g_hash_table_lookup (markup_cache, &key);
+  else
+    entry = NULL;
+
+  if (entry)
+    {
+      g_queue_unlink (&markup_cache_lru, &entry->link);
+      g_queue_push_head_link (&markup_cache_lru, &entry->link);
+
+      /* The cached list never leaves the cache, since
+       * callers may modify the list they get
+       */
+      if (attr_list)
+        *attr_list = pango_attr_list_copy (entry->attr_list);
+      if (text)
+        *text = g_ref_string_acquire (entry->text);
+      if (accel_char)
+        *accel_char = entry->accel_char;
+
+      G_UNLOCK (markup_cache);
+
+      pango_cache_stats_hit (&markup_cache_stats);
+
+      return TRUE;
+    }
+
+  G_UNLOCK (markup_cache);
+
+  pango_cache_stats_miss (&markup_cache_stats);
+
+  if (!pango_parse_markup (markup_text, length, accel_marker,
+                           &list, &plain, &accel,
+                           error))
+    return FALSE;
+
+  entry = g_slice_new (MarkupCacheEntry);
+  entry->markup = g_strndup (markup_text, length);
+  entry->length = length;
+  entry->accel_marker = accel_marker;
+  entry->hash = key.hash;
+  entry->text = g_ref_string_new (plain);
+  entry->attr_list = list;
+  entry->accel_char = accel;
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+
+  g_free (plain);
+
+  if (attr_list)
+    *attr_list = pango_attr_list_copy (entry->attr_list);
+  if (text)
+    *text = g_ref_string_acquire (entry->text);
+  if (accel_char)
+    *accel_char = entry->accel_char;
+
+  G_LOCK (markup_cache);
+
+  /* The cache may have been disabled, or another thread may
+   * have added the same markup while we were parsing.
+   */
+  if (markup_cache_max_entries == 0 ||
+      (markup_cache && g_hash_table_contains (markup_cache, entry)))
+    {
+      G_UNLOCK (markup_cache);
+      markup_cache_entry_free (entry);
+      return TRUE;
+    }
+
+  if (!markup_cache)
+    markup_cache = g_hash_table_new (markup_cache_entry_hash, markup_cache_entry_equal);
+
+  g_hash_table_add (markup_cache, entry);
+  g_queue_push_head_link (&markup_cache_lru, &entry->link);
+  markup_cache_trim (markup_cache_max_entries);
+
+  G_UNLOCK (markup_cache);
+
+  return TRUE;
+
+parse:
+  if (!pango_parse_markup (markup_text, length, accel_marker,
+                           attr_list ? &list : NULL,
+                           text ? &plain : NULL,
+                           accel_char,
+                           error))
+    return FALSE;
+
+  if (attr_list)
+    *attr_list = list;
+  if (text)
+    {
+      *text = g_ref_string_new (plain);
+      g_free (plain);
+    }
+
+  return TRUE;
+}
+
 /**
  * pango_markup_parser_new:
  * @accel_marker: character that precedes an accelerator, or 0 for none
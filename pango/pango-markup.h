@@ -46,6 +46,12 @@ gboolean               pango_parse_markup        (const char            *markup_
                                                   gunichar              *accel_char,
                                                   GError               **error);
 
+PANGO_AVAILABLE_IN_1_52
+void                   pango_markup_cache_set_max_entries (guint         max_entries);
+
+PANGO_AVAILABLE_IN_1_52
+guint                  pango_markup_cache_get_max_entries (void);
+
 
 G_END_DECLS
 
@@ -63,6 +63,9 @@ struct _PangoRendererPrivate
   PangoLayoutLine *line;
   LineState *line_state;
   PangoOverline overline;
+
+  gboolean has_visible_rect;
+  PangoRectangle visible_rect;
 };
 
 static void pango_renderer_finalize                     (GObject          *gobject);
@@ -146,6 +149,26 @@ pango_renderer_finalize (GObject *gobject)
   G_OBJECT_CLASS (pango_renderer_parent_class)->finalize (gobject);
 }
 
+/* Returns whether @rect, offset by @x, @y, intersects
+ * the visible rectangle of @renderer
+ */
+static gboolean
+rect_is_visible (PangoRenderer  *renderer,
+                 int             x,
+                 int             y,
+                 PangoRectangle *rect)
+{
+  PangoRectangle *visible = &renderer->priv->visible_rect;
+
+  if (!renderer->priv->has_visible_rect)
+    return TRUE;
+
+  return x + rect->x < visible->x + visible->width &&
+         x + rect->x + rect->width > visible->x &&
+         y + rect->y < visible->y + visible->height &&
+         y + rect->y + rect->height > visible->y;
+}
+
 /**
  * pango_renderer_draw_layout:
  * @renderer: a `PangoRenderer`
@@ -196,6 +219,21 @@ pango_renderer_draw_layout (PangoRenderer *renderer,
       line = pango_layout_iter_get_line_readonly (&iter);
 
       pango_layout_iter_get_line_extents (&iter, NULL, &logical_rect);
+
+      if (!rect_is_visible (renderer, x, y, &logical_rect))
+        {
+          PangoRectangle ink_rect;
+
+          /* Ink can stick out of the logical extents, so
+           * only skip the line if that is invisible too.
+           * Line extents are cached, so this is cheap when
+           * drawing the same layout repeatedly.
+           */
+          pango_layout_iter_get_line_extents (&iter, &ink_rect, NULL);
+          if (!rect_is_visible (renderer, x, y, &ink_rect))
+            continue;
+        }
+
       baseline = pango_layout_iter_get_baseline (&iter);
 
       pango_renderer_draw_layout_line (renderer,
@@ -550,6 +588,37 @@ draw_shaped_glyphs (PangoRenderer    *renderer,
 }
 
 
+/* Runs of a line that is known to be visible are culled
+ * horizontally by their logical extents first, since those
+ * are known already. Only if that fails do we look at the
+ * ink extents, to catch glyphs that stick out.
+ */
+static gboolean
+run_is_visible (PangoRenderer  *renderer,
+                PangoLayoutRun *run,
+                int             x,
+                int             y,
+                int             width,
+                PangoRectangle *ink)
+{
+  PangoRectangle *visible = &renderer->priv->visible_rect;
+  PangoRectangle ink_rect;
+
+  if (!renderer->priv->has_visible_rect)
+    return TRUE;
+
+  if (x < visible->x + visible->width && x + width > visible->x)
+    return TRUE;
+
+  if (!ink)
+    {
+      pango_glyph_string_extents (run->glyphs, run->item->analysis.font, &ink_rect, NULL);
+      ink = &ink_rect;
+    }
+
+  return rect_is_visible (renderer, x, y, ink);
+}
+
 /**
  * pango_renderer_draw_layout_line:
  * @renderer: a `PangoRenderer`
@@ -686,7 +755,7 @@ pango_renderer_draw_layout_line (PangoRenderer   *renderer,
         {
           draw_shaped_glyphs (renderer, run->glyphs, shape_attr, x + x_off, y - y_off);
         }
-      else
+      else if (run_is_visible (renderer, run, x + x_off, y - y_off, glyph_string_width, ink))
         {
           pango_renderer_draw_glyph_item (renderer,
                                           text,
@@ -1645,3 +1714,62 @@ pango_renderer_get_layout_line (PangoRenderer *renderer)
 {
   return renderer->priv->line;
 }
+
+/**
+ * pango_renderer_set_visible_rect:
+ * @renderer: a `PangoRenderer`
+ * @rect: (nullable): the visible rectangle, or %NULL to unset it
+ *
+ * Sets the part of user space that is visible on the target of
+ * @renderer.
+ *
+ * The rectangle is in the same coordinates as the positions that
+ * are passed to [method@Pango.Renderer.draw_layout] and
+ * [method@Pango.Renderer.draw_layout_line], in Pango units.
+ *
+ * When a visible rectangle is set, lines and runs that don't
+ * intersect it with their logical or ink extents are not drawn.
+ * This makes drawing a small part of a large layout, for example
+ * when scrolling, cost proportional to what is visible.
+ *
+ * Since: 1.52
+ */
+void
+pango_renderer_set_visible_rect (PangoRenderer        *renderer,
+                                 const PangoRectangle *rect)
+{
+  g_return_if_fail (PANGO_IS_RENDERER (renderer));
+
+  if (rect)
+    {
+      renderer->priv->has_visible_rect = TRUE;
+      renderer->priv->visible_rect = *rect;
+    }
+  else
+    renderer->priv->has_visible_rect = FALSE;
+}
+
+/**
+ * pango_renderer_get_visible_rect:
+ * @renderer: a `PangoRenderer`
+ * @rect: (out caller-allocates) (optional): return location for
+ *   the visible rectangle
+ *
+ * Gets the visible rectangle that was set with
+ * [method@Pango.Renderer.set_visible_rect].
+ *
+ * Return value: %TRUE if a visible rectangle is set
+ *
+ * Since: 1.52
+ */
+gboolean
+pango_renderer_get_visible_rect (PangoRenderer  *renderer,
+                                 PangoRectangle *rect)
+{
+  g_return_val_if_fail (PANGO_IS_RENDERER (renderer), FALSE);
+
+  if (rect && renderer->priv->has_visible_rect)
+    *rect = renderer->priv->visible_rect;
+
+  return renderer->priv->has_visible_rect;
+}
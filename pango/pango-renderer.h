@@ -284,6 +284,13 @@ PangoLayout       *pango_renderer_get_layout      (PangoRenderer     *renderer);
 PANGO_AVAILABLE_IN_1_20
 PangoLayoutLine   *pango_renderer_get_layout_line (PangoRenderer     *renderer);
 
+PANGO_AVAILABLE_IN_1_52
+void               pango_renderer_set_visible_rect (PangoRenderer        *renderer,
+                                                    const PangoRectangle *rect);
+PANGO_AVAILABLE_IN_1_52
+gboolean           pango_renderer_get_visible_rect (PangoRenderer        *renderer,
+                                                    PangoRectangle       *rect);
+
 G_END_DECLS
 
 #endif /* __PANGO_RENDERER_H_ */
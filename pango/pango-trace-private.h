@@ -25,6 +25,7 @@
 #endif
 
 #include <glib.h>
+#include <pango/pango-version-macros.h>
 
 G_BEGIN_DECLS
 
@@ -34,11 +35,42 @@ G_BEGIN_DECLS
 #define PANGO_TRACE_CURRENT_TIME 0
 #endif
 
+PANGO_AVAILABLE_IN_ALL
 void pango_trace_mark (gint64       begin_time,
                        const gchar *name,
                        const gchar *message_format,
                        ...) G_GNUC_PRINTF (3, 4);
 
+/* Hit/miss counters for internal caches. Caches keep one
+ * static PangoCacheStats each; it registers itself on first
+ * use. Setting PANGO_CACHE_STATS in the environment prints
+ * a summary of all registered caches at exit.
+ *
+ * These live in libpango and are exported for the other
+ * pango libraries, so that all caches share one registry.
+ */
+typedef struct _PangoCacheStats PangoCacheStats;
+
+struct _PangoCacheStats
+{
+  const char *name;
+  guint hits;
+  guint misses;
+  guint evictions;
+  gsize evicted_bytes;
+  gsize registered;
+};
+
+#define PANGO_CACHE_STATS_INIT(n) { n, 0, 0, 0, 0, 0 }
+
+PANGO_AVAILABLE_IN_ALL
+void pango_cache_stats_hit   (PangoCacheStats *stats);
+PANGO_AVAILABLE_IN_ALL
+void pango_cache_stats_miss  (PangoCacheStats *stats);
+PANGO_AVAILABLE_IN_ALL
+void pango_cache_stats_evict (PangoCacheStats *stats,
+                              gsize            bytes);
+
 #ifndef HAVE_SYSPROF
 /* Optimise the whole call out */
 #if defined(G_HAVE_ISO_VARARGS)
@@ -22,6 +22,7 @@
 #include "pango-trace-private.h"
 
 #include <stdarg.h>
+#include <stdlib.h>
 
 void
 (pango_trace_mark) (gint64       begin_time,
@@ -38,3 +39,77 @@ void
   va_end (args);
 #endif  /* HAVE_SYSPROF */
 }
+
+static GMutex cache_stats_lock;
+static GSList *cache_stats_list;
+
+static void
+dump_cache_stats (void)
+{
+  GSList *l;
+
+  g_mutex_lock (&cache_stats_lock);
+
+  for (l = cache_stats_list; l; l = l->next)
+    {
+      PangoCacheStats *stats = l->data;
+      guint hits = g_atomic_int_get (&stats->hits);
+      guint misses = g_atomic_int_get (&stats->misses);
+      guint lookups = hits + misses;
+
+      g_printerr ("%s: %u lookups, %u hits (%.1f%%), %u evictions (%" G_GSIZE_FORMAT " bytes)\n",
+                  stats->name,
+                  lookups,
+                  hits,
+                  lookups ? 100. * hits / lookups : 0.,
+                  (guint) g_atomic_int_get (&stats->evictions),
+                  (gsize) g_atomic_pointer_get (&stats->evicted_bytes));
+    }
+
+  g_mutex_unlock (&cache_stats_lock);
+}
+
+static void
+cache_stats_register (PangoCacheStats *stats)
+{
+  if (g_once_init_enter (&stats->registered))
+    {
+      g_mutex_lock (&cache_stats_lock);
+
+      if (cache_stats_list == NULL && g_getenv ("PANGO_CACHE_STATS") != NULL)
+        atexit (dump_cache_stats);
+
+      cache_stats_list = g_slist_prepend (cache_stats_list, stats);
+
+      g_mutex_unlock (&cache_stats_lock);
+
+      g_once_init_leave (&stats->registered, 1);
+    }
+}
+
+void
+pango_cache_stats_hit (PangoCacheStats *stats)
+{
+  cache_stats_register (stats);
+  g_atomic_int_inc (&stats->hits);
+}
+
+void
+pango_cache_stats_miss (PangoCacheStats *stats)
+{
+  cache_stats_register (stats);
+  g_atomic_int_inc (&stats->misses);
+}
+
+void
+pango_cache_stats_evict (PangoCacheStats *stats,
+                         gsize            bytes)
+{
+  gint64 before = PANGO_TRACE_CURRENT_TIME;
+
+  cache_stats_register (stats);
+  g_atomic_int_inc (&stats->evictions);
+  g_atomic_pointer_add (&stats->evicted_bytes, bytes);
+
+  pango_trace_mark (before, "cache eviction", "%s: %" G_GSIZE_FORMAT " bytes", stats->name, bytes);
+}
@@ -36,6 +36,7 @@
 #include <pango/pango-fontmap.h>
 #include <pango/pango-fontset.h>
 #include <pango/pango-glyph.h>
+#include <pango/pango-glyph-export.h>
 #include <pango/pango-glyph-item.h>
 #include <pango/pango-gravity.h>
 #include <pango/pango-item.h>
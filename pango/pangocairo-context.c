@@ -24,6 +24,7 @@
 #include "pangocairo.h"
 #include "pangocairo-private.h"
 #include "pango-impl-utils.h"
+#include "pango-context-private.h"
 
 #include <string.h>
 
@@ -89,6 +90,22 @@ retry:
   return info;
 }
 
+/* Records the font options that affect glyph positions on the
+ * context, so that serialized layout output can be checked
+ * against them
+ */
+static void
+update_font_options_string (PangoContext               *context,
+                            const cairo_font_options_t *options)
+{
+  g_free (context->font_options);
+  context->font_options = g_strdup_printf ("antialias=%d,subpixel-order=%d,hint-style=%d,hint-metrics=%d",
+                                           cairo_font_options_get_antialias (options),
+                                           cairo_font_options_get_subpixel_order (options),
+                                           cairo_font_options_get_hint_style (options),
+                                           cairo_font_options_get_hint_metrics (options));
+}
+
 static void
 _pango_cairo_update_context (cairo_t      *cr,
 			     PangoContext *context)
@@ -120,6 +137,7 @@ _pango_cairo_update_context (cairo_t      *cr,
   info->merged_options = NULL;
 
   merged_options = _pango_cairo_context_get_merged_font_options (context);
+  update_font_options_string (context, merged_options);
 
   if (old_merged_options)
     {
@@ -279,6 +297,8 @@ pango_cairo_context_set_font_options (PangoContext               *context,
       cairo_font_options_destroy (info->merged_options);
       info->merged_options = NULL;
     }
+
+  update_font_options_string (context, _pango_cairo_context_get_merged_font_options (context));
 }
 
 /**
@@ -31,6 +31,7 @@
 #include "pangocairo-private.h"
 #include "pangocairo-fc-private.h"
 #include "pangofc-private.h"
+#include "pango-font-private.h"
 #include "pango-impl-utils.h"
 
 #include <hb-ot.h>
@@ -129,6 +130,20 @@ pango_cairo_fc_font_get_glyph_extents (PangoFont      *font,
 					       logical_rect);
 }
 
+static void
+pango_cairo_fc_font_get_glyphs_extents (PangoFont            *font,
+                                        const PangoGlyphInfo *glyphs,
+                                        int                   n_glyphs,
+                                        PangoRectangle       *ink_rects,
+                                        PangoRectangle       *logical_rects)
+{
+  PangoCairoFcFont *cffont = (PangoCairoFcFont *) (font);
+
+  _pango_cairo_font_private_get_glyphs_extents (&cffont->cf_priv,
+                                                glyphs, n_glyphs,
+                                                ink_rects, logical_rects);
+}
+
 static FT_Face
 pango_cairo_fc_font_lock_face (PangoFcFont *font)
 {
@@ -159,6 +174,7 @@ pango_cairo_fc_font_class_init (PangoCairoFcFontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoFcFontClass *fc_font_class = PANGO_FC_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_cairo_fc_font_finalize;
 
@@ -167,6 +183,10 @@ pango_cairo_fc_font_class_init (PangoCairoFcFontClass *class)
 
   fc_font_class->lock_face = pango_cairo_fc_font_lock_face;
   fc_font_class->unlock_face = pango_cairo_fc_font_unlock_face;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+
+  pclass->get_glyphs_extents = pango_cairo_fc_font_get_glyphs_extents;
 }
 
 static void
@@ -161,6 +161,52 @@ pango_cairo_font_get_scaled_font (PangoCairoFont *cfont)
   return _pango_cairo_font_private_get_scaled_font (cf_priv);
 }
 
+/**
+ * pango_cairo_font_get_glyph_extents_cache_stats:
+ * @font: a `PangoFont` from a `PangoCairoFontMap`
+ * @size: (out) (optional): return location for the number
+ *   of glyphs in the cache
+ * @hits: (out) (optional): return location for the number
+ *   of lookups that found their glyph in the cache
+ * @misses: (out) (optional): return location for the number
+ *   of lookups that had to compute the glyph extents
+ * @evictions: (out) (optional): return location for the number
+ *   of glyphs that were dropped from the cache to make room
+ *   for others
+ *
+ * Gets statistics about the cache that @font keeps
+ * for glyph extents.
+ *
+ * The cache grows with the number of different glyphs
+ * that are measured, up to a fixed limit. A high number
+ * of evictions relative to misses means that the working
+ * set of glyphs exceeds that limit.
+ *
+ * Since: 1.52
+ */
+void
+pango_cairo_font_get_glyph_extents_cache_stats (PangoCairoFont *font,
+                                                guint          *size,
+                                                guint          *hits,
+                                                guint          *misses,
+                                                guint          *evictions)
+{
+  PangoCairoFontPrivate *cf_priv;
+
+  g_return_if_fail (PANGO_IS_CAIRO_FONT (font));
+
+  cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
+
+  if (size)
+    *size = cf_priv->glyph_extents_cache_used;
+  if (hits)
+    *hits = cf_priv->glyph_extents_cache_hits;
+  if (misses)
+    *misses = cf_priv->glyph_extents_cache_misses;
+  if (evictions)
+    *evictions = cf_priv->glyph_extents_cache_evictions;
+}
+
 /**
  * _pango_cairo_font_install:
  * @font: a `PangoCairoFont`
@@ -186,30 +232,6 @@ _pango_cairo_font_install (PangoFont *font,
 }
 
 
-static int
-max_glyph_width (PangoLayout *layout)
-{
-  int max_width = 0;
-  GSList *l, *r;
-
-  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
-    {
-      PangoLayoutLine *line = l->data;
-
-      for (r = line->runs; r; r = r->next)
-	{
-	  PangoGlyphString *glyphs = ((PangoGlyphItem *)r->data)->glyphs;
-	  int i;
-
-	  for (i = 0; i < glyphs->num_glyphs; i++)
-	    if (glyphs->glyphs[i].geometry.width > max_width)
-	      max_width = glyphs->glyphs[i].geometry.width;
-	}
-    }
-
-  return max_width;
-}
-
 typedef struct _PangoCairoFontMetricsInfo
 {
   const char       *sample_str;
@@ -224,7 +246,6 @@ _pango_cairo_font_get_metrics (PangoFont     *font,
   PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
   PangoCairoFontMetricsInfo *info = NULL; /* Quiet gcc */
   GSList *tmp_list;
-  static int in_get_metrics;
 
   const char *sample_str = pango_language_get_sample_string (language);
 
@@ -244,14 +265,10 @@ _pango_cairo_font_get_metrics (PangoFont     *font,
       PangoFontMap *fontmap;
       PangoContext *context;
       cairo_font_options_t *font_options;
-      PangoLayout *layout;
-      PangoRectangle extents;
-      PangoFontDescription *desc;
       cairo_scaled_font_t *scaled_font;
       cairo_matrix_t cairo_matrix;
       PangoMatrix pango_matrix;
       PangoMatrix identity = PANGO_MATRIX_INIT;
-      glong sample_str_width;
 
       int height, shift;
 
@@ -301,36 +318,12 @@ _pango_cairo_font_get_metrics (PangoFont     *font,
 	  info->metrics->strikethrough_thickness *= xscale;
 	}
 
-      /* Set the matrix on the context so we don't have to adjust the derived
-       * metrics. */
-      pango_context_set_matrix (context, &pango_matrix);
-
-      /* Ugly. We need to prevent recursion when we call into
-       * PangoLayout to determine approximate char width.
+      /* Update approximate_*_width now. The glyph extents
+       * are in user space, so they don't need adjusting.
        */
-      if (!in_get_metrics)
-        {
-          in_get_metrics = 1;
-
-          /* Update approximate_*_width now */
-          layout = pango_layout_new (context);
-          desc = pango_font_describe_with_absolute_size (font);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
-
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
-
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
-
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
-
-          g_object_unref (layout);
-          in_get_metrics = 0;
-        }
+      pango_font_get_approximate_widths (font, sample_str,
+                                         &info->metrics->approximate_char_width,
+                                         &info->metrics->approximate_digit_width);
 
       /* We may actually reuse ascent/descent we got from cairo here.  that's
        * in cf_priv->font_extents.
@@ -633,7 +626,14 @@ _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
 
   cf_priv->scaled_font = NULL;
   cf_priv->hbi = NULL;
-  cf_priv->glyph_extents_cache = NULL;
+  cf_priv->glyph_extents_cache_initialized = FALSE;
+  pango_glyph_table_init (&cf_priv->glyph_extents_cache,
+                          sizeof (PangoCairoFontGlyphExtentsCacheEntry));
+  cf_priv->glyph_extents_cache_used = 0;
+  cf_priv->glyph_extents_cache_cursor = 0;
+  cf_priv->glyph_extents_cache_hits = 0;
+  cf_priv->glyph_extents_cache_misses = 0;
+  cf_priv->glyph_extents_cache_evictions = 0;
   cf_priv->metrics_by_lang = NULL;
 }
 
@@ -656,9 +656,9 @@ _pango_cairo_font_private_finalize (PangoCairoFontPrivate *cf_priv)
   _pango_cairo_font_hex_box_info_destroy (cf_priv->hbi);
   cf_priv->hbi = NULL;
 
-  if (cf_priv->glyph_extents_cache)
-    g_free (cf_priv->glyph_extents_cache);
-  cf_priv->glyph_extents_cache = NULL;
+  pango_glyph_table_clear (&cf_priv->glyph_extents_cache);
+  cf_priv->glyph_extents_cache_initialized = FALSE;
+  cf_priv->glyph_extents_cache_used = 0;
 
   g_slist_foreach (cf_priv->metrics_by_lang, (GFunc)free_metrics_info, NULL);
   g_slist_free (cf_priv->metrics_by_lang);
@@ -767,16 +767,20 @@ _pango_cairo_font_private_get_glyph_extents_missing (PangoCairoFontPrivate *cf_p
     }
 }
 
-#define GLYPH_CACHE_NUM_ENTRIES 256 /* should be power of two */
-#define GLYPH_CACHE_MASK (GLYPH_CACHE_NUM_ENTRIES - 1)
-/* An entry in the fixed-size cache for the glyph->extents mapping.
- * The cache is indexed by the lower N bits of the glyph (see
- * GLYPH_CACHE_NUM_ENTRIES).  For scripts with few glyphs,
- * this should provide pretty much instant lookups.
+#define GLYPH_CACHE_MAX_ENTRIES 8192
+/* An entry in the cache for the glyph->extents mapping.
+ * The cache is a PangoGlyphTable, like the per-glyph data of
+ * the FT2 and Xft fonts, so lookups index pages directly and
+ * the cache grows with the glyphs that are actually used.
+ *
+ * At most GLYPH_CACHE_MAX_ENTRIES glyphs are cached. After
+ * that, a new glyph evicts a whole page of the table, so that
+ * its memory is actually freed. A cursor sweeps through the
+ * pages, so that the same glyphs don't always lose.
  */
 struct _PangoCairoFontGlyphExtentsCacheEntry
 {
-  PangoGlyph     glyph;
+  gboolean       cached;
   int            width;
   PangoRectangle ink_rect;
 };
@@ -832,14 +836,72 @@ _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_pr
       cf_priv->font_extents.height = - cf_priv->font_extents.height;
     }
 
-  if (!cf_priv->glyph_extents_cache)
+  cf_priv->glyph_extents_cache_initialized = TRUE;
+
+  return TRUE;
+}
+
+static guint
+glyph_extents_cache_count_page (PangoCairoFontPrivate *cf_priv,
+                                guint                  page)
+{
+  guint count = 0;
+  guint i;
+
+  for (i = 0; i < PANGO_GLYPH_TABLE_PAGE_SIZE; i++)
     {
-      cf_priv->glyph_extents_cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, GLYPH_CACHE_NUM_ENTRIES);
-      /* Make sure all cache entries are invalid initially */
-      cf_priv->glyph_extents_cache[0].glyph = 1; /* glyph 1 cannot happen in bucket 0 */
+      PangoCairoFontGlyphExtentsCacheEntry *entry;
+
+      entry = pango_glyph_table_lookup (&cf_priv->glyph_extents_cache,
+                                        (page << PANGO_GLYPH_TABLE_PAGE_BITS) + i,
+                                        FALSE);
+      if (!entry)
+        return 0;
+
+      if (entry->cached)
+        count++;
     }
 
-  return TRUE;
+  return count;
+}
+
+/* Frees the first page at or after the cursor, other than
+ * the page of @keep, and moves the cursor past it
+ */
+static void
+glyph_extents_cache_evict (PangoCairoFontPrivate *cf_priv,
+                           PangoGlyph             keep)
+{
+  PangoGlyphTable *table = &cf_priv->glyph_extents_cache;
+  guint keep_page = keep >> PANGO_GLYPH_TABLE_PAGE_BITS;
+  guint evicted;
+  guint i;
+
+  for (i = 0; i < table->n_pages; i++)
+    {
+      guint page = (cf_priv->glyph_extents_cache_cursor + i) % table->n_pages;
+
+      if (page == keep_page || !table->pages[page])
+        continue;
+
+      evicted = glyph_extents_cache_count_page (cf_priv, page);
+      pango_glyph_table_remove_page (table, page);
+
+      cf_priv->glyph_extents_cache_cursor = page + 1;
+      cf_priv->glyph_extents_cache_used -= evicted;
+      cf_priv->glyph_extents_cache_evictions += evicted;
+      return;
+    }
+
+  /* Everything else is in the overflow table */
+  evicted = cf_priv->glyph_extents_cache_used;
+  if (keep_page < PANGO_GLYPH_TABLE_MAX_PAGES)
+    evicted -= glyph_extents_cache_count_page (cf_priv, keep_page);
+
+  pango_glyph_table_remove_page (table, PANGO_GLYPH_TABLE_MAX_PAGES);
+
+  cf_priv->glyph_extents_cache_used -= evicted;
+  cf_priv->glyph_extents_cache_evictions += evicted;
 }
 
 
@@ -860,7 +922,7 @@ compute_glyph_extents (PangoCairoFontPrivate  *cf_priv,
   cairo_scaled_font_glyph_extents (_pango_cairo_font_private_get_scaled_font (cf_priv),
 				   &cairo_glyph, 1, &extents);
 
-  entry->glyph = glyph;
+  entry->cached = TRUE;
   if (PANGO_GRAVITY_IS_VERTICAL (cf_priv->gravity))
     entry->width = pango_units_from_double (extents.y_advance);
   else
@@ -876,19 +938,59 @@ _pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate
 							 PangoGlyph              glyph)
 {
   PangoCairoFontGlyphExtentsCacheEntry *entry;
-  guint idx;
 
-  idx = glyph & GLYPH_CACHE_MASK;
-  entry = cf_priv->glyph_extents_cache + idx;
+  entry = pango_glyph_table_lookup (&cf_priv->glyph_extents_cache, glyph, TRUE);
 
-  if (entry->glyph != glyph)
+  if (G_LIKELY (entry->cached))
     {
-      compute_glyph_extents (cf_priv, glyph, entry);
+      cf_priv->glyph_extents_cache_hits++;
+      return entry;
     }
 
+  cf_priv->glyph_extents_cache_misses++;
+
+  if (cf_priv->glyph_extents_cache_used >= GLYPH_CACHE_MAX_ENTRIES)
+    {
+      glyph_extents_cache_evict (cf_priv, glyph);
+
+      /* Evicting the overflow table frees the entry */
+      entry = pango_glyph_table_lookup (&cf_priv->glyph_extents_cache, glyph, TRUE);
+    }
+
+  cf_priv->glyph_extents_cache_used++;
+  compute_glyph_extents (cf_priv, glyph, entry);
+
   return entry;
 }
 
+static inline void
+get_logical_rect (PangoCairoFontPrivate                *cf_priv,
+                  PangoCairoFontGlyphExtentsCacheEntry *entry,
+                  PangoRectangle                       *logical_rect)
+{
+  *logical_rect = cf_priv->font_extents;
+  switch (cf_priv->gravity)
+    {
+    case PANGO_GRAVITY_SOUTH:
+      logical_rect->width = entry->width;
+      break;
+    case PANGO_GRAVITY_EAST:
+      logical_rect->width = cf_priv->font_extents.height;
+      logical_rect->x = - logical_rect->width;
+      break;
+    case PANGO_GRAVITY_NORTH:
+      logical_rect->width = entry->width;
+      break;
+    case PANGO_GRAVITY_WEST:
+      logical_rect->width = - cf_priv->font_extents.height;
+      logical_rect->x = - logical_rect->width;
+      break;
+    case PANGO_GRAVITY_AUTO:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
 void
 _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
 					     PangoGlyph             glyph,
@@ -898,7 +1000,7 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
   PangoCairoFontGlyphExtentsCacheEntry *entry;
 
   if (!cf_priv ||
-      (cf_priv->glyph_extents_cache == NULL &&
+      (!cf_priv->glyph_extents_cache_initialized &&
        !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv)))
     {
       /* Get generic unknown-glyph extents. */
@@ -925,27 +1027,51 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
   if (ink_rect)
     *ink_rect = entry->ink_rect;
   if (logical_rect)
+    get_logical_rect (cf_priv, entry, logical_rect);
+}
+
+/* Like _pango_cairo_font_private_get_glyph_extents(), for
+ * many glyphs. The cache is only set up once, and the common
+ * case of real glyphs goes straight to the cache.
+ */
+void
+_pango_cairo_font_private_get_glyphs_extents (PangoCairoFontPrivate *cf_priv,
+                                              const PangoGlyphInfo  *glyphs,
+                                              int                    n_glyphs,
+                                              PangoRectangle        *ink_rects,
+                                              PangoRectangle        *logical_rects)
+{
+  int i;
+
+  if (!cf_priv ||
+      (!cf_priv->glyph_extents_cache_initialized &&
+       !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv)))
     {
-      *logical_rect = cf_priv->font_extents;
-      switch (cf_priv->gravity)
+      for (i = 0; i < n_glyphs; i++)
+        pango_font_get_glyph_extents (NULL, glyphs[i].glyph,
+                                      ink_rects ? &ink_rects[i] : NULL,
+                                      logical_rects ? &logical_rects[i] : NULL);
+      return;
+    }
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoGlyph glyph = glyphs[i].glyph;
+      PangoCairoFontGlyphExtentsCacheEntry *entry;
+
+      if (G_UNLIKELY (glyph == PANGO_GLYPH_EMPTY || (glyph & PANGO_GLYPH_UNKNOWN_FLAG)))
         {
-        case PANGO_GRAVITY_SOUTH:
-          logical_rect->width = entry->width;
-          break;
-        case PANGO_GRAVITY_EAST:
-          logical_rect->width = cf_priv->font_extents.height;
-          logical_rect->x = - logical_rect->width;
-          break;
-        case PANGO_GRAVITY_NORTH:
-          logical_rect->width = entry->width;
-          break;
-        case PANGO_GRAVITY_WEST:
-          logical_rect->width = - cf_priv->font_extents.height;
-          logical_rect->x = - logical_rect->width;
-          break;
-        case PANGO_GRAVITY_AUTO:
-        default:
-          g_assert_not_reached ();
+          _pango_cairo_font_private_get_glyph_extents (cf_priv, glyph,
+                                                       ink_rects ? &ink_rects[i] : NULL,
+                                                       logical_rects ? &logical_rects[i] : NULL);
+          continue;
         }
+
+      entry = _pango_cairo_font_private_get_glyph_extents_cache_entry (cf_priv, glyph);
+
+      if (ink_rects)
+        ink_rects[i] = entry->ink_rect;
+      if (logical_rects)
+        get_logical_rect (cf_priv, entry, &logical_rects[i]);
     }
 }
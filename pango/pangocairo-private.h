@@ -24,6 +24,7 @@
 
 #include <pango/pangocairo.h>
 #include <pango/pango-renderer.h>
+#include "pango-glyph-table-private.h"
 
 G_BEGIN_DECLS
 
@@ -85,7 +86,13 @@ struct _PangoCairoFontPrivate
   PangoGravity gravity;
 
   PangoRectangle font_extents;
-  PangoCairoFontGlyphExtentsCacheEntry *glyph_extents_cache;
+  gboolean glyph_extents_cache_initialized;
+  PangoGlyphTable glyph_extents_cache;
+  guint glyph_extents_cache_used;
+  guint glyph_extents_cache_cursor;
+  guint glyph_extents_cache_hits;
+  guint glyph_extents_cache_misses;
+  guint glyph_extents_cache_evictions;
 
   GSList *metrics_by_lang;
 };
@@ -120,6 +127,11 @@ void _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv
 						  PangoGlyph             glyph,
 						  PangoRectangle        *ink_rect,
 						  PangoRectangle        *logical_rect);
+void _pango_cairo_font_private_get_glyphs_extents (PangoCairoFontPrivate *cf_priv,
+						   const PangoGlyphInfo  *glyphs,
+						   int                    n_glyphs,
+						   PangoRectangle        *ink_rects,
+						   PangoRectangle        *logical_rects);
 
 #define PANGO_TYPE_CAIRO_RENDERER            (pango_cairo_renderer_get_type())
 #define PANGO_CAIRO_RENDERER(object)         (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_CAIRO_RENDERER, PangoCairoRenderer))
@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 
 #include "pango-font-private.h"
 #include "pangocairo-private.h"
@@ -46,6 +47,15 @@ struct _PangoCairoRenderer
   /* house-keeping options */
   gboolean is_cached_renderer;
   gboolean cr_had_current_point;
+
+  /* Glyphs of consecutive runs that share a font and a
+   * foreground color, waiting to be shown in one go.
+   * See flush_glyphs().
+   */
+  GArray *pending_glyphs;
+  PangoFont *pending_font;
+  gboolean pending_has_color;
+  double pending_color[4];
 };
 
 struct _PangoCairoRendererClass
@@ -55,16 +65,17 @@ struct _PangoCairoRendererClass
 
 G_DEFINE_TYPE (PangoCairoRenderer, pango_cairo_renderer, PANGO_TYPE_RENDERER)
 
-static void
-set_color (PangoCairoRenderer *crenderer,
-	   PangoRenderPart     part)
+static gboolean
+get_color (PangoCairoRenderer *crenderer,
+           PangoRenderPart     part,
+           double              rgba[4])
 {
   PangoColor *color = pango_renderer_get_color ((PangoRenderer *) (crenderer), part);
   guint16 a = pango_renderer_get_alpha ((PangoRenderer *) (crenderer), part);
   gdouble red, green, blue, alpha;
 
   if (!a && !color)
-    return;
+    return FALSE;
 
   if (color)
     {
@@ -91,7 +102,64 @@ set_color (PangoCairoRenderer *crenderer,
   if (a)
     alpha = a / 65535.;
 
-  cairo_set_source_rgba (crenderer->cr, red, green, blue, alpha);
+  rgba[0] = red;
+  rgba[1] = green;
+  rgba[2] = blue;
+  rgba[3] = alpha;
+
+  return TRUE;
+}
+
+static void
+set_color (PangoCairoRenderer *crenderer,
+	   PangoRenderPart     part)
+{
+  double rgba[4];
+
+  if (get_color (crenderer, part, rgba))
+    cairo_set_source_rgba (crenderer->cr, rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+/* Shows the glyphs that have been collected by
+ * pango_cairo_renderer_show_text_glyphs(), with a single
+ * cairo_show_glyphs() call. This must be called before
+ * anything else is drawn, to preserve the painting order.
+ */
+static void
+flush_glyphs (PangoCairoRenderer *crenderer)
+{
+  cairo_t *cr = crenderer->cr;
+
+  if (!crenderer->pending_font)
+    return;
+
+  if (crenderer->pending_glyphs->len > 0)
+    {
+      cairo_save (cr);
+
+      if (crenderer->pending_has_color)
+        cairo_set_source_rgba (cr,
+                               crenderer->pending_color[0],
+                               crenderer->pending_color[1],
+                               crenderer->pending_color[2],
+                               crenderer->pending_color[3]);
+
+      _pango_cairo_font_install (crenderer->pending_font, cr);
+
+      if (G_UNLIKELY (crenderer->do_path))
+        cairo_glyph_path (cr,
+                          (cairo_glyph_t *) crenderer->pending_glyphs->data,
+                          crenderer->pending_glyphs->len);
+      else
+        cairo_show_glyphs (cr,
+                           (cairo_glyph_t *) crenderer->pending_glyphs->data,
+                           crenderer->pending_glyphs->len);
+
+      cairo_restore (cr);
+    }
+
+  g_array_set_size (crenderer->pending_glyphs, 0);
+  g_clear_object (&crenderer->pending_font);
 }
 
 /* note: modifies crenderer->cr without doing cairo_save/restore() */
@@ -401,6 +469,79 @@ done:
 
 #define STACK_ARRAY_LENGTH(T) (STACK_BUFFER_SIZE / sizeof(T))
 
+/* Runs can only be batched if all their glyphs go through
+ * cairo_show_glyphs(); hex boxes for unknown glyphs are drawn
+ * separately and would end up out of order.
+ */
+static gboolean
+can_batch_glyphs (PangoFont        *font,
+                  PangoGlyphString *glyphs)
+{
+  cairo_scaled_font_t *scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *)font);
+  int i;
+
+  if (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS)
+    return FALSE;
+
+  for (i = 0; i < glyphs->num_glyphs; i++)
+    {
+      PangoGlyph glyph = glyphs->glyphs[i].glyph;
+
+      if ((glyph & PANGO_GLYPH_UNKNOWN_FLAG) &&
+          glyph != (0x20 | PANGO_GLYPH_UNKNOWN_FLAG))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+queue_glyphs (PangoCairoRenderer *crenderer,
+              PangoFont          *font,
+              PangoGlyphString   *glyphs,
+              double              base_x,
+              double              base_y)
+{
+  gboolean has_color = FALSE;
+  double color[4] = { 0., 0., 0., 0. };
+  int x_position = 0;
+  int i;
+
+  if (!crenderer->do_path)
+    has_color = get_color (crenderer, PANGO_RENDER_PART_FOREGROUND, color);
+
+  if (crenderer->pending_font != font ||
+      crenderer->pending_has_color != has_color ||
+      (has_color && memcmp (crenderer->pending_color, color, sizeof (color)) != 0))
+    {
+      flush_glyphs (crenderer);
+
+      crenderer->pending_font = g_object_ref (font);
+      crenderer->pending_has_color = has_color;
+      memcpy (crenderer->pending_color, color, sizeof (color));
+    }
+
+  for (i = 0; i < glyphs->num_glyphs; i++)
+    {
+      PangoGlyphInfo *gi = &glyphs->glyphs[i];
+
+      if (gi->glyph != PANGO_GLYPH_EMPTY &&
+          !(gi->glyph & PANGO_GLYPH_UNKNOWN_FLAG))
+        {
+          cairo_glyph_t cg;
+
+          cg.index = gi->glyph;
+          cg.x = base_x + (double)(x_position + gi->geometry.x_offset) / PANGO_SCALE;
+          cg.y = gi->geometry.y_offset == 0 ?
+                 base_y :
+                 base_y + (double)(gi->geometry.y_offset) / PANGO_SCALE;
+
+          g_array_append_val (crenderer->pending_glyphs, cg);
+        }
+      x_position += gi->geometry.width;
+    }
+}
+
 static void
 pango_cairo_renderer_show_text_glyphs (PangoRenderer        *renderer,
 				       const char           *text,
@@ -422,6 +563,14 @@ pango_cairo_renderer_show_text_glyphs (PangoRenderer        *renderer,
   double base_x = crenderer->x_offset + (double)x / PANGO_SCALE;
   double base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
 
+  if (!clusters && can_batch_glyphs (font, glyphs))
+    {
+      queue_glyphs (crenderer, font, glyphs, base_x, base_y);
+      return;
+    }
+
+  flush_glyphs (crenderer);
+
   cairo_save (crenderer->cr);
   if (!crenderer->do_path)
     set_color (crenderer, PANGO_RENDER_PART_FOREGROUND);
@@ -606,6 +755,8 @@ pango_cairo_renderer_draw_rectangle (PangoRenderer     *renderer,
 {
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
 
+  flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (crenderer->cr);
@@ -640,6 +791,8 @@ pango_cairo_renderer_draw_trapezoid (PangoRenderer     *renderer,
   cairo_t *cr;
   double x, y;
 
+  flush_glyphs (crenderer);
+
   cr = crenderer->cr;
 
   cairo_save (cr);
@@ -748,6 +901,8 @@ pango_cairo_renderer_draw_error_underline (PangoRenderer *renderer,
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
   cairo_t *cr = crenderer->cr;
 
+  flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (cr);
@@ -794,6 +949,8 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
   if (!shape_renderer)
     return;
 
+  flush_glyphs (crenderer);
+
   base_x = crenderer->x_offset + (double)x / PANGO_SCALE;
   base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
 
@@ -809,21 +966,43 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
 }
 
 static void
-pango_cairo_renderer_init (PangoCairoRenderer *renderer G_GNUC_UNUSED)
+pango_cairo_renderer_end (PangoRenderer *renderer)
 {
+  flush_glyphs ((PangoCairoRenderer *) renderer);
+}
+
+static void
+pango_cairo_renderer_init (PangoCairoRenderer *renderer)
+{
+  renderer->pending_glyphs = g_array_new (FALSE, FALSE, sizeof (cairo_glyph_t));
+}
+
+static void
+pango_cairo_renderer_finalize (GObject *object)
+{
+  PangoCairoRenderer *renderer = (PangoCairoRenderer *) object;
+
+  g_array_unref (renderer->pending_glyphs);
+  g_clear_object (&renderer->pending_font);
+
+  G_OBJECT_CLASS (pango_cairo_renderer_parent_class)->finalize (object);
 }
 
 static void
 pango_cairo_renderer_class_init (PangoCairoRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (klass);
 
+  object_class->finalize = pango_cairo_renderer_finalize;
+
   renderer_class->draw_glyphs = pango_cairo_renderer_draw_glyphs;
   renderer_class->draw_glyph_item = pango_cairo_renderer_draw_glyph_item;
   renderer_class->draw_rectangle = pango_cairo_renderer_draw_rectangle;
   renderer_class->draw_trapezoid = pango_cairo_renderer_draw_trapezoid;
   renderer_class->draw_error_underline = pango_cairo_renderer_draw_error_underline;
   renderer_class->draw_shape = pango_cairo_renderer_draw_shape;
+  renderer_class->end = pango_cairo_renderer_end;
 }
 
 static PangoCairoRenderer *cached_renderer = NULL; /* MT-safe */
@@ -862,6 +1041,7 @@ release_renderer (PangoCairoRenderer *renderer)
       renderer->has_show_text_glyphs = FALSE;
       renderer->x_offset = 0.;
       renderer->y_offset = 0.;
+      pango_renderer_set_visible_rect ((PangoRenderer *) renderer, NULL);
 
       G_UNLOCK (cached_renderer);
     }
@@ -889,6 +1069,33 @@ restore_current_point (PangoCairoRenderer *renderer)
     cairo_new_sub_path (renderer->cr);
 }
 
+/* Lets the renderer skip lines and runs that are clipped away.
+ * Must be called after save_current_point().
+ */
+static void
+set_visible_rect_from_clip (PangoCairoRenderer *renderer)
+{
+  double x1, y1, x2, y2;
+  PangoRectangle rect;
+
+  cairo_clip_extents (renderer->cr, &x1, &y1, &x2, &y2);
+
+  /* Unbounded clips have huge extents, don't overflow */
+#define CLIP_LIMIT (G_MAXINT / 4.)
+  x1 = CLAMP ((x1 - renderer->x_offset) * PANGO_SCALE, -CLIP_LIMIT, CLIP_LIMIT);
+  y1 = CLAMP ((y1 - renderer->y_offset) * PANGO_SCALE, -CLIP_LIMIT, CLIP_LIMIT);
+  x2 = CLAMP ((x2 - renderer->x_offset) * PANGO_SCALE, -CLIP_LIMIT, CLIP_LIMIT);
+  y2 = CLAMP ((y2 - renderer->y_offset) * PANGO_SCALE, -CLIP_LIMIT, CLIP_LIMIT);
+#undef CLIP_LIMIT
+
+  rect.x = floor (x1);
+  rect.y = floor (y1);
+  rect.width = ceil (x2) - rect.x;
+  rect.height = ceil (y2) - rect.y;
+
+  pango_renderer_set_visible_rect ((PangoRenderer *) renderer, &rect);
+}
+
 
 /* convenience wrappers using the default renderer */
 
@@ -985,6 +1192,9 @@ _pango_cairo_do_layout_line (cairo_t          *cr,
   crenderer->do_path = do_path;
   save_current_point (crenderer);
 
+  if (!do_path)
+    set_visible_rect_from_clip (crenderer);
+
   pango_renderer_draw_layout_line (renderer, line, 0, 0);
 
   restore_current_point (crenderer);
@@ -1004,6 +1214,9 @@ _pango_cairo_do_layout (cairo_t     *cr,
   crenderer->do_path = do_path;
   save_current_point (crenderer);
 
+  if (!do_path)
+    set_visible_rect_from_clip (crenderer);
+
   pango_renderer_draw_layout (renderer, layout, 0, 0);
 
   restore_current_point (crenderer);
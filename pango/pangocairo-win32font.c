@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "pango-fontmap.h"
+#include "pango-font-private.h"
 #include "pango-impl-utils.h"
 #include "pangocairo-private.h"
 #include "pangocairo-win32.h"
@@ -141,6 +142,20 @@ pango_cairo_win32_font_get_glyph_extents (PangoFont        *font,
 					       logical_rect);
 }
 
+static void
+pango_cairo_win32_font_get_glyphs_extents (PangoFont            *font,
+                                           const PangoGlyphInfo *glyphs,
+                                           int                   n_glyphs,
+                                           PangoRectangle       *ink_rects,
+                                           PangoRectangle       *logical_rects)
+{
+  PangoCairoWin32Font *cwfont = (PangoCairoWin32Font *) font;
+
+  _pango_cairo_font_private_get_glyphs_extents (&cwfont->cf_priv,
+                                                glyphs, n_glyphs,
+                                                ink_rects, logical_rects);
+}
+
 static gboolean
 pango_cairo_win32_font_select_font (PangoFont *font,
 				    HDC        hdc)
@@ -173,6 +188,7 @@ pango_cairo_win32_font_class_init (PangoCairoWin32FontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoWin32FontClass *win32_font_class = PANGO_WIN32_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_cairo_win32_font_finalize;
 
@@ -182,6 +198,10 @@ pango_cairo_win32_font_class_init (PangoCairoWin32FontClass *class)
   win32_font_class->select_font = pango_cairo_win32_font_select_font;
   win32_font_class->done_font = pango_cairo_win32_font_done_font;
   win32_font_class->get_metrics_factor = pango_cairo_win32_font_get_metrics_factor;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+
+  pclass->get_glyphs_extents = pango_cairo_win32_font_get_glyphs_extents;
 }
 
 static void
@@ -25,7 +25,6 @@
 #include "pangofc-font-private.h"
 #include "pangofc-fontmap.h"
 #include "pangofc-private.h"
-#include "pango-layout.h"
 #include "pango-impl-utils.h"
 
 #include <hb-ot.h>
@@ -402,30 +401,6 @@ pango_fc_font_create_base_metrics_for_context (PangoFcFont   *fcfont,
   return metrics;
 }
 
-static int
-max_glyph_width (PangoLayout *layout)
-{
-  int max_width = 0;
-  GSList *l, *r;
-
-  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
-    {
-      PangoLayoutLine *line = l->data;
-
-      for (r = line->runs; r; r = r->next)
-	{
-	  PangoGlyphString *glyphs = ((PangoGlyphItem *)r->data)->glyphs;
-	  int i;
-
-	  for (i = 0; i < glyphs->num_glyphs; i++)
-	    if (glyphs->glyphs[i].geometry.width > max_width)
-	      max_width = glyphs->glyphs[i].geometry.width;
-	}
-    }
-
-  return max_width;
-}
-
 static PangoFontMetrics *
 pango_fc_font_get_metrics (PangoFont     *font,
 			   PangoLanguage *language)
@@ -433,7 +408,6 @@ pango_fc_font_get_metrics (PangoFont     *font,
   PangoFcFont *fcfont = PANGO_FC_FONT (font);
   PangoFcMetricsInfo *info = NULL; /* Quiet gcc */
   GSList *tmp_list;
-  static int in_get_metrics;
 
   const char *sample_str = pango_language_get_sample_string (language);
 
@@ -459,9 +433,6 @@ pango_fc_font_get_metrics (PangoFont     *font,
 
       info = g_slice_new0 (PangoFcMetricsInfo);
 
-      /* Note: we need to add info to the list before calling
-       * into PangoLayout below, to prevent recursion
-       */
       fcfont->metrics_by_lang = g_slist_prepend (fcfont->metrics_by_lang,
 						 info);
 
@@ -472,34 +443,10 @@ pango_fc_font_get_metrics (PangoFont     *font,
 
       info->metrics = pango_fc_font_create_base_metrics_for_context (fcfont, context);
 
-      if (!in_get_metrics)
-        {
-          /* Compute derived metrics */
-          PangoLayout *layout;
-          PangoRectangle extents;
-          PangoFontDescription *desc = pango_font_describe_with_absolute_size (font);
-          gulong sample_str_width;
-
-          in_get_metrics = 1;
-
-          layout = pango_layout_new (context);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
-
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
-
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
-
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
-
-          g_object_unref (layout);
-
-          in_get_metrics = 0;
-        }
+      /* Compute derived metrics */
+      pango_font_get_approximate_widths (font, sample_str,
+                                         &info->metrics->approximate_char_width,
+                                         &info->metrics->approximate_digit_width);
 
       g_object_unref (context);
       g_object_unref (fontmap);
@@ -53,6 +53,7 @@ struct _PangoFT2FontMap
   double dpi_y;
 
   PangoRenderer *renderer;
+  PangoFT2GlyphCache *glyph_cache;
 };
 
 struct _PangoFT2FontMapClass
@@ -96,6 +97,7 @@ pango_ft2_font_map_init (PangoFT2FontMap *fontmap)
   fontmap->library = NULL;
   fontmap->dpi_x   = 72.0;
   fontmap->dpi_y   = 72.0;
+  fontmap->glyph_cache = _pango_ft2_glyph_cache_new ();
 
   error = FT_Init_FreeType (&fontmap->library);
   if (error != FT_Err_Ok)
@@ -110,6 +112,8 @@ pango_ft2_font_map_finalize (GObject *object)
   if (ft2fontmap->renderer)
     g_object_unref (ft2fontmap->renderer);
 
+  _pango_ft2_glyph_cache_unref (ft2fontmap->glyph_cache);
+
   G_OBJECT_CLASS (pango_ft2_font_map_parent_class)->finalize (object);
 
   FT_Done_FreeType (ft2fontmap->library);
@@ -325,6 +329,75 @@ _pango_ft2_font_map_get_library (PangoFontMap *fontmap)
   return ft2fontmap->library;
 }
 
+PangoFT2GlyphCache *
+_pango_ft2_font_map_get_glyph_cache (PangoFT2FontMap *ft2fontmap)
+{
+  return ft2fontmap->glyph_cache;
+}
+
+/**
+ * pango_ft2_font_map_set_glyph_cache_size:
+ * @fontmap: a `PangoFT2FontMap`
+ * @size: the maximum size of the cache, in bytes
+ *
+ * Sets the maximum amount of memory that is used to cache
+ * rendered glyphs for the fonts of @fontmap.
+ *
+ * All fonts of a fontmap share one cache, and glyphs that
+ * have not been used for the longest time are evicted first.
+ * The default is 4 megabytes.
+ *
+ * Since: 1.52
+ */
+void
+pango_ft2_font_map_set_glyph_cache_size (PangoFT2FontMap *fontmap,
+                                         gsize            size)
+{
+  g_return_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap));
+
+  _pango_ft2_glyph_cache_set_max_size (fontmap->glyph_cache, size);
+}
+
+/**
+ * pango_ft2_font_map_get_glyph_cache_stats:
+ * @fontmap: a `PangoFT2FontMap`
+ * @size: (out) (optional): return location for the number of
+ *   bytes that rendered glyphs currently use in the cache
+ * @hits: (out) (optional): return location for the number
+ *   of lookups that found a rendered glyph in the cache
+ * @misses: (out) (optional): return location for the number
+ *   of lookups that had to render the glyph
+ * @evictions: (out) (optional): return location for the number
+ *   of glyphs that were dropped to keep the cache in its budget
+ *
+ * Gets statistics about the cache of rendered glyphs that
+ * the fonts of @fontmap share.
+ *
+ * A high number of evictions relative to misses means that
+ * the glyphs in use don't fit into the size that was set with
+ * [method@PangoFT2.FontMap.set_glyph_cache_size].
+ *
+ * Since: 1.52
+ */
+void
+pango_ft2_font_map_get_glyph_cache_stats (PangoFT2FontMap *fontmap,
+                                          gsize           *size,
+                                          guint           *hits,
+                                          guint           *misses,
+                                          guint           *evictions)
+{
+  g_return_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap));
+
+  if (size)
+    *size = fontmap->glyph_cache->size;
+  if (hits)
+    *hits = fontmap->glyph_cache->hits;
+  if (misses)
+    *misses = fontmap->glyph_cache->misses;
+  if (evictions)
+    *evictions = fontmap->glyph_cache->evictions;
+}
+
 
 /**
  * _pango_ft2_font_map_get_renderer:
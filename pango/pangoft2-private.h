@@ -28,6 +28,8 @@
 #include <pango/pango-renderer.h>
 #include <fontconfig/fontconfig.h>
 
+#include "pango-glyph-table-private.h"
+
 /* Debugging... */
 /*#define DEBUGGING 1*/
 
@@ -47,9 +49,10 @@
 #define PING(printlist)
 #endif
 
-typedef struct _PangoFT2Font      PangoFT2Font;
-typedef struct _PangoFT2GlyphInfo PangoFT2GlyphInfo;
-typedef struct _PangoFT2Renderer  PangoFT2Renderer;
+typedef struct _PangoFT2Font       PangoFT2Font;
+typedef struct _PangoFT2GlyphInfo  PangoFT2GlyphInfo;
+typedef struct _PangoFT2GlyphCache PangoFT2GlyphCache;
+typedef struct _PangoFT2Renderer   PangoFT2Renderer;
 
 struct _PangoFT2Font
 {
@@ -62,17 +65,50 @@ struct _PangoFT2Font
 
   GSList *metrics_by_lang;
 
-  GHashTable *glyph_info;
+  PangoGlyphTable glyph_info;
   GDestroyNotify glyph_cache_destroy;
+  PangoFT2GlyphCache *glyph_cache;
 };
 
 struct _PangoFT2GlyphInfo
 {
+  gboolean has_extents;
   PangoRectangle logical_rect;
   PangoRectangle ink_rect;
   void *cached_glyph;
+
+  /* Only used while cached_glyph is set */
+  PangoFT2Font *font;
+  PangoGlyph glyph;
+  gsize cached_size;
+  GList lru_link;
+};
+
+/* The rendered glyphs of all fonts of a font map share one
+ * cache, which is limited to max_size bytes. Glyphs are
+ * evicted in least recently used order. Fonts keep a
+ * reference, since they can outlive their font map.
+ */
+struct _PangoFT2GlyphCache
+{
+  int ref_count;
+  GQueue lru;
+  gsize size;
+  gsize max_size;
+
+  guint hits;
+  guint misses;
+  guint evictions;
 };
 
+#define PANGO_FT2_GLYPH_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+PangoFT2GlyphCache * _pango_ft2_glyph_cache_new           (void);
+PangoFT2GlyphCache * _pango_ft2_glyph_cache_ref           (PangoFT2GlyphCache *cache);
+void                 _pango_ft2_glyph_cache_unref         (PangoFT2GlyphCache *cache);
+void                 _pango_ft2_glyph_cache_set_max_size  (PangoFT2GlyphCache *cache,
+                                                           gsize               max_size);
+
 #define PANGO_TYPE_FT2_FONT              (pango_ft2_font_get_type ())
 #define PANGO_FT2_FONT(object)           (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_FT2_FONT, PangoFT2Font))
 #define PANGO_FT2_IS_FONT(object)        (G_TYPE_CHECK_INSTANCE_TYPE ((object), PANGO_TYPE_FT2_FONT))
@@ -83,6 +119,7 @@ GType pango_ft2_font_get_type (void) G_GNUC_CONST;
 PangoFT2Font * _pango_ft2_font_new                (PangoFT2FontMap   *ft2fontmap,
 						   FcPattern         *pattern);
 FT_Library     _pango_ft2_font_map_get_library    (PangoFontMap      *fontmap);
+PangoFT2GlyphCache * _pango_ft2_font_map_get_glyph_cache (PangoFT2FontMap *ft2fontmap);
 void _pango_ft2_font_map_default_substitute (PangoFcFontMap *fcfontmap,
 					     FcPattern      *pattern);
 
@@ -90,7 +127,8 @@ void *_pango_ft2_font_get_cache_glyph_data    (PangoFont      *font,
 					       int             glyph_index);
 void  _pango_ft2_font_set_cache_glyph_data    (PangoFont      *font,
 					       int             glyph_index,
-					       void           *cached_glyph);
+					       void           *cached_glyph,
+					       gsize           size);
 void  _pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
 					       GDestroyNotify  destroy_notify);
 
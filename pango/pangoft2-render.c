@@ -23,6 +23,13 @@
 #include "config.h"
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "pango-font-private.h"
 #include "pangoft2-private.h"
 #include "pango-impl-utils.h"
@@ -34,6 +41,77 @@
 
 typedef struct _PangoFT2RendererClass PangoFT2RendererClass;
 
+/* Compositing gray glyph bitmaps and trapezoids amounts to
+ * a saturating add of the coverage to the target. These are
+ * vectorized with whatever the compiler targets; the scalar
+ * loop handles the remainder and other architectures.
+ */
+static inline void
+add_saturate (guchar       *dest,
+              const guchar *src,
+              int           n)
+{
+  int i = 0;
+
+#ifdef __AVX2__
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i d = _mm256_loadu_si256 ((const __m256i *) (dest + i));
+      __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + i));
+
+      _mm256_storeu_si256 ((__m256i *) (dest + i), _mm256_adds_epu8 (d, s));
+    }
+#endif
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i d = _mm_loadu_si128 ((const __m128i *) (dest + i));
+      __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+      _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epu8 (d, s));
+    }
+#endif
+
+  for (; i < n; i++)
+    dest[i] = MIN ((gushort) dest[i] + (gushort) src[i], 0xff);
+}
+
+static inline void
+add_saturate_const (guchar *dest,
+                    guchar  value,
+                    int     n)
+{
+  int i = 0;
+
+#ifdef __AVX2__
+  {
+    __m256i v = _mm256_set1_epi8 ((char) value);
+
+    for (; i + 32 <= n; i += 32)
+      {
+        __m256i d = _mm256_loadu_si256 ((const __m256i *) (dest + i));
+
+        _mm256_storeu_si256 ((__m256i *) (dest + i), _mm256_adds_epu8 (d, v));
+      }
+  }
+#endif
+#ifdef __SSE2__
+  {
+    __m128i v = _mm_set1_epi8 ((char) value);
+
+    for (; i + 16 <= n; i += 16)
+      {
+        __m128i d = _mm_loadu_si128 ((const __m128i *) (dest + i));
+
+        _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epu8 (d, v));
+      }
+  }
+#endif
+
+  for (; i < n; i++)
+    dest[i] = MIN ((gushort) dest[i] + (gushort) value, 0xff);
+}
+
 #define PANGO_FT2_RENDERER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), PANGO_TYPE_FT2_RENDERER, PangoFT2RendererClass))
 #define PANGO_IS_FT2_RENDERER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), PANGO_TYPE_FT2_RENDERER))
 #define PANGO_FT2_RENDERER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), PANGO_TYPE_FT2_RENDERER, PangoFT2RendererClass))
@@ -43,6 +121,15 @@ struct _PangoFT2Renderer
   PangoRenderer parent_instance;
 
   FT_Bitmap *bitmap;
+
+  /* Only rows in [band_y1, band_y2) of the bitmap are drawn to */
+  int band_y1;
+  int band_y2;
+
+  /* If set, glyphs and trapezoids are recorded as RenderOps
+   * here instead of being drawn, see pango_ft2_render_layout_tiled()
+   */
+  GArray *ops;
 };
 
 struct _PangoFT2RendererClass
@@ -67,8 +154,10 @@ static void pango_ft2_renderer_draw_trapezoid (PangoRenderer    *renderer,
 G_DEFINE_TYPE (PangoFT2Renderer, pango_ft2_renderer, PANGO_TYPE_RENDERER)
 
 static void
-pango_ft2_renderer_init (PangoFT2Renderer *renderer G_GNUC_UNUSED)
+pango_ft2_renderer_init (PangoFT2Renderer *renderer)
 {
+  renderer->band_y1 = 0;
+  renderer->band_y2 = G_MAXINT;
 }
 
 static void
@@ -92,11 +181,31 @@ typedef struct
   FT_Bitmap bitmap;
   int bitmap_left;
   int bitmap_top;
+  int ref_count;
 } PangoFT2RenderedGlyph;
 
+typedef struct
+{
+  /* NULL for trapezoids */
+  PangoFT2RenderedGlyph *glyph;
+  /* x, y for glyphs; y1, x11, x21, y2, x12, x22 for trapezoids */
+  double coords[6];
+} RenderOp;
+
+static PangoFT2RenderedGlyph *
+pango_ft2_rendered_glyph_ref (PangoFT2RenderedGlyph *rendered)
+{
+  rendered->ref_count++;
+
+  return rendered;
+}
+
 static void
-pango_ft2_free_rendered_glyph (PangoFT2RenderedGlyph *rendered)
+pango_ft2_rendered_glyph_unref (PangoFT2RenderedGlyph *rendered)
 {
+  if (--rendered->ref_count > 0)
+    return;
+
   g_free (rendered->bitmap.buffer);
   g_slice_free (PangoFT2RenderedGlyph, rendered);
 }
@@ -118,6 +227,7 @@ pango_ft2_font_render_box_glyph (int      width,
 
   box->bitmap_left = 0;
   box->bitmap_top = top;
+  box->ref_count = 1;
 
   box->bitmap.pixel_mode = ft_pixel_mode_grays;
 
@@ -232,6 +342,7 @@ pango_ft2_font_render_glyph (PangoFont *font,
                                            face->glyph->bitmap.rows * face->glyph->bitmap.pitch);
       rendered->bitmap_left = face->glyph->bitmap_left;
       rendered->bitmap_top = face->glyph->bitmap_top;
+      rendered->ref_count = 1;
 
       if (G_UNLIKELY (!rendered->bitmap.buffer)) {
         g_slice_free (PangoFT2RenderedGlyph, rendered);
@@ -250,23 +361,15 @@ generic_box:
     }
 }
 
-static void
-pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
-			       PangoFont     *font,
-			       PangoGlyph     glyph,
-			       double         x,
-			       double         y)
+/* Returns the rendered glyph from the glyph cache of @font,
+ * rendering and adding it first if necessary. The glyph stays
+ * valid until the next lookup may evict it.
+ */
+static PangoFT2RenderedGlyph *
+pango_ft2_lookup_rendered_glyph (PangoFont  *font,
+                                 PangoGlyph  glyph)
 {
-  FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
   PangoFT2RenderedGlyph *rendered_glyph;
-  gboolean add_glyph_to_cache;
-  guchar *src, *dest;
-
-  int x_start, x_limit;
-  int y_start, y_limit;
-  int ixoff = floor (x + 0.5);
-  int iyoff = floor (y + 0.5);
-  int ix, iy;
 
   if (glyph & PANGO_GLYPH_UNKNOWN_FLAG)
     {
@@ -284,22 +387,46 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
     }
 
   rendered_glyph = _pango_ft2_font_get_cache_glyph_data (font, glyph);
-  add_glyph_to_cache = FALSE;
   if (rendered_glyph == NULL)
     {
       rendered_glyph = pango_ft2_font_render_glyph (font, glyph);
       if (rendered_glyph == NULL)
-        return;
-      add_glyph_to_cache = TRUE;
+        return NULL;
+
+      _pango_ft2_font_set_glyph_cache_destroy (font,
+					       (GDestroyNotify) pango_ft2_rendered_glyph_unref);
+      _pango_ft2_font_set_cache_glyph_data (font,
+					    glyph, rendered_glyph,
+					    sizeof (PangoFT2RenderedGlyph) +
+					    rendered_glyph->bitmap.rows * ABS (rendered_glyph->bitmap.pitch));
     }
 
+  return rendered_glyph;
+}
+
+static void
+pango_ft2_renderer_composite_glyph (PangoFT2Renderer      *renderer,
+                                    PangoFT2RenderedGlyph *rendered_glyph,
+                                    double                 x,
+                                    double                 y)
+{
+  FT_Bitmap *bitmap = renderer->bitmap;
+  guchar *src, *dest;
+
+  int x_start, x_limit;
+  int y_start, y_limit;
+  int band_y2 = MIN (renderer->band_y2, (int) bitmap->rows);
+  int ixoff = floor (x + 0.5);
+  int iyoff = floor (y + 0.5);
+  int ix, iy;
+
   x_start = MAX (0, - (ixoff + rendered_glyph->bitmap_left));
   x_limit = MIN ((int) rendered_glyph->bitmap.width,
 		 (int) (bitmap->width - (ixoff + rendered_glyph->bitmap_left)));
 
-  y_start = MAX (0,  - (iyoff - rendered_glyph->bitmap_top));
+  y_start = MAX (0,  renderer->band_y1 - (iyoff - rendered_glyph->bitmap_top));
   y_limit = MIN ((int) rendered_glyph->bitmap.rows,
-		 (int) (bitmap->rows - (iyoff - rendered_glyph->bitmap_top)));
+		 band_y2 - (iyoff - rendered_glyph->bitmap_top));
 
   src = rendered_glyph->bitmap.buffer +
     y_start * rendered_glyph->bitmap.pitch;
@@ -314,26 +441,8 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
       src += x_start;
       for (iy = y_start; iy < y_limit; iy++)
 	{
-	  guchar *s = src;
-	  guchar *d = dest;
-
-	  for (ix = x_start; ix < x_limit; ix++)
-	    {
-	      switch (*s)
-		{
-		case 0:
-		  break;
-		case 0xff:
-		  *d = 0xff;
-                  break;
-		default:
-		  *d = MIN ((gushort) *d + (gushort) *s, 0xff);
-		  break;
-		}
-
-	      s++;
-	      d++;
-	    }
+	  if (x_limit > x_start)
+	    add_saturate (dest, src, x_limit - x_start);
 
 	  dest += bitmap->pitch;
 	  src  += rendered_glyph->bitmap.pitch;
@@ -368,14 +477,34 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 		 rendered_glyph->bitmap.pixel_mode);
       break;
     }
+}
+
+static void
+pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
+			       PangoFont     *font,
+			       PangoGlyph     glyph,
+			       double         x,
+			       double         y)
+{
+  PangoFT2Renderer *ft2_renderer = PANGO_FT2_RENDERER (renderer);
+  PangoFT2RenderedGlyph *rendered_glyph;
+
+  rendered_glyph = pango_ft2_lookup_rendered_glyph (font, glyph);
+  if (rendered_glyph == NULL)
+    return;
 
-  if (add_glyph_to_cache)
+  if (ft2_renderer->ops)
     {
-      _pango_ft2_font_set_glyph_cache_destroy (font,
-					       (GDestroyNotify) pango_ft2_free_rendered_glyph);
-      _pango_ft2_font_set_cache_glyph_data (font,
-					    glyph, rendered_glyph);
+      RenderOp op;
+
+      op.glyph = pango_ft2_rendered_glyph_ref (rendered_glyph);
+      op.coords[0] = x;
+      op.coords[1] = y;
+      g_array_append_val (ft2_renderer->ops, op);
+      return;
     }
+
+  pango_ft2_renderer_composite_glyph (ft2_renderer, rendered_glyph, x, y);
 }
 
 typedef struct {
@@ -389,13 +518,15 @@ draw_simple_trap (PangoRenderer *renderer,
 		  Position      *t,
 		  Position      *b)
 {
-  FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
+  PangoFT2Renderer *ft2_renderer = PANGO_FT2_RENDERER (renderer);
+  FT_Bitmap *bitmap = ft2_renderer->bitmap;
   int iy = floor (t->y);
   int x1, x2, x;
+  int inner_x1, inner_x2;
   double dy = b->y - t->y;
   guchar *dest;
 
-  if (iy < 0 || iy >= (int) bitmap->rows)
+  if (iy < ft2_renderer->band_y1 || iy >= ft2_renderer->band_y2 || iy >= (int) bitmap->rows)
     return;
   dest = bitmap->buffer + iy * bitmap->pitch;
 
@@ -412,19 +543,39 @@ draw_simple_trap (PangoRenderer *renderer,
   x1 = CLAMP (x1, 0, (int) bitmap->width);
   x2 = CLAMP (x2, 0, (int) bitmap->width);
 
+  /* Pixels that are fully covered horizontally by both
+   * the top and the bottom edge all get the same coverage
+   */
+  inner_x1 = CLAMP ((int) ceil (MAX (t->x1, b->x1)), x1, x2);
+  inner_x2 = CLAMP ((int) floor (MIN (t->x2, b->x2)), inner_x1, x2);
+
+  if (inner_x2 > inner_x1)
+    add_saturate_const (dest + inner_x1, MIN ((int) (dy * 256), 255), inner_x2 - inner_x1);
+  else
+    inner_x1 = inner_x2 = x2;
+
   for (x = x1; x < x2; x++)
     {
-      double top_left = MAX (t->x1, x);
-      double top_right = MIN (t->x2, x + 1);
-      double bottom_left = MAX (b->x1, x);
-      double bottom_right = MIN (b->x2, x + 1);
-      double c = 0.5 * dy * ((top_right - top_left) + (bottom_right - bottom_left));
+      double top_left, top_right, bottom_left, bottom_right, c;
+      int ic;
+
+      if (x == inner_x1)
+        {
+          x = inner_x2 - 1;
+          continue;
+        }
+
+      top_left = MAX (t->x1, x);
+      top_right = MIN (t->x2, x + 1);
+      bottom_left = MAX (b->x1, x);
+      bottom_right = MIN (b->x2, x + 1);
+      c = 0.5 * dy * ((top_right - top_left) + (bottom_right - bottom_left));
 
       /* When converting to [0,255], we round up. This is intended
        * to prevent the problem of pixels that get divided into
        * multiple slices not being fully black.
        */
-      int ic = c * 256;
+      ic = c * 256;
 
       dest[x] = MIN (dest[x] + ic, 255);
     }
@@ -460,6 +611,7 @@ pango_ft2_renderer_draw_trapezoid (PangoRenderer   *renderer,
 				   double           x12,
 				   double           x22)
 {
+  PangoFT2Renderer *ft2_renderer = PANGO_FT2_RENDERER (renderer);
   Position pos;
   Position t;
   Position b;
@@ -468,6 +620,24 @@ pango_ft2_renderer_draw_trapezoid (PangoRenderer   *renderer,
   if (y1 == y2)
     return;
 
+  if (ft2_renderer->ops)
+    {
+      RenderOp op;
+
+      op.glyph = NULL;
+      op.coords[0] = y1;
+      op.coords[1] = x11;
+      op.coords[2] = x21;
+      op.coords[3] = y2;
+      op.coords[4] = x12;
+      op.coords[5] = x22;
+      g_array_append_val (ft2_renderer->ops, op);
+      return;
+    }
+
+  if (y2 <= ft2_renderer->band_y1 || floor (y1) >= ft2_renderer->band_y2)
+    return;
+
   pos.y = t.y = y1;
   pos.x1 = t.x1 = x11;
   pos.x2 = t.x2 = x21;
@@ -634,6 +804,146 @@ pango_ft2_render_layout (FT_Bitmap   *bitmap,
   pango_ft2_render_layout_subpixel (bitmap, layout, x * PANGO_SCALE, y * PANGO_SCALE);
 }
 
+/* Bands smaller than this are not worth a thread */
+#define MIN_BAND_ROWS 32
+
+typedef struct
+{
+  FT_Bitmap *bitmap;
+  GArray *ops;
+  int y1;
+  int y2;
+} RenderBand;
+
+static gpointer
+render_band (gpointer data)
+{
+  RenderBand *band = data;
+  PangoFT2Renderer *renderer;
+  guint i;
+
+  renderer = g_object_new (PANGO_TYPE_FT2_RENDERER, NULL);
+  renderer->bitmap = band->bitmap;
+  renderer->band_y1 = band->y1;
+  renderer->band_y2 = band->y2;
+
+  for (i = 0; i < band->ops->len; i++)
+    {
+      RenderOp *op = &g_array_index (band->ops, RenderOp, i);
+
+      if (op->glyph)
+        pango_ft2_renderer_composite_glyph (renderer, op->glyph,
+                                            op->coords[0], op->coords[1]);
+      else
+        pango_ft2_renderer_draw_trapezoid ((PangoRenderer *) renderer,
+                                           PANGO_RENDER_PART_FOREGROUND,
+                                           op->coords[0], op->coords[1], op->coords[2],
+                                           op->coords[3], op->coords[4], op->coords[5]);
+    }
+
+  g_object_unref (renderer);
+
+  return NULL;
+}
+
+/**
+ * pango_ft2_render_layout_tiled:
+ * @bitmap: a FT_Bitmap to render the layout onto
+ * @layout: a `PangoLayout`
+ * @x: the X position of the left of the layout (in pixels)
+ * @y: the Y position of the top of the layout (in pixels)
+ * @n_threads: the number of threads to use, or 0 to use
+ *   one per processor
+ *
+ * Render a `PangoLayout` onto a FreeType2 bitmap, using
+ * multiple threads.
+ *
+ * The bitmap is split into horizontal bands that are drawn
+ * in parallel. Fonts are only accessed from the calling thread,
+ * which renders the glyphs into the glyph cache of the fontmap;
+ * the other threads only composite them onto their band.
+ *
+ * The result is the same as with [func@PangoFT2.render_layout].
+ * This is worthwhile for large bitmaps with a lot of text.
+ *
+ * Since: 1.52
+ */
+void
+pango_ft2_render_layout_tiled (FT_Bitmap   *bitmap,
+                               PangoLayout *layout,
+                               int          x,
+                               int          y,
+                               int          n_threads)
+{
+  PangoContext *context;
+  PangoFontMap *fontmap;
+  PangoFT2Renderer *renderer;
+  GArray *ops;
+  RenderBand *bands;
+  GThread **threads;
+  int n_bands;
+  int i;
+  guint j;
+
+  g_return_if_fail (bitmap != NULL);
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+
+  if (n_threads <= 0)
+    n_threads = g_get_num_processors ();
+
+  n_bands = CLAMP ((int) bitmap->rows / MIN_BAND_ROWS, 1, n_threads);
+
+  context = pango_layout_get_context (layout);
+  fontmap = pango_context_get_font_map (context);
+  renderer = PANGO_FT2_RENDERER (_pango_ft2_font_map_get_renderer (PANGO_FT2_FONT_MAP (fontmap)));
+
+  pango_ft2_renderer_set_bitmap (renderer, bitmap);
+
+  if (n_bands == 1)
+    {
+      pango_renderer_draw_layout ((PangoRenderer *) renderer, layout, x * PANGO_SCALE, y * PANGO_SCALE);
+      return;
+    }
+
+  /* Record what to draw, on this thread */
+  ops = g_array_new (FALSE, FALSE, sizeof (RenderOp));
+  renderer->ops = ops;
+  pango_renderer_draw_layout ((PangoRenderer *) renderer, layout, x * PANGO_SCALE, y * PANGO_SCALE);
+  renderer->ops = NULL;
+
+  bands = g_new (RenderBand, n_bands);
+  threads = g_new (GThread *, n_bands);
+
+  for (i = 0; i < n_bands; i++)
+    {
+      bands[i].bitmap = bitmap;
+      bands[i].ops = ops;
+      bands[i].y1 = (int) ((gint64) bitmap->rows * i / n_bands);
+      bands[i].y2 = (int) ((gint64) bitmap->rows * (i + 1) / n_bands);
+    }
+
+  /* The first band is drawn on this thread */
+  for (i = 1; i < n_bands; i++)
+    threads[i] = g_thread_new ("pango-ft2-band", render_band, &bands[i]);
+
+  render_band (&bands[0]);
+
+  for (i = 1; i < n_bands; i++)
+    g_thread_join (threads[i]);
+
+  for (j = 0; j < ops->len; j++)
+    {
+      RenderOp *op = &g_array_index (ops, RenderOp, j);
+
+      if (op->glyph)
+        pango_ft2_rendered_glyph_unref (op->glyph);
+    }
+
+  g_array_unref (ops);
+  g_free (threads);
+  g_free (bands);
+}
+
 /**
  * pango_ft2_render_layout_line_subpixel:
  * @bitmap: a FT_Bitmap to render the line onto
@@ -32,6 +32,8 @@
 #include "pangoft2-private.h"
 #include "pangofc-fontmap-private.h"
 #include "pangofc-private.h"
+#include "pango-font-private.h"
+#include "pango-trace-private.h"
 
 /* for compatibility with older freetype versions */
 #ifndef FT_LOAD_TARGET_MONO
@@ -55,6 +57,11 @@ static void     pango_ft2_font_get_glyph_extents (PangoFont      *font,
                                                   PangoGlyph      glyph,
                                                   PangoRectangle *ink_rect,
                                                   PangoRectangle *logical_rect);
+static void     pango_ft2_font_get_glyphs_extents (PangoFont            *font,
+                                                   const PangoGlyphInfo *glyphs,
+                                                   int                   n_glyphs,
+                                                   PangoRectangle       *ink_rects,
+                                                   PangoRectangle       *logical_rects);
 
 static FT_Face  pango_ft2_font_real_lock_face    (PangoFcFont    *font);
 static void     pango_ft2_font_real_unlock_face  (PangoFcFont    *font);
@@ -79,6 +86,8 @@ _pango_ft2_font_new (PangoFT2FontMap *ft2fontmap,
   if (FcPatternGetDouble (pattern, FC_PIXEL_SIZE, 0, &d) == FcResultMatch)
     ft2font->size = d*PANGO_SCALE;
 
+  ft2font->glyph_cache = _pango_ft2_glyph_cache_ref (_pango_ft2_font_map_get_glyph_cache (ft2fontmap));
+
   return ft2font;
 }
 
@@ -270,7 +279,7 @@ pango_ft2_font_init (PangoFT2Font *ft2font)
 
   ft2font->size = 0;
 
-  ft2font->glyph_info = g_hash_table_new (NULL, NULL);
+  pango_glyph_table_init (&ft2font->glyph_info, sizeof (PangoFT2GlyphInfo));
 }
 
 static void
@@ -279,6 +288,7 @@ pango_ft2_font_class_init (PangoFT2FontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoFcFontClass *fc_font_class = PANGO_FC_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_ft2_font_finalize;
 
@@ -286,6 +296,10 @@ pango_ft2_font_class_init (PangoFT2FontClass *class)
 
   fc_font_class->lock_face = pango_ft2_font_real_lock_face;
   fc_font_class->unlock_face = pango_ft2_font_real_unlock_face;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+
+  pclass->get_glyphs_extents = pango_ft2_font_get_glyphs_extents;
 }
 
 static PangoFT2GlyphInfo *
@@ -297,18 +311,15 @@ pango_ft2_font_get_glyph_info (PangoFont   *font,
   PangoFcFont *fcfont = (PangoFcFont *)font;
   PangoFT2GlyphInfo *info;
 
-  info = g_hash_table_lookup (ft2font->glyph_info, GUINT_TO_POINTER (glyph));
+  info = pango_glyph_table_lookup (&ft2font->glyph_info, glyph, create);
 
-  if ((info == NULL) && create)
+  if (info && !info->has_extents && create)
     {
-      info = g_slice_new0 (PangoFT2GlyphInfo);
-
       pango_fc_font_get_raw_extents (fcfont,
 				     glyph,
 				     &info->ink_rect,
 				     &info->logical_rect);
-
-      g_hash_table_insert (ft2font->glyph_info, GUINT_TO_POINTER(glyph), info);
+      info->has_extents = TRUE;
     }
 
   return info;
@@ -379,6 +390,37 @@ pango_ft2_font_get_glyph_extents (PangoFont      *font,
     }
 }
 
+static void
+pango_ft2_font_get_glyphs_extents (PangoFont            *font,
+				   const PangoGlyphInfo *glyphs,
+				   int                   n_glyphs,
+				   PangoRectangle       *ink_rects,
+				   PangoRectangle       *logical_rects)
+{
+  int i;
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoGlyph glyph = glyphs[i].glyph;
+      PangoFT2GlyphInfo *info;
+
+      if (G_UNLIKELY (glyph == PANGO_GLYPH_EMPTY || (glyph & PANGO_GLYPH_UNKNOWN_FLAG)))
+	{
+	  pango_ft2_font_get_glyph_extents (font, glyph,
+					    ink_rects ? &ink_rects[i] : NULL,
+					    logical_rects ? &logical_rects[i] : NULL);
+	  continue;
+	}
+
+      info = pango_ft2_font_get_glyph_info (font, glyph, TRUE);
+
+      if (ink_rects)
+	ink_rects[i] = info->ink_rect;
+      if (logical_rects)
+	logical_rects[i] = info->logical_rect;
+    }
+}
+
 /**
  * pango_ft2_font_get_kerning:
  * @font: a `PangoFont`
@@ -435,19 +477,98 @@ pango_ft2_font_real_unlock_face (PangoFcFont *font G_GNUC_UNUSED)
 {
 }
 
-static gboolean
-pango_ft2_free_glyph_info_callback (gpointer key G_GNUC_UNUSED,
-				    gpointer value,
+/* Glyph cache */
+
+static PangoCacheStats glyph_cache_stats = PANGO_CACHE_STATS_INIT ("FT2 glyph cache");
+
+PangoFT2GlyphCache *
+_pango_ft2_glyph_cache_new (void)
+{
+  PangoFT2GlyphCache *cache;
+
+  cache = g_new0 (PangoFT2GlyphCache, 1);
+  cache->ref_count = 1;
+  g_queue_init (&cache->lru);
+  cache->max_size = PANGO_FT2_GLYPH_CACHE_DEFAULT_SIZE;
+
+  return cache;
+}
+
+PangoFT2GlyphCache *
+_pango_ft2_glyph_cache_ref (PangoFT2GlyphCache *cache)
+{
+  cache->ref_count++;
+
+  return cache;
+}
+
+void
+_pango_ft2_glyph_cache_unref (PangoFT2GlyphCache *cache)
+{
+  if (--cache->ref_count > 0)
+    return;
+
+  g_assert (g_queue_is_empty (&cache->lru));
+
+  g_free (cache);
+}
+
+/* Frees the rendered glyph of @info, but keeps @info itself */
+static void
+glyph_cache_remove (PangoFT2GlyphCache *cache,
+                    PangoFT2GlyphInfo  *info)
+{
+  PangoFT2Font *font = info->font;
+
+  g_queue_unlink (&cache->lru, &info->lru_link);
+  cache->size -= info->cached_size;
+
+  if (font->glyph_cache_destroy)
+    (*font->glyph_cache_destroy) (info->cached_glyph);
+
+  info->cached_glyph = NULL;
+  info->cached_size = 0;
+}
+
+/* Evicts least recently used glyphs until the cache fits
+ * into its budget, but keeps the @keep most recent ones
+ */
+static void
+glyph_cache_trim (PangoFT2GlyphCache *cache,
+                  guint               keep)
+{
+  while (cache->size > cache->max_size && cache->lru.length > keep)
+    {
+      PangoFT2GlyphInfo *info = cache->lru.tail->data;
+      gsize size = info->cached_size;
+
+      /* The extents stay, the glyph_info table is bounded
+       * by the number of glyphs in the font anyway
+       */
+      glyph_cache_remove (cache, info);
+
+      cache->evictions++;
+      pango_cache_stats_evict (&glyph_cache_stats, size);
+    }
+}
+
+void
+_pango_ft2_glyph_cache_set_max_size (PangoFT2GlyphCache *cache,
+                                     gsize               max_size)
+{
+  cache->max_size = max_size;
+  glyph_cache_trim (cache, 0);
+}
+
+static void
+pango_ft2_free_glyph_info_callback (gpointer value,
 				    gpointer data)
 {
   PangoFT2Font *font = PANGO_FT2_FONT (data);
   PangoFT2GlyphInfo *info = value;
 
-  if (font->glyph_cache_destroy && info->cached_glyph)
-    (*font->glyph_cache_destroy) (info->cached_glyph);
-
-  g_slice_free (PangoFT2GlyphInfo, info);
-  return TRUE;
+  if (info->cached_glyph)
+    glyph_cache_remove (font->glyph_cache, info);
 }
 
 static void
@@ -461,9 +582,12 @@ pango_ft2_font_finalize (GObject *object)
       ft2font->face = NULL;
     }
 
-  g_hash_table_foreach_remove (ft2font->glyph_info,
-			       pango_ft2_free_glyph_info_callback, object);
-  g_hash_table_destroy (ft2font->glyph_info);
+  pango_glyph_table_foreach (&ft2font->glyph_info,
+			     pango_ft2_free_glyph_info_callback, object);
+  pango_glyph_table_clear (&ft2font->glyph_info);
+
+  if (ft2font->glyph_cache)
+    _pango_ft2_glyph_cache_unref (ft2font->glyph_cache);
 
   G_OBJECT_CLASS (pango_ft2_font_parent_class)->finalize (object);
 }
@@ -524,8 +648,19 @@ _pango_ft2_font_get_cache_glyph_data (PangoFont *font,
 
   info = pango_ft2_font_get_glyph_info (font, glyph_index, FALSE);
 
-  if (info == NULL)
-    return NULL;
+  if (info == NULL || info->cached_glyph == NULL)
+    {
+      PANGO_FT2_FONT (font)->glyph_cache->misses++;
+      pango_cache_stats_miss (&glyph_cache_stats);
+      return NULL;
+    }
+
+  PANGO_FT2_FONT (font)->glyph_cache->hits++;
+  pango_cache_stats_hit (&glyph_cache_stats);
+
+  /* Move to the front of the LRU list */
+  g_queue_unlink (&PANGO_FT2_FONT (font)->glyph_cache->lru, &info->lru_link);
+  g_queue_push_head_link (&PANGO_FT2_FONT (font)->glyph_cache->lru, &info->lru_link);
 
   return info->cached_glyph;
 }
@@ -533,18 +668,31 @@ _pango_ft2_font_get_cache_glyph_data (PangoFont *font,
 void
 _pango_ft2_font_set_cache_glyph_data (PangoFont     *font,
 				     int            glyph_index,
-				     void          *cached_glyph)
+				     void          *cached_glyph,
+				     gsize          size)
 {
+  PangoFT2GlyphCache *cache;
   PangoFT2GlyphInfo *info;
 
   if (!PANGO_FT2_IS_FONT (font))
     return;
 
+  cache = PANGO_FT2_FONT (font)->glyph_cache;
   info = pango_ft2_font_get_glyph_info (font, glyph_index, TRUE);
 
+  if (info->cached_glyph)
+    glyph_cache_remove (cache, info);
+
   info->cached_glyph = cached_glyph;
+  info->font = PANGO_FT2_FONT (font);
+  info->glyph = glyph_index;
+  info->cached_size = size;
+  info->lru_link.data = info;
+
+  g_queue_push_head_link (&cache->lru, &info->lru_link);
+  cache->size += size;
 
-  /* TODO: Implement limiting of the number of cached glyphs */
+  glyph_cache_trim (cache, 1);
 }
 
 void
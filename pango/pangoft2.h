@@ -106,6 +106,12 @@ void pango_ft2_render_layout_subpixel      (FT_Bitmap        *bitmap,
 					    PangoLayout      *layout,
 					    int               x,
 					    int               y);
+PANGO_AVAILABLE_IN_1_52
+void pango_ft2_render_layout_tiled         (FT_Bitmap        *bitmap,
+					    PangoLayout      *layout,
+					    int               x,
+					    int               y,
+					    int               n_threads);
 
 PANGO_AVAILABLE_IN_ALL
 GType pango_ft2_font_map_get_type (void) G_GNUC_CONST;
@@ -116,6 +122,15 @@ PANGO_AVAILABLE_IN_1_2
 void          pango_ft2_font_map_set_resolution         (PangoFT2FontMap        *fontmap,
 							 double                  dpi_x,
 							 double                  dpi_y);
+PANGO_AVAILABLE_IN_1_52
+void          pango_ft2_font_map_set_glyph_cache_size   (PangoFT2FontMap        *fontmap,
+							 gsize                   size);
+PANGO_AVAILABLE_IN_1_52
+void          pango_ft2_font_map_get_glyph_cache_stats  (PangoFT2FontMap        *fontmap,
+							 gsize                  *size,
+							 guint                  *hits,
+							 guint                  *misses,
+							 guint                  *evictions);
 #ifndef PANGO_DISABLE_DEPRECATED
 PANGO_DEPRECATED_IN_1_48_FOR(pango_fc_font_map_set_default_substitute)
 void          pango_ft2_font_map_set_default_substitute (PangoFT2FontMap        *fontmap,
@@ -75,9 +75,17 @@ pango_xft_font_class_init (PangoXftFontClass *class)
   fc_font_class->shutdown = pango_xft_font_real_shutdown;
 }
 
+typedef struct
+{
+  gboolean valid;
+  PangoRectangle ink_rect;
+  PangoRectangle logical_rect;
+} Extents;
+
 static void
-pango_xft_font_init (PangoXftFont *xftfont G_GNUC_UNUSED)
+pango_xft_font_init (PangoXftFont *xftfont)
 {
+  pango_glyph_table_init (&xftfont->glyph_info, sizeof (Extents));
 }
 
 PangoXftFont *
@@ -193,8 +201,7 @@ pango_xft_font_finalize (GObject *object)
       XftFontClose (display, xfont->xft_font);
     }
 
-  if (xfont->glyph_info)
-    g_hash_table_destroy (xfont->glyph_info);
+  pango_glyph_table_clear (&xfont->glyph_info);
 
   G_OBJECT_CLASS (pango_xft_font_parent_class)->finalize (object);
 }
@@ -269,18 +276,6 @@ get_glyph_extents_xft (PangoFcFont      *fcfont,
     }
 }
 
-typedef struct
-{
-  PangoRectangle ink_rect;
-  PangoRectangle logical_rect;
-} Extents;
-
-static void
-extents_free (Extents *ext)
-{
-  g_slice_free (Extents, ext);
-}
-
 static void
 get_glyph_extents_raw (PangoXftFont     *xfont,
 		       PangoGlyph        glyph,
@@ -289,25 +284,15 @@ get_glyph_extents_raw (PangoXftFont     *xfont,
 {
   Extents *extents;
 
-  if (!xfont->glyph_info)
-    xfont->glyph_info = g_hash_table_new_full (NULL, NULL,
-					       NULL, (GDestroyNotify)extents_free);
-
-  extents = g_hash_table_lookup (xfont->glyph_info,
-				 GUINT_TO_POINTER (glyph));
+  extents = pango_glyph_table_lookup (&xfont->glyph_info, glyph, TRUE);
 
-  if (!extents)
+  if (!extents->valid)
     {
-      extents = g_slice_new (Extents);
-
       pango_fc_font_get_raw_extents (PANGO_FC_FONT (xfont),
 				     glyph,
 				     &extents->ink_rect,
 				     &extents->logical_rect);
-
-      g_hash_table_insert (xfont->glyph_info,
-			   GUINT_TO_POINTER (glyph),
-			   extents);
+      extents->valid = TRUE;
     }
 
   if (ink_rect)
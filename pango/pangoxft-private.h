@@ -26,6 +26,8 @@
 #include <pango/pangofc-font-private.h>
 #include <pango/pango-renderer.h>
 
+#include "pango-glyph-table-private.h"
+
 G_BEGIN_DECLS
 
 struct _PangoXftFont
@@ -39,7 +41,7 @@ struct _PangoXftFont
   guint mini_height;
   guint mini_pad;
 
-  GHashTable *glyph_info;	    /* Used only when we can't get
+  PangoGlyphTable glyph_info;	    /* Used only when we can't get
 				     * glyph extents out of Xft because
 				     * we have a transformation in effect
 				     */
@@ -21,11 +21,15 @@
 
 #include "config.h"
 
+#include <math.h>
+
 #include <pango/pango-layout.h>
 #include <pango/pango-layout-private.h>
 #include <pango/pango-context-private.h>
 #include <pango/pango-enum-types.h>
 #include <pango/pango-font-private.h>
+#include <pango/pango-item-private.h>
+#include <pango/pango-impl-utils.h>
 
 #include <hb-ot.h>
 #include "pango/json/gtkjsonparserprivate.h"
@@ -250,6 +254,7 @@ static const char *wrap_names[] = {
   "word",
   "char",
   "word-char",
+  "optimal",
   NULL
 };
 
@@ -469,6 +474,9 @@ add_context (GtkJsonPrinter *printer,
   gtk_json_printer_add_string (printer, "base-dir", direction_names[context->base_dir]);
   gtk_json_printer_add_boolean (printer, "round-glyph-positions", context->round_glyph_positions);
 
+  if (context->font_options)
+    gtk_json_printer_add_string (printer, "font-options", context->font_options);
+
   matrix = pango_context_get_matrix (context);
   if (!matrix)
     matrix = &identity;
@@ -534,6 +542,138 @@ add_log_attrs (GtkJsonPrinter *printer,
   gtk_json_printer_end (printer);
 }
 
+static hb_user_data_key_t checksum_key;
+
+/* Computing the checksum means hashing the whole font file,
+ * so we keep it around on the face.
+ */
+static const char *
+get_font_checksum (PangoFont *font)
+{
+  hb_face_t *face;
+  char *checksum;
+
+  face = hb_font_get_face (pango_font_get_hb_font (font));
+
+  checksum = hb_face_get_user_data (face, &checksum_key);
+  if (!checksum)
+    {
+      hb_blob_t *blob;
+      const char *data;
+      guint length;
+
+      blob = hb_face_reference_blob (face);
+      data = hb_blob_get_data (blob, &length);
+      checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *)data, length);
+      hb_blob_destroy (blob);
+
+      if (!hb_face_set_user_data (face, &checksum_key, checksum, g_free, FALSE))
+        {
+          /* Someone else was faster, or the face is the empty face */
+          g_free (checksum);
+          checksum = hb_face_get_user_data (face, &checksum_key);
+          if (!checksum)
+            return "";
+        }
+    }
+
+  return checksum;
+}
+
+/* Returns the normalized variation coordinates of @font as
+ * a string like "wght=8374,wdth=0,", or NULL if it has none
+ */
+static char *
+get_font_variations (PangoFont *font)
+{
+  hb_font_t *hb_font;
+  hb_face_t *face;
+  const int *coords;
+  guint length, count;
+  hb_ot_var_axis_info_t *axes;
+  GString *str;
+
+  hb_font = pango_font_get_hb_font (font);
+  face = hb_font_get_face (hb_font);
+
+  coords = hb_font_get_var_coords_normalized (hb_font, &length);
+  if (length == 0)
+    return NULL;
+
+  /* The coordinates should cover all axes of the face;
+   * if they don't, there is nothing sensible to record
+   */
+  count = hb_ot_var_get_axis_count (face);
+  if (count != length)
+    return NULL;
+
+  axes = g_alloca (count * sizeof (hb_ot_var_axis_info_t));
+  hb_ot_var_get_axis_infos (face, 0, &count, axes);
+
+  str = g_string_new ("");
+  for (int i = 0; i < length; i++)
+    {
+      char buf[5] = { 0, };
+
+      hb_tag_to_string (axes[i].tag, buf);
+      g_string_append_printf (str, "%s=%d,", buf, coords[i]);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static gboolean
+matrix_equal (const PangoMatrix *m1,
+              const PangoMatrix *m2)
+{
+  return fabs (m1->xx - m2->xx) < 1e-6 &&
+         fabs (m1->xy - m2->xy) < 1e-6 &&
+         fabs (m1->yx - m2->yx) < 1e-6 &&
+         fabs (m1->yy - m2->yy) < 1e-6 &&
+         fabs (m1->x0 - m2->x0) < 1e-6 &&
+         fabs (m1->y0 - m2->y0) < 1e-6;
+}
+
+/* Checks that @font has the transformation and variations
+ * that a serialized font had. Together with the checksum of
+ * the face, this tells whether glyphs that were positioned
+ * with the serialized font are still valid.
+ */
+static gboolean
+font_state_matches (PangoFont         *font,
+                    const PangoMatrix *matrix,
+                    const char        *variations)
+{
+  PangoMatrix font_matrix;
+  char *font_variations;
+  gboolean result;
+
+  pango_font_get_matrix (font, &font_matrix);
+  if (!matrix_equal (&font_matrix, matrix))
+    return FALSE;
+
+  font_variations = get_font_variations (font);
+  result = g_strcmp0 (font_variations, variations) == 0;
+  g_free (font_variations);
+
+  return result;
+}
+
+/* Checks that @context positions glyphs like @stored did */
+static gboolean
+context_state_matches (PangoContext *context,
+                       PangoContext *stored)
+{
+  const PangoMatrix *m1, *m2;
+  PangoMatrix identity = PANGO_MATRIX_INIT;
+
+  m1 = pango_context_get_matrix (context);
+  m2 = pango_context_get_matrix (stored);
+
+  return context->round_glyph_positions == stored->round_glyph_positions &&
+         matrix_equal (m1 ? m1 : &identity, m2 ? m2 : &identity);
+}
+
 static void
 add_font (GtkJsonPrinter *printer,
           const char     *member,
@@ -543,8 +683,6 @@ add_font (GtkJsonPrinter *printer,
   char *str;
   hb_font_t *hb_font;
   hb_face_t *face;
-  hb_blob_t *blob;
-  const char *data;
   guint length;
   const int *coords;
   hb_feature_t features[32];
@@ -560,15 +698,8 @@ add_font (GtkJsonPrinter *printer,
 
   hb_font = pango_font_get_hb_font (font);
   face = hb_font_get_face (hb_font);
-  blob = hb_face_reference_blob (face);
-
-  data = hb_blob_get_data (blob, &length);
-  str = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *)data, length);
-
-  gtk_json_printer_add_string (printer, "checksum", str);
 
-  g_free (str);
-  hb_blob_destroy (blob);
+  gtk_json_printer_add_string (printer, "checksum", get_font_checksum (font));
 
   coords = hb_font_get_var_coords_normalized (hb_font, &length);
   if (length > 0)
@@ -1275,6 +1406,7 @@ enum {
   CONTEXT_BASE_DIR,
   CONTEXT_ROUND_GLYPH_POSITIONS,
   CONTEXT_TRANSFORM,
+  CONTEXT_FONT_OPTIONS,
 };
 
 static const char *context_members[] = {
@@ -1285,12 +1417,18 @@ static const char *context_members[] = {
   "base-dir",
   "round-glyph-positions",
   "transform",
+  "font-options",
   NULL,
 };
 
+/* The font options can't be applied to @context, since
+ * they are set by the backend. They are returned in
+ * @font_options, to be compared with those of @context.
+ */
 static void
-json_parser_fill_context (GtkJsonParser *parser,
-                          PangoContext  *context)
+json_parser_fill_context (GtkJsonParser  *parser,
+                          PangoContext   *context,
+                          char          **font_options)
 {
   gtk_json_parser_start_object (parser);
 
@@ -1353,6 +1491,11 @@ json_parser_fill_context (GtkJsonParser *parser,
           }
           break;
 
+        case CONTEXT_FONT_OPTIONS:
+          g_free (*font_options);
+          *font_options = gtk_json_parser_get_string (parser);
+          break;
+
         default:
           break;
         }
@@ -1363,212 +1506,2339 @@ json_parser_fill_context (GtkJsonParser *parser,
 }
 
 enum {
-  LAYOUT_CONTEXT,
-  LAYOUT_COMMENT,
-  LAYOUT_TEXT,
-  LAYOUT_ATTRIBUTES,
-  LAYOUT_FONT,
-  LAYOUT_TABS,
-  LAYOUT_JUSTIFY,
-  LAYOUT_JUSTIFY_LAST_LINE,
-  LAYOUT_SINGLE_PARAGRAPH,
-  LAYOUT_AUTO_DIR,
-  LAYOUT_ALIGNMENT,
-  LAYOUT_WRAP,
-  LAYOUT_ELLIPSIZE,
-  LAYOUT_WIDTH,
-  LAYOUT_HEIGHT,
-  LAYOUT_INDENT,
-  LAYOUT_SPACING,
-  LAYOUT_LINE_SPACING,
-  LAYOUT_OUTPUT
+  FONT_DESCRIPTION,
+  FONT_CHECKSUM,
+  FONT_VARIATIONS,
+  FONT_FEATURES,
+  FONT_MATRIX
 };
 
-static const char *layout_members[] = {
-  "context",
-  "comment",
-  "text",
-  "attributes",
-  "font",
-  "tabs",
-  "justify",
-  "justify-last-line",
-  "single-paragraph",
-  "auto-dir",
-  "alignment",
-  "wrap",
-  "ellipsize",
-  "width",
-  "height",
-  "indent",
-  "spacing",
-  "line-spacing",
-  "output",
+static const char *font_members[] = {
+  "description",
+  "checksum",
+  "variations",
+  "features",
+  "matrix",
   NULL
 };
 
+/* Parses a font object. @matrix and @variations are optional,
+ * and get the data that font_state_matches() checks.
+ */
 static void
-json_parser_fill_layout (GtkJsonParser               *parser,
-                         PangoLayout                 *layout,
-                         PangoLayoutDeserializeFlags  flags)
+json_parser_get_font_data (GtkJsonParser  *parser,
+                           char          **description,
+                           char          **checksum,
+                           PangoMatrix    *matrix,
+                           char          **variations)
 {
+  *description = NULL;
+  *checksum = NULL;
+  if (matrix)
+    *matrix = (PangoMatrix) PANGO_MATRIX_INIT;
+  if (variations)
+    *variations = NULL;
+
   gtk_json_parser_start_object (parser);
 
   do
     {
-      char *str;
-
-      switch (gtk_json_parser_select_member (parser, layout_members))
+      switch (gtk_json_parser_select_member (parser, font_members))
         {
-        case LAYOUT_CONTEXT:
-          if (flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT)
-            json_parser_fill_context (parser, pango_layout_get_context (layout));
-          break;
-
-        case LAYOUT_COMMENT:
-          str = gtk_json_parser_get_string (parser);
-          g_object_set_data_full (G_OBJECT (layout), "comment", str, g_free);
+        case FONT_DESCRIPTION:
+          g_free (*description);
+          *description = gtk_json_parser_get_string (parser);
           break;
 
-        case LAYOUT_TEXT:
-          str = gtk_json_parser_get_string (parser);
-          pango_layout_set_text (layout, str, -1);
-          g_free (str);
-          break;
-
-        case LAYOUT_ATTRIBUTES:
-          {
-            PangoAttrList *attributes = pango_attr_list_new ();
-            json_parser_fill_attr_list (parser, attributes);
-            pango_layout_set_attributes (layout, attributes);
-            pango_attr_list_unref (attributes);
-          }
+        case FONT_CHECKSUM:
+          g_free (*checksum);
+          *checksum = gtk_json_parser_get_string (parser);
           break;
 
-        case LAYOUT_FONT:
-          {
-            PangoFontDescription *desc = parser_get_font_description (parser);;
-            pango_layout_set_font_description (layout, desc);
-            pango_font_description_free (desc);
-          }
-          break;
+        case FONT_VARIATIONS:
+          if (variations)
+            {
+              GString *str = g_string_new ("");
 
-        case LAYOUT_TABS:
-          {
-            PangoTabArray *tabs = pango_tab_array_new (0, FALSE);
-            json_parser_fill_tab_array (parser, tabs);
-            pango_layout_set_tabs (layout, tabs);
-            pango_tab_array_free (tabs);
-          }
-          break;
+              gtk_json_parser_start_object (parser);
+              do
+                {
+                  char *name = gtk_json_parser_get_member_name (parser);
 
-        case LAYOUT_JUSTIFY:
-          pango_layout_set_justify (layout, gtk_json_parser_get_boolean (parser));
+                  if (name)
+                    g_string_append_printf (str, "%s=%d,", name, gtk_json_parser_get_int (parser));
+                  g_free (name);
+                }
+              while (gtk_json_parser_next (parser));
+              gtk_json_parser_end (parser);
+
+              g_free (*variations);
+              if (str->len > 0)
+                *variations = g_string_free (str, FALSE);
+              else
+                *variations = g_string_free (str, TRUE);
+            }
           break;
 
-        case LAYOUT_JUSTIFY_LAST_LINE:
-          pango_layout_set_justify_last_line (layout, gtk_json_parser_get_boolean (parser));
+        case FONT_MATRIX:
+          if (matrix)
+            {
+              gtk_json_parser_start_array (parser);
+              matrix->xx = gtk_json_parser_get_number (parser);
+              gtk_json_parser_next (parser);
+              matrix->xy = gtk_json_parser_get_number (parser);
+              gtk_json_parser_next (parser);
+              matrix->yx = gtk_json_parser_get_number (parser);
+              gtk_json_parser_next (parser);
+              matrix->yy = gtk_json_parser_get_number (parser);
+              gtk_json_parser_next (parser);
+              matrix->x0 = gtk_json_parser_get_number (parser);
+              gtk_json_parser_next (parser);
+              matrix->y0 = gtk_json_parser_get_number (parser);
+              gtk_json_parser_end (parser);
+            }
           break;
 
-        case LAYOUT_SINGLE_PARAGRAPH:
-          pango_layout_set_single_paragraph_mode (layout, gtk_json_parser_get_boolean (parser));
+        default:
           break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
 
-        case LAYOUT_AUTO_DIR:
-          pango_layout_set_auto_dir (layout, gtk_json_parser_get_boolean (parser));
-          break;
+  gtk_json_parser_end (parser);
 
-        case LAYOUT_ALIGNMENT:
-          pango_layout_set_alignment (layout, (PangoAlignment) parser_select_string (parser, alignment_names));
-          break;
+  if (!*description && !gtk_json_parser_get_error (parser))
+    gtk_json_parser_schema_error (parser, "Font missing \"description\"");
+}
 
-        case LAYOUT_WRAP:
-          pango_layout_set_wrap (layout, (PangoWrapMode) parser_select_string (parser, wrap_names));
-          break;
+/* State for restoring the formatted output of a layout */
+typedef struct {
+  PangoLayout *layout;
+  GHashTable *fonts;
+  gboolean fonts_match;
+  GSList *lines;
+  GArray *log_attrs;
+  gboolean is_wrapped;
+  gboolean is_ellipsized;
+} OutputData;
+
+/* Loads the font with the given serialized data, and checks
+ * that it resolves to the same font file, with the same
+ * transformation and variations, as when it was serialized.
+ * Returns NULL if it doesn't.
+ *
+ * The JSON format has no record of the font options that
+ * the glyphs were positioned with; those are covered by
+ * the binary format only.
+ */
+static PangoFont *
+output_data_load_font (OutputData    *data,
+                       GtkJsonParser *parser)
+{
+  char *description, *checksum, *variations;
+  PangoMatrix matrix;
+  char *key;
+  PangoFont *font;
 
-        case LAYOUT_ELLIPSIZE:
-          pango_layout_set_ellipsize (layout, (PangoEllipsizeMode) parser_select_string (parser, ellipsize_names));
-          break;
+  json_parser_get_font_data (parser, &description, &checksum, &matrix, &variations);
+  if (!description)
+    {
+      g_free (checksum);
+      g_free (variations);
+      return NULL;
+    }
 
-        case LAYOUT_WIDTH:
-          pango_layout_set_width (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+  key = g_strdup_printf ("%s\n%s\n%s\n%g %g %g %g %g %g",
+                         description,
+                         checksum ? checksum : "",
+                         variations ? variations : "",
+                         matrix.xx, matrix.xy, matrix.yx, matrix.yy, matrix.x0, matrix.y0);
 
-        case LAYOUT_HEIGHT:
-          pango_layout_set_height (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+  if (!g_hash_table_lookup_extended (data->fonts, key, NULL, (gpointer *) &font))
+    {
+      PangoFontDescription *desc = pango_font_description_from_string (description);
 
-        case LAYOUT_INDENT:
-          pango_layout_set_indent (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+      font = pango_context_load_font (data->layout->context, desc);
+      pango_font_description_free (desc);
 
-        case LAYOUT_SPACING:
-          pango_layout_set_spacing (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+      if (font && (!checksum || strcmp (get_font_checksum (font), checksum) != 0 ||
+                   !font_state_matches (font, &matrix, variations)))
+        g_clear_object (&font);
 
-        case LAYOUT_LINE_SPACING:
-          pango_layout_set_line_spacing (layout, gtk_json_parser_get_number (parser));
-          break;
+      g_hash_table_insert (data->fonts, key, font);
+      key = NULL;
+    }
 
-        case LAYOUT_OUTPUT:
-          break;
+  g_free (key);
+  g_free (description);
+  g_free (checksum);
+  g_free (variations);
 
-        default:
-          break;
-        }
-    }
-  while (gtk_json_parser_next (parser));
+  if (!font)
+    data->fonts_match = FALSE;
 
-  gtk_json_parser_end (parser);
+  return font;
 }
 
 enum {
-  FONT_DESCRIPTION,
-  FONT_CHECKSUM,
-  FONT_VARIATIONS,
-  FONT_FEATURES,
-  FONT_MATRIX
+  LOG_ATTR_LINE_BREAK,
+  LOG_ATTR_MANDATORY_BREAK,
+  LOG_ATTR_CHAR_BREAK,
+  LOG_ATTR_WHITE,
+  LOG_ATTR_CURSOR_POSITION,
+  LOG_ATTR_WORD_START,
+  LOG_ATTR_WORD_END,
+  LOG_ATTR_SENTENCE_BOUNDARY,
+  LOG_ATTR_SENTENCE_START,
+  LOG_ATTR_SENTENCE_END,
+  LOG_ATTR_BACKSPACE_DELETES_CHARACTER,
+  LOG_ATTR_EXPANDABLE_SPACE,
+  LOG_ATTR_WORD_BOUNDARY,
+  LOG_ATTR_BREAK_INSERTS_HYPHEN,
+  LOG_ATTR_BREAK_REMOVES_PRECEDING
 };
 
-static const char *font_members[] = {
-  "description",
-  "checksum",
-  "variations",
-  "features",
-  "matrix",
+static const char *log_attr_members[] = {
+  "line-break",
+  "mandatory-break",
+  "char-break",
+  "white",
+  "cursor-position",
+  "word-start",
+  "word-end",
+  "sentence-boundary",
+  "sentence-start",
+  "sentence-end",
+  "backspace-deletes-character",
+  "expandable-space",
+  "word-boundary",
+  "break-inserts-hyphen",
+  "break-removes-preceding",
   NULL
 };
 
-static PangoFont *
-json_parser_load_font (GtkJsonParser  *parser,
-                       PangoContext   *context,
-                       GError        **error)
+static void
+json_parser_fill_log_attrs (GtkJsonParser *parser,
+                            GArray        *log_attrs)
 {
-  PangoFont *font = NULL;
-
-  gtk_json_parser_start_object (parser);
+  gtk_json_parser_start_array (parser);
 
-  switch (gtk_json_parser_select_member (parser, font_members))
-    {
-    case FONT_DESCRIPTION:
+  if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+    do
       {
-        PangoFontDescription *desc = parser_get_font_description (parser);
-        font = pango_context_load_font (context, desc);
-        pango_font_description_free (desc);
-      }
-      break;
+        PangoLogAttr attr = { 0, };
 
-    default:
-      break;
-    }
+        gtk_json_parser_start_object (parser);
 
-  gtk_json_parser_end (parser);
+        do
+          {
+            gssize member = gtk_json_parser_select_member (parser, log_attr_members);
+            gboolean value;
+
+            if (member < 0)
+              continue;
+
+            value = gtk_json_parser_get_boolean (parser);
+
+            switch (member)
+              {
+              case LOG_ATTR_LINE_BREAK: attr.is_line_break = value; break;
+              case LOG_ATTR_MANDATORY_BREAK: attr.is_mandatory_break = value; break;
+              case LOG_ATTR_CHAR_BREAK: attr.is_char_break = value; break;
+              case LOG_ATTR_WHITE: attr.is_white = value; break;
+              case LOG_ATTR_CURSOR_POSITION: attr.is_cursor_position = value; break;
+              case LOG_ATTR_WORD_START: attr.is_word_start = value; break;
+              case LOG_ATTR_WORD_END: attr.is_word_end = value; break;
+              case LOG_ATTR_SENTENCE_BOUNDARY: attr.is_sentence_boundary = value; break;
+              case LOG_ATTR_SENTENCE_START: attr.is_sentence_start = value; break;
+              case LOG_ATTR_SENTENCE_END: attr.is_sentence_end = value; break;
+              case LOG_ATTR_BACKSPACE_DELETES_CHARACTER: attr.backspace_deletes_character = value; break;
+              case LOG_ATTR_EXPANDABLE_SPACE: attr.is_expandable_space = value; break;
+              case LOG_ATTR_WORD_BOUNDARY: attr.is_word_boundary = value; break;
+              case LOG_ATTR_BREAK_INSERTS_HYPHEN: attr.break_inserts_hyphen = value; break;
+              case LOG_ATTR_BREAK_REMOVES_PRECEDING: attr.break_removes_preceding = value; break;
+              default: break;
+              }
+          }
+        while (gtk_json_parser_next (parser));
 
-  return font;
-}
+        gtk_json_parser_end (parser);
 
-/* }}} */
-/* {{{ Public API */
+        g_array_append_val (log_attrs, attr);
+      }
+    while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+enum {
+  GLYPH_GLYPH,
+  GLYPH_WIDTH,
+  GLYPH_X_OFFSET,
+  GLYPH_Y_OFFSET,
+  GLYPH_IS_CLUSTER_START,
+  GLYPH_IS_COLOR,
+  GLYPH_LOG_CLUSTER
+};
+
+static const char *glyph_members[] = {
+  "glyph",
+  "width",
+  "x-offset",
+  "y-offset",
+  "is-cluster-start",
+  "is-color",
+  "log-cluster",
+  NULL
+};
+
+static void
+json_parser_fill_glyph_string (GtkJsonParser    *parser,
+                               PangoGlyphString *glyphs)
+{
+  gtk_json_parser_start_array (parser);
+
+  if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+    do
+      {
+        PangoGlyphInfo info = { 0, };
+        int log_cluster = 0;
+
+        gtk_json_parser_start_object (parser);
+
+        do
+          {
+            switch (gtk_json_parser_select_member (parser, glyph_members))
+              {
+              case GLYPH_GLYPH:
+                info.glyph = gtk_json_parser_get_uint (parser);
+                break;
+
+              case GLYPH_WIDTH:
+                info.geometry.width = gtk_json_parser_get_int (parser);
+                break;
+
+              case GLYPH_X_OFFSET:
+                info.geometry.x_offset = gtk_json_parser_get_int (parser);
+                break;
+
+              case GLYPH_Y_OFFSET:
+                info.geometry.y_offset = gtk_json_parser_get_int (parser);
+                break;
+
+              case GLYPH_IS_CLUSTER_START:
+                info.attr.is_cluster_start = gtk_json_parser_get_boolean (parser);
+                break;
+
+              case GLYPH_IS_COLOR:
+                info.attr.is_color = gtk_json_parser_get_boolean (parser);
+                break;
+
+              case GLYPH_LOG_CLUSTER:
+                log_cluster = gtk_json_parser_get_int (parser);
+                break;
+
+              default:
+                break;
+              }
+          }
+        while (gtk_json_parser_next (parser));
+
+        gtk_json_parser_end (parser);
+
+        pango_glyph_string_set_size (glyphs, glyphs->num_glyphs + 1);
+        glyphs->glyphs[glyphs->num_glyphs - 1] = info;
+        glyphs->log_clusters[glyphs->num_glyphs - 1] = log_cluster;
+      }
+    while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+static PangoScript
+parser_get_script (GtkJsonParser *parser)
+{
+  GEnumClass *enum_class;
+  GEnumValue *enum_value;
+  char *str;
+  PangoScript script = PANGO_SCRIPT_UNKNOWN;
+
+  str = gtk_json_parser_get_string (parser);
+
+  enum_class = g_type_class_ref (PANGO_TYPE_SCRIPT);
+  enum_value = g_enum_get_value_by_nick (enum_class, str);
+  g_type_class_unref (enum_class);
+
+  if (enum_value)
+    script = enum_value->value;
+  else
+    gtk_json_parser_value_error (parser, "Failed to parse script: %s", str);
+
+  g_free (str);
+
+  return script;
+}
+
+enum {
+  RUN_OFFSET,
+  RUN_LENGTH,
+  RUN_TEXT,
+  RUN_BIDI_LEVEL,
+  RUN_GRAVITY,
+  RUN_LANGUAGE,
+  RUN_SCRIPT,
+  RUN_FONT,
+  RUN_FLAGS,
+  RUN_EXTRA_ATTRIBUTES,
+  RUN_Y_OFFSET,
+  RUN_START_X_OFFSET,
+  RUN_END_X_OFFSET,
+  RUN_GLYPHS
+};
+
+static const char *run_members[] = {
+  "offset",
+  "length",
+  "text",
+  "bidi-level",
+  "gravity",
+  "language",
+  "script",
+  "font",
+  "flags",
+  "extra-attributes",
+  "y-offset",
+  "start-x-offset",
+  "end-x-offset",
+  "glyphs",
+  NULL
+};
+
+static PangoLayoutRun *
+json_parser_get_run (GtkJsonParser *parser,
+                     OutputData    *data)
+{
+  PangoGlyphItem *run;
+  PangoItem *item;
+  char *str;
+
+  item = pango_item_new ();
+  run = g_slice_new0 (PangoGlyphItem);
+  run->item = item;
+  run->glyphs = pango_glyph_string_new ();
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, run_members))
+        {
+        case RUN_OFFSET:
+          item->offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_LENGTH:
+          item->length = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_BIDI_LEVEL:
+          item->analysis.level = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_GRAVITY:
+          item->analysis.gravity = parser_select_string (parser, gravity_names);
+          break;
+
+        case RUN_LANGUAGE:
+          str = gtk_json_parser_get_string (parser);
+          item->analysis.language = pango_language_from_string (str);
+          g_free (str);
+          break;
+
+        case RUN_SCRIPT:
+          item->analysis.script = parser_get_script (parser);
+          break;
+
+        case RUN_FONT:
+          g_clear_object (&item->analysis.font);
+          item->analysis.font = output_data_load_font (data, parser);
+          if (item->analysis.font)
+            g_object_ref (item->analysis.font);
+          break;
+
+        case RUN_FLAGS:
+          item->analysis.flags |= gtk_json_parser_get_int (parser) & ~PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET;
+          break;
+
+        case RUN_EXTRA_ATTRIBUTES:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              {
+                PangoAttribute *attr = json_to_attribute (parser);
+                if (attr)
+                  item->analysis.extra_attrs = g_slist_prepend (item->analysis.extra_attrs, attr);
+              }
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          item->analysis.extra_attrs = g_slist_reverse (item->analysis.extra_attrs);
+          break;
+
+        case RUN_Y_OFFSET:
+          run->y_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_START_X_OFFSET:
+          run->start_x_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_END_X_OFFSET:
+          run->end_x_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_GLYPHS:
+          json_parser_fill_glyph_string (parser, run->glyphs);
+          break;
+
+        case RUN_TEXT:
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+
+  return run;
+}
+
+enum {
+  LINE_START_INDEX,
+  LINE_LENGTH,
+  LINE_PARAGRAPH_START,
+  LINE_DIRECTION,
+  LINE_RUNS
+};
+
+static const char *line_members[] = {
+  "start-index",
+  "length",
+  "paragraph-start",
+  "direction",
+  "runs",
+  NULL
+};
+
+static void
+json_parser_add_line (GtkJsonParser *parser,
+                      OutputData    *data)
+{
+  PangoLayoutLine *line;
+
+  line = _pango_layout_line_new (data->layout);
+  line->start_index = 0;
+  line->is_paragraph_start = FALSE;
+  line->resolved_dir = PANGO_DIRECTION_LTR;
+
+  /* Add it right away, so it is freed if parsing fails */
+  data->lines = g_slist_prepend (data->lines, line);
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, line_members))
+        {
+        case LINE_START_INDEX:
+          line->start_index = gtk_json_parser_get_int (parser);
+          break;
+
+        case LINE_LENGTH:
+          line->length = gtk_json_parser_get_int (parser);
+          break;
+
+        case LINE_PARAGRAPH_START:
+          line->is_paragraph_start = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case LINE_DIRECTION:
+          line->resolved_dir = parser_select_string (parser, direction_names);
+          break;
+
+        case LINE_RUNS:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              {
+                PangoLayoutRun *run = json_parser_get_run (parser, data);
+                line->runs = g_slist_prepend (line->runs, run);
+              }
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          line->runs = g_slist_reverse (line->runs);
+          break;
+
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+enum {
+  OUTPUT_IS_WRAPPED,
+  OUTPUT_IS_ELLIPSIZED,
+  OUTPUT_UNKNOWN_GLYPHS,
+  OUTPUT_WIDTH,
+  OUTPUT_HEIGHT,
+  OUTPUT_LOG_ATTRS,
+  OUTPUT_LINES
+};
+
+static const char *output_members[] = {
+  "is-wrapped",
+  "is-ellipsized",
+  "unknown-glyphs",
+  "width",
+  "height",
+  "log-attrs",
+  "lines",
+  NULL
+};
+
+static void
+json_parser_fill_output (GtkJsonParser *parser,
+                         OutputData    *data)
+{
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, output_members))
+        {
+        case OUTPUT_IS_WRAPPED:
+          data->is_wrapped = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case OUTPUT_IS_ELLIPSIZED:
+          data->is_ellipsized = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case OUTPUT_LOG_ATTRS:
+          g_array_set_size (data->log_attrs, 0);
+          json_parser_fill_log_attrs (parser, data->log_attrs);
+          break;
+
+        case OUTPUT_LINES:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              json_parser_add_line (parser, data);
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          break;
+
+        /* These are derived from the lines */
+        case OUTPUT_UNKNOWN_GLYPHS:
+        case OUTPUT_WIDTH:
+        case OUTPUT_HEIGHT:
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+/* Checks that the parsed output is consistent with the text
+ * of the layout, and fills in what the JSON doesn't store.
+ */
+static gboolean
+output_data_validate (OutputData *data)
+{
+  PangoLayout *layout = data->layout;
+
+  if (!data->fonts_match ||
+      data->lines == NULL ||
+      data->log_attrs->len != layout->n_chars + 1)
+    return FALSE;
+
+  for (GSList *l = data->lines; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      int line_char_offset;
+
+      if (line->start_index < 0 || line->length < 0 ||
+          line->start_index > layout->length ||
+          line->length > layout->length - line->start_index)
+        return FALSE;
+
+      line_char_offset = pango_utf8_strlen (layout->text, line->start_index);
+
+      for (GSList *r = line->runs; r; r = r->next)
+        {
+          PangoLayoutRun *run = r->data;
+          PangoItem *item = run->item;
+
+          if (item->offset < line->start_index || item->length < 0 ||
+              item->offset > layout->length ||
+              item->length > layout->length - item->offset ||
+              !item->analysis.font)
+            return FALSE;
+
+          for (int i = 0; i < run->glyphs->num_glyphs; i++)
+            if (run->glyphs->log_clusters[i] < 0 ||
+                run->glyphs->log_clusters[i] >= MAX (item->length, 1))
+              return FALSE;
+
+          item->num_chars = pango_utf8_strlen (layout->text + item->offset, item->length);
+          ((PangoItemPrivate *)item)->char_offset =
+              line_char_offset + pango_utf8_strlen (layout->text + line->start_index,
+                                                    item->offset - line->start_index);
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+font_unref (gpointer data)
+{
+  if (data)
+    g_object_unref (data);
+}
+
+static void
+output_data_init (OutputData  *data,
+                  PangoLayout *layout)
+{
+  data->layout = layout;
+  data->fonts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, font_unref);
+  data->fonts_match = TRUE;
+  data->lines = NULL;
+  data->log_attrs = g_array_new (FALSE, FALSE, sizeof (PangoLogAttr));
+  data->is_wrapped = FALSE;
+  data->is_ellipsized = FALSE;
+}
+
+static void
+output_data_finish (OutputData *data,
+                    gboolean    install)
+{
+  if (install && output_data_validate (data))
+    {
+      _pango_layout_set_output (data->layout,
+                                g_slist_reverse (data->lines),
+                                (PangoLogAttr *) g_array_free (data->log_attrs, FALSE),
+                                data->is_wrapped,
+                                data->is_ellipsized);
+    }
+  else
+    {
+      for (GSList *l = data->lines; l; l = l->next)
+        {
+          PangoLayoutLine *line = l->data;
+          line->layout = NULL;
+          pango_layout_line_unref (line);
+        }
+      g_slist_free (data->lines);
+      g_array_free (data->log_attrs, TRUE);
+    }
+
+  g_hash_table_unref (data->fonts);
+}
+
+enum {
+  LAYOUT_CONTEXT,
+  LAYOUT_COMMENT,
+  LAYOUT_TEXT,
+  LAYOUT_ATTRIBUTES,
+  LAYOUT_FONT,
+  LAYOUT_TABS,
+  LAYOUT_JUSTIFY,
+  LAYOUT_JUSTIFY_LAST_LINE,
+  LAYOUT_SINGLE_PARAGRAPH,
+  LAYOUT_AUTO_DIR,
+  LAYOUT_ALIGNMENT,
+  LAYOUT_WRAP,
+  LAYOUT_ELLIPSIZE,
+  LAYOUT_WIDTH,
+  LAYOUT_HEIGHT,
+  LAYOUT_INDENT,
+  LAYOUT_SPACING,
+  LAYOUT_LINE_SPACING,
+  LAYOUT_OUTPUT
+};
+
+static const char *layout_members[] = {
+  "context",
+  "comment",
+  "text",
+  "attributes",
+  "font",
+  "tabs",
+  "justify",
+  "justify-last-line",
+  "single-paragraph",
+  "auto-dir",
+  "alignment",
+  "wrap",
+  "ellipsize",
+  "width",
+  "height",
+  "indent",
+  "spacing",
+  "line-spacing",
+  "output",
+  NULL
+};
+
+static void
+json_parser_fill_layout (GtkJsonParser               *parser,
+                         PangoLayout                 *layout,
+                         PangoLayoutDeserializeFlags  flags)
+{
+  OutputData output;
+  gboolean has_context = FALSE;
+
+  output_data_init (&output, layout);
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      char *str;
+
+      switch (gtk_json_parser_select_member (parser, layout_members))
+        {
+        case LAYOUT_CONTEXT:
+          {
+            char *font_options = NULL;
+
+            has_context = TRUE;
+
+            if (flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT)
+              json_parser_fill_context (parser, pango_layout_get_context (layout), &font_options);
+            else if (flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT)
+              {
+                /* The output is only valid for a context
+                 * that positions glyphs the same way
+                 */
+                PangoContext *stored = pango_context_new ();
+
+                json_parser_fill_context (parser, stored, &font_options);
+                if (!context_state_matches (pango_layout_get_context (layout), stored))
+                  output.fonts_match = FALSE;
+                g_object_unref (stored);
+              }
+
+            if (g_strcmp0 (font_options, pango_layout_get_context (layout)->font_options) != 0)
+              output.fonts_match = FALSE;
+            g_free (font_options);
+          }
+          break;
+
+        case LAYOUT_COMMENT:
+          str = gtk_json_parser_get_string (parser);
+          g_object_set_data_full (G_OBJECT (layout), "comment", str, g_free);
+          break;
+
+        case LAYOUT_TEXT:
+          str = gtk_json_parser_get_string (parser);
+          pango_layout_set_text (layout, str, -1);
+          g_free (str);
+          break;
+
+        case LAYOUT_ATTRIBUTES:
+          {
+            PangoAttrList *attributes = pango_attr_list_new ();
+            json_parser_fill_attr_list (parser, attributes);
+            pango_layout_set_attributes (layout, attributes);
+            pango_attr_list_unref (attributes);
+          }
+          break;
+
+        case LAYOUT_FONT:
+          {
+            PangoFontDescription *desc = parser_get_font_description (parser);;
+            pango_layout_set_font_description (layout, desc);
+            pango_font_description_free (desc);
+          }
+          break;
+
+        case LAYOUT_TABS:
+          {
+            PangoTabArray *tabs = pango_tab_array_new (0, FALSE);
+            json_parser_fill_tab_array (parser, tabs);
+            pango_layout_set_tabs (layout, tabs);
+            pango_tab_array_free (tabs);
+          }
+          break;
+
+        case LAYOUT_JUSTIFY:
+          pango_layout_set_justify (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_JUSTIFY_LAST_LINE:
+          pango_layout_set_justify_last_line (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_SINGLE_PARAGRAPH:
+          pango_layout_set_single_paragraph_mode (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_AUTO_DIR:
+          pango_layout_set_auto_dir (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_ALIGNMENT:
+          pango_layout_set_alignment (layout, (PangoAlignment) parser_select_string (parser, alignment_names));
+          break;
+
+        case LAYOUT_WRAP:
+          pango_layout_set_wrap (layout, (PangoWrapMode) parser_select_string (parser, wrap_names));
+          break;
+
+        case LAYOUT_ELLIPSIZE:
+          pango_layout_set_ellipsize (layout, (PangoEllipsizeMode) parser_select_string (parser, ellipsize_names));
+          break;
+
+        case LAYOUT_WIDTH:
+          pango_layout_set_width (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_HEIGHT:
+          pango_layout_set_height (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_INDENT:
+          pango_layout_set_indent (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_SPACING:
+          pango_layout_set_spacing (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_LINE_SPACING:
+          pango_layout_set_line_spacing (layout, gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_OUTPUT:
+          if (flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT)
+            json_parser_fill_output (parser, &output);
+          break;
+
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+
+  /* Without the context, there is no telling
+   * how the glyphs of the output were positioned
+   */
+  if (!has_context)
+    output.fonts_match = FALSE;
+
+  output_data_finish (&output,
+                      (flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT) != 0 &&
+                      gtk_json_parser_get_error (parser) == NULL);
+}
+
+static PangoFont *
+json_parser_load_font (GtkJsonParser  *parser,
+                       PangoContext   *context,
+                       GError        **error)
+{
+  PangoFont *font = NULL;
+  char *description, *checksum;
+
+  json_parser_get_font_data (parser, &description, &checksum, NULL, NULL);
+
+  if (description)
+    {
+      PangoFontDescription *desc = pango_font_description_from_string (description);
+      font = pango_context_load_font (context, desc);
+      pango_font_description_free (desc);
+    }
+
+  g_free (description);
+  g_free (checksum);
+
+  return font;
+}
+
+/* }}} */
+/* {{{ Binary format */
+
+/* The binary format is a flat, versioned image that can be used
+ * straight from a memory-mapped file. All records consist of
+ * 32-bit words in host byte order and are 4-byte aligned. Records
+ * refer to each other and to strings by offsets from the start
+ * of the data. Strings are nul-terminated; the length in a
+ * BinRange does not include the terminator.
+ *
+ * The format is not portable across architectures with different
+ * byte order; deserialization rejects data from such machines.
+ */
+
+#define BINARY_MAGIC "PANGOLB"
+#define BINARY_VERSION 3
+#define BINARY_BYTE_ORDER 0x01020304
+
+#define BINARY_NONE G_MAXUINT32
+
+/* The deepest embedding level the bidi algorithm resolves to */
+#define BINARY_MAX_BIDI_LEVEL 126
+
+enum {
+  BINARY_HAS_CONTEXT = 1 << 0,
+  BINARY_HAS_OUTPUT  = 1 << 1,
+};
+
+enum {
+  BINARY_JUSTIFY           = 1 << 0,
+  BINARY_JUSTIFY_LAST_LINE = 1 << 1,
+  BINARY_SINGLE_PARAGRAPH  = 1 << 2,
+  BINARY_AUTO_DIR          = 1 << 3,
+  BINARY_IS_WRAPPED        = 1 << 4,
+  BINARY_IS_ELLIPSIZED     = 1 << 5,
+  BINARY_PARAGRAPH_START   = 1 << 6,
+  BINARY_CLUSTER_START     = 1 << 7,
+  BINARY_IS_COLOR          = 1 << 8,
+  BINARY_TABS_IN_PIXELS    = 1 << 9,
+  BINARY_ROUND_POSITIONS   = 1 << 10,
+};
+
+/* For strings, offset and length in bytes. For arrays, offset
+ * and number of elements. A string offset of BINARY_NONE means NULL.
+ */
+typedef struct {
+  guint32 offset;
+  guint32 length;
+} BinRange;
+
+typedef struct {
+  guint32 type;
+  guint32 start;
+  guint32 end;
+  guint32 value[2];
+} BinAttr;
+
+typedef struct {
+  gint32 position;
+  guint32 alignment;
+  gint32 decimal_point;
+} BinTab;
+
+typedef struct {
+  BinRange font;
+  BinRange language;
+  guint32 base_gravity;
+  guint32 gravity_hint;
+  guint32 base_dir;
+  guint32 matrix[12];
+  BinRange font_options;
+} BinContext;
+
+/* Besides identifying the face, a font records its transformation,
+ * variations and the extents of one glyph that it shaped. The probe
+ * extents change with the font options (hinting, metrics rounding)
+ * that glyph positions depend on.
+ */
+typedef struct {
+  BinRange description;
+  BinRange checksum;
+  BinRange variations;
+  guint32 matrix[12];
+  guint32 probe_glyph;
+  gint32 probe_ink[4];
+  gint32 probe_logical[4];
+} BinFont;
+
+typedef struct {
+  gint32 start_index;
+  gint32 length;
+  guint32 flags;
+  guint32 resolved_dir;
+  BinRange runs;
+} BinLine;
+
+typedef struct {
+  gint32 offset;
+  gint32 length;
+  gint32 num_chars;
+  gint32 char_offset;
+  guint32 level;
+  guint32 gravity;
+  guint32 script;
+  guint32 flags;
+  BinRange language;
+  guint32 font;
+  BinRange extra_attrs;
+  gint32 y_offset;
+  gint32 start_x_offset;
+  gint32 end_x_offset;
+  BinRange glyphs;
+} BinRun;
+
+typedef struct {
+  guint32 glyph;
+  gint32 width;
+  gint32 x_offset;
+  gint32 y_offset;
+  guint32 flags;
+  gint32 log_cluster;
+} BinGlyph;
+
+typedef struct {
+  char magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 flags;
+  guint32 size;
+
+  BinRange comment;
+  BinRange text;
+  BinRange font;
+  BinRange attrs;
+  BinRange tabs;
+  guint32 layout_flags;
+  guint32 alignment;
+  guint32 wrap;
+  guint32 ellipsize;
+  gint32 width;
+  gint32 height;
+  gint32 indent;
+  gint32 spacing;
+  guint32 line_spacing[2];
+
+  BinContext context;
+
+  /* Output */
+  BinRange log_attrs;
+  BinRange fonts;
+  BinRange lines;
+  BinRange runs;
+  BinRange glyphs;
+
+  /* All attributes: layout attributes first, then run attributes */
+  BinRange attr_table;
+} BinHeader;
+
+G_STATIC_ASSERT (sizeof (PangoLogAttr) == sizeof (guint32));
+G_STATIC_ASSERT (sizeof (BinHeader) % 4 == 0);
+
+static void
+binary_put_double (guint32 *words,
+                   double   value)
+{
+  memcpy (words, &value, sizeof (double));
+}
+
+static double
+binary_get_double (const guint32 *words)
+{
+  double value;
+
+  memcpy (&value, words, sizeof (double));
+
+  return value;
+}
+
+typedef struct {
+  GByteArray *data;
+  GArray *attrs;
+  GArray *fonts;
+  GHashTable *font_index;
+  GArray *lines;
+  GArray *runs;
+  GArray *glyphs;
+} BinaryWriter;
+
+static guint32
+binary_append (BinaryWriter *writer,
+               gconstpointer data,
+               gsize         size)
+{
+  static const guint8 padding[4] = { 0, };
+  guint32 offset = writer->data->len;
+
+  g_byte_array_append (writer->data, data, size);
+  if (size % 4)
+    g_byte_array_append (writer->data, padding, 4 - size % 4);
+
+  return offset;
+}
+
+static BinRange
+binary_add_string (BinaryWriter *writer,
+                   const char   *str)
+{
+  BinRange range;
+  gsize len;
+
+  if (!str)
+    return (BinRange) { BINARY_NONE, 0 };
+
+  len = strlen (str);
+  range.offset = binary_append (writer, str, len + 1);
+  range.length = len;
+
+  return range;
+}
+
+static BinRange
+binary_add_array (BinaryWriter *writer,
+                  GArray       *array)
+{
+  BinRange range;
+
+  range.offset = binary_append (writer, array->data, array->len * g_array_get_element_size (array));
+  range.length = array->len;
+
+  return range;
+}
+
+static void
+binary_add_attribute (BinaryWriter   *writer,
+                      GArray         *attrs,
+                      PangoAttribute *attr)
+{
+  BinAttr a = { 0, };
+  char *str;
+
+  a.type = attr->klass->type;
+  a.start = attr->start_index;
+  a.end = attr->end_index;
+
+  switch (attr->klass->type)
+    {
+    default:
+    case PANGO_ATTR_INVALID:
+      g_assert_not_reached ();
+
+    case PANGO_ATTR_SHAPE:
+      /* Not serializable, like in the JSON format */
+      return;
+
+    case PANGO_ATTR_LANGUAGE:
+      {
+        BinRange r = binary_add_string (writer, pango_language_to_string (((PangoAttrLanguage*)attr)->value));
+        a.value[0] = r.offset;
+        a.value[1] = r.length;
+      }
+      break;
+
+    case PANGO_ATTR_FAMILY:
+    case PANGO_ATTR_FONT_FEATURES:
+      {
+        BinRange r = binary_add_string (writer, ((PangoAttrString*)attr)->value);
+        a.value[0] = r.offset;
+        a.value[1] = r.length;
+      }
+      break;
+
+    case PANGO_ATTR_FONT_DESC:
+      {
+        BinRange r;
+
+        str = pango_font_description_to_string (((PangoAttrFontDesc*)attr)->desc);
+        r = binary_add_string (writer, str);
+        g_free (str);
+        a.value[0] = r.offset;
+        a.value[1] = r.length;
+      }
+      break;
+
+    case PANGO_ATTR_FOREGROUND:
+    case PANGO_ATTR_BACKGROUND:
+    case PANGO_ATTR_UNDERLINE_COLOR:
+    case PANGO_ATTR_OVERLINE_COLOR:
+    case PANGO_ATTR_STRIKETHROUGH_COLOR:
+      {
+        PangoColor *color = &((PangoAttrColor*)attr)->color;
+        a.value[0] = color->red | ((guint32) color->green << 16);
+        a.value[1] = color->blue;
+      }
+      break;
+
+    case PANGO_ATTR_SCALE:
+    case PANGO_ATTR_LINE_HEIGHT:
+      binary_put_double (a.value, ((PangoAttrFloat*)attr)->value);
+      break;
+
+    case PANGO_ATTR_STYLE:
+    case PANGO_ATTR_WEIGHT:
+    case PANGO_ATTR_VARIANT:
+    case PANGO_ATTR_STRETCH:
+    case PANGO_ATTR_SIZE:
+    case PANGO_ATTR_UNDERLINE:
+    case PANGO_ATTR_STRIKETHROUGH:
+    case PANGO_ATTR_RISE:
+    case PANGO_ATTR_FALLBACK:
+    case PANGO_ATTR_LETTER_SPACING:
+    case PANGO_ATTR_ABSOLUTE_SIZE:
+    case PANGO_ATTR_GRAVITY:
+    case PANGO_ATTR_GRAVITY_HINT:
+    case PANGO_ATTR_FOREGROUND_ALPHA:
+    case PANGO_ATTR_BACKGROUND_ALPHA:
+    case PANGO_ATTR_ALLOW_BREAKS:
+    case PANGO_ATTR_SHOW:
+    case PANGO_ATTR_INSERT_HYPHENS:
+    case PANGO_ATTR_OVERLINE:
+    case PANGO_ATTR_ABSOLUTE_LINE_HEIGHT:
+    case PANGO_ATTR_TEXT_TRANSFORM:
+    case PANGO_ATTR_WORD:
+    case PANGO_ATTR_SENTENCE:
+    case PANGO_ATTR_BASELINE_SHIFT:
+    case PANGO_ATTR_FONT_SCALE:
+      a.value[0] = (guint32) ((PangoAttrInt*)attr)->value;
+      break;
+    }
+
+  g_array_append_val (attrs, a);
+}
+
+static BinRange
+binary_add_attr_list (BinaryWriter *writer,
+                      GSList       *attributes)
+{
+  BinRange range;
+
+  range.offset = writer->attrs->len;
+
+  for (GSList *l = attributes; l; l = l->next)
+    binary_add_attribute (writer, writer->attrs, l->data);
+
+  range.length = writer->attrs->len - range.offset;
+
+  return range;
+}
+
+static void
+binary_put_rect (gint32               *words,
+                 const PangoRectangle *rect)
+{
+  words[0] = rect->x;
+  words[1] = rect->y;
+  words[2] = rect->width;
+  words[3] = rect->height;
+}
+
+static gboolean
+binary_rect_equal (const gint32         *words,
+                   const PangoRectangle *rect)
+{
+  return words[0] == rect->x && words[1] == rect->y &&
+         words[2] == rect->width && words[3] == rect->height;
+}
+
+static void
+binary_put_matrix (guint32           *words,
+                   const PangoMatrix *matrix)
+{
+  binary_put_double (&words[0], matrix->xx);
+  binary_put_double (&words[2], matrix->xy);
+  binary_put_double (&words[4], matrix->yx);
+  binary_put_double (&words[6], matrix->yy);
+  binary_put_double (&words[8], matrix->x0);
+  binary_put_double (&words[10], matrix->y0);
+}
+
+static void
+binary_get_matrix (const guint32 *words,
+                   PangoMatrix   *matrix)
+{
+  matrix->xx = binary_get_double (&words[0]);
+  matrix->xy = binary_get_double (&words[2]);
+  matrix->yx = binary_get_double (&words[4]);
+  matrix->yy = binary_get_double (&words[6]);
+  matrix->x0 = binary_get_double (&words[8]);
+  matrix->y0 = binary_get_double (&words[10]);
+}
+
+/* @probe_glyph is a glyph that the font shaped, whose
+ * extents are stored along with the font
+ */
+static guint32
+binary_add_font (BinaryWriter *writer,
+                 PangoFont    *font,
+                 PangoGlyph    probe_glyph)
+{
+  gpointer value;
+  PangoFontDescription *desc;
+  PangoMatrix matrix;
+  PangoRectangle ink, logical;
+  BinFont f;
+  char *str;
+
+  if (!font)
+    return BINARY_NONE;
+
+  if (g_hash_table_lookup_extended (writer->font_index, font, NULL, &value))
+    return GPOINTER_TO_UINT (value);
+
+  desc = pango_font_describe (font);
+  str = pango_font_description_to_string (desc);
+  f.description = binary_add_string (writer, str);
+  g_free (str);
+  pango_font_description_free (desc);
+
+  f.checksum = binary_add_string (writer, get_font_checksum (font));
+
+  str = get_font_variations (font);
+  f.variations = binary_add_string (writer, str);
+  g_free (str);
+
+  pango_font_get_matrix (font, &matrix);
+  binary_put_matrix (f.matrix, &matrix);
+
+  if (probe_glyph & PANGO_GLYPH_UNKNOWN_FLAG)
+    probe_glyph = PANGO_GLYPH_EMPTY;
+  f.probe_glyph = probe_glyph;
+  pango_font_get_glyph_extents (font, probe_glyph, &ink, &logical);
+  binary_put_rect (f.probe_ink, &ink);
+  binary_put_rect (f.probe_logical, &logical);
+
+  g_array_append_val (writer->fonts, f);
+  g_hash_table_insert (writer->font_index, font, GUINT_TO_POINTER (writer->fonts->len - 1));
+
+  return writer->fonts->len - 1;
+}
+
+static void
+binary_add_run (BinaryWriter   *writer,
+                PangoLayoutRun *run)
+{
+  PangoItem *item = run->item;
+  BinRun r;
+
+  r.offset = item->offset;
+  r.length = item->length;
+  r.num_chars = item->num_chars;
+  if (item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET)
+    r.char_offset = ((PangoItemPrivate *)item)->char_offset;
+  else
+    r.char_offset = -1;
+  r.level = item->analysis.level;
+  r.gravity = item->analysis.gravity;
+  r.script = item->analysis.script;
+  r.flags = item->analysis.flags & ~PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET;
+  r.language = binary_add_string (writer, pango_language_to_string (item->analysis.language));
+  r.font = binary_add_font (writer, item->analysis.font,
+                            run->glyphs->num_glyphs > 0 ? run->glyphs->glyphs[0].glyph
+                                                        : PANGO_GLYPH_EMPTY);
+  r.extra_attrs.offset = writer->attrs->len;
+  for (GSList *l = item->analysis.extra_attrs; l; l = l->next)
+    binary_add_attribute (writer, writer->attrs, l->data);
+  r.extra_attrs.length = writer->attrs->len - r.extra_attrs.offset;
+  r.y_offset = run->y_offset;
+  r.start_x_offset = run->start_x_offset;
+  r.end_x_offset = run->end_x_offset;
+
+  r.glyphs.offset = writer->glyphs->len;
+  r.glyphs.length = run->glyphs->num_glyphs;
+  for (int i = 0; i < run->glyphs->num_glyphs; i++)
+    {
+      PangoGlyphInfo *info = &run->glyphs->glyphs[i];
+      BinGlyph g;
+
+      g.glyph = info->glyph;
+      g.width = info->geometry.width;
+      g.x_offset = info->geometry.x_offset;
+      g.y_offset = info->geometry.y_offset;
+      g.flags = (info->attr.is_cluster_start ? BINARY_CLUSTER_START : 0) |
+                (info->attr.is_color ? BINARY_IS_COLOR : 0);
+      g.log_cluster = run->glyphs->log_clusters[i];
+
+      g_array_append_val (writer->glyphs, g);
+    }
+
+  g_array_append_val (writer->runs, r);
+}
+
+static void
+binary_add_output (BinaryWriter *writer,
+                   PangoLayout  *layout,
+                   BinHeader    *header)
+{
+  const PangoLogAttr *log_attrs;
+  int n_attrs;
+
+  log_attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+  header->log_attrs.offset = binary_append (writer, log_attrs, n_attrs * sizeof (PangoLogAttr));
+  header->log_attrs.length = n_attrs;
+
+  if (pango_layout_is_wrapped (layout))
+    header->layout_flags |= BINARY_IS_WRAPPED;
+  if (pango_layout_is_ellipsized (layout))
+    header->layout_flags |= BINARY_IS_ELLIPSIZED;
+
+  for (GSList *l = layout->lines; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      BinLine bl;
+
+      bl.start_index = line->start_index;
+      bl.length = line->length;
+      bl.flags = line->is_paragraph_start ? BINARY_PARAGRAPH_START : 0;
+      bl.resolved_dir = line->resolved_dir;
+      bl.runs.offset = writer->runs->len;
+
+      for (GSList *r = line->runs; r; r = r->next)
+        binary_add_run (writer, r->data);
+
+      bl.runs.length = writer->runs->len - bl.runs.offset;
+
+      g_array_append_val (writer->lines, bl);
+    }
+}
+
+static GBytes *
+layout_to_binary (PangoLayout               *layout,
+                  PangoLayoutSerializeFlags  flags)
+{
+  BinaryWriter writer;
+  BinHeader header = { BINARY_MAGIC, };
+  GSList *attributes;
+  const char *str;
+  gsize size;
+
+  writer.data = g_byte_array_new ();
+  writer.attrs = g_array_new (FALSE, FALSE, sizeof (BinAttr));
+  writer.fonts = g_array_new (FALSE, FALSE, sizeof (BinFont));
+  writer.font_index = g_hash_table_new (NULL, NULL);
+  writer.lines = g_array_new (FALSE, FALSE, sizeof (BinLine));
+  writer.runs = g_array_new (FALSE, FALSE, sizeof (BinRun));
+  writer.glyphs = g_array_new (FALSE, FALSE, sizeof (BinGlyph));
+
+  /* Reserve space for the header, we fill it in at the end */
+  g_byte_array_set_size (writer.data, sizeof (BinHeader));
+
+  header.version = BINARY_VERSION;
+  header.byte_order = BINARY_BYTE_ORDER;
+
+  str = (const char *) g_object_get_data (G_OBJECT (layout), "comment");
+  header.comment = binary_add_string (&writer, str);
+  header.text = binary_add_string (&writer, layout->text ? layout->text : "");
+
+  if (layout->font_desc)
+    {
+      char *s = pango_font_description_to_string (layout->font_desc);
+      header.font = binary_add_string (&writer, s);
+      g_free (s);
+    }
+  else
+    header.font = binary_add_string (&writer, NULL);
+
+  attributes = layout->attrs ? pango_attr_list_get_attributes (layout->attrs) : NULL;
+  header.attrs = binary_add_attr_list (&writer, attributes);
+  g_slist_free_full (attributes, (GDestroyNotify) pango_attribute_destroy);
+
+  if (layout->tabs)
+    {
+      GArray *tabs = g_array_new (FALSE, FALSE, sizeof (BinTab));
+
+      for (int i = 0; i < pango_tab_array_get_size (layout->tabs); i++)
+        {
+          BinTab tab;
+          PangoTabAlign align;
+
+          pango_tab_array_get_tab (layout->tabs, i, &align, &tab.position);
+          tab.alignment = align;
+          tab.decimal_point = pango_tab_array_get_decimal_point (layout->tabs, i);
+          g_array_append_val (tabs, tab);
+        }
+
+      header.tabs = binary_add_array (&writer, tabs);
+      if (pango_tab_array_get_positions_in_pixels (layout->tabs))
+        header.layout_flags |= BINARY_TABS_IN_PIXELS;
+
+      g_array_unref (tabs);
+    }
+  else
+    header.tabs = (BinRange) { BINARY_NONE, 0 };
+
+  if (layout->justify)
+    header.layout_flags |= BINARY_JUSTIFY;
+  if (layout->justify_last_line)
+    header.layout_flags |= BINARY_JUSTIFY_LAST_LINE;
+  if (layout->single_paragraph)
+    header.layout_flags |= BINARY_SINGLE_PARAGRAPH;
+  if (layout->auto_dir)
+    header.layout_flags |= BINARY_AUTO_DIR;
+
+  header.alignment = layout->alignment;
+  header.wrap = layout->wrap;
+  header.ellipsize = layout->ellipsize;
+  header.width = layout->width;
+  header.height = layout->height;
+  header.indent = layout->indent;
+  header.spacing = layout->spacing;
+  binary_put_double (header.line_spacing, layout->line_spacing);
+
+  if (flags & PANGO_LAYOUT_SERIALIZE_CONTEXT)
+    {
+      PangoContext *context = layout->context;
+      const PangoMatrix *matrix;
+      PangoMatrix identity = PANGO_MATRIX_INIT;
+      char *s;
+
+      header.flags |= BINARY_HAS_CONTEXT;
+
+      s = pango_font_description_to_string (context->font_desc);
+      header.context.font = binary_add_string (&writer, s);
+      g_free (s);
+
+      header.context.language = binary_add_string (&writer,
+                                                   context->set_language
+                                                   ? pango_language_to_string (context->set_language)
+                                                   : NULL);
+      header.context.base_gravity = context->base_gravity;
+      header.context.gravity_hint = context->gravity_hint;
+      header.context.base_dir = context->base_dir;
+      header.context.font_options = binary_add_string (&writer, context->font_options);
+      if (context->round_glyph_positions)
+        header.layout_flags |= BINARY_ROUND_POSITIONS;
+
+      matrix = pango_context_get_matrix (context);
+      if (!matrix)
+        matrix = &identity;
+
+      binary_put_matrix (header.context.matrix, matrix);
+    }
+
+  if (flags & PANGO_LAYOUT_SERIALIZE_OUTPUT)
+    {
+      header.flags |= BINARY_HAS_OUTPUT;
+      binary_add_output (&writer, layout, &header);
+    }
+
+  header.attr_table = binary_add_array (&writer, writer.attrs);
+  header.fonts = binary_add_array (&writer, writer.fonts);
+  header.lines = binary_add_array (&writer, writer.lines);
+  header.runs = binary_add_array (&writer, writer.runs);
+  header.glyphs = binary_add_array (&writer, writer.glyphs);
+
+  header.size = writer.data->len;
+  memcpy (writer.data->data, &header, sizeof (BinHeader));
+
+  g_array_unref (writer.attrs);
+  g_array_unref (writer.fonts);
+  g_hash_table_unref (writer.font_index);
+  g_array_unref (writer.lines);
+  g_array_unref (writer.runs);
+  g_array_unref (writer.glyphs);
+
+  size = writer.data->len;
+  return g_bytes_new_take (g_byte_array_free (writer.data, FALSE), size);
+}
+
+typedef struct {
+  const guint8 *data;
+  gsize size;
+  const BinHeader *header;
+  const BinAttr *attrs;
+  const BinGlyph *glyphs;
+} BinaryReader;
+
+static gboolean
+binary_get_string (BinaryReader  *reader,
+                   BinRange       range,
+                   const char   **str)
+{
+  if (range.offset == BINARY_NONE)
+    {
+      *str = NULL;
+      return TRUE;
+    }
+
+  if (range.offset >= reader->size ||
+      range.length >= reader->size - range.offset ||
+      reader->data[range.offset + range.length] != '\0')
+    return FALSE;
+
+  *str = (const char *) reader->data + range.offset;
+
+  return TRUE;
+}
+
+static gboolean
+binary_get_array (BinaryReader   *reader,
+                  BinRange        range,
+                  gsize           element_size,
+                  gconstpointer  *array)
+{
+  if (range.length == 0)
+    {
+      *array = NULL;
+      return TRUE;
+    }
+
+  if (range.offset % 4 != 0 ||
+      range.offset > reader->size ||
+      range.length > (reader->size - range.offset) / element_size)
+    return FALSE;
+
+  *array = reader->data + range.offset;
+
+  return TRUE;
+}
+
+/* Checks that @sub is a valid subrange of an array with @n elements */
+static inline gboolean
+binary_check_subrange (BinRange sub,
+                       guint32  n)
+{
+  return sub.offset <= n && sub.length <= n - sub.offset;
+}
+
+/* Checks that @value has a name in @names. This is the
+ * same set of values that parser_select_string() accepts
+ * for the JSON format, and that the JSON printer can print.
+ */
+static inline gboolean
+binary_check_enum (guint32      value,
+                   const char **names)
+{
+  return value < g_strv_length ((char **) names);
+}
+
+static PangoAttribute *
+binary_to_attribute (BinaryReader  *reader,
+                     const BinAttr *a)
+{
+  PangoAttribute *attr;
+  PangoFontDescription *desc;
+  const char *str = NULL;
+  int value = (int) a->value[0];
+  guint16 red = a->value[0] & 0xffff;
+  guint16 green = a->value[0] >> 16;
+  guint16 blue = a->value[1] & 0xffff;
+
+  switch (a->type)
+    {
+    case PANGO_ATTR_LANGUAGE:
+    case PANGO_ATTR_FAMILY:
+    case PANGO_ATTR_FONT_FEATURES:
+    case PANGO_ATTR_FONT_DESC:
+      if (!binary_get_string (reader, (BinRange) { a->value[0], a->value[1] }, &str) || !str)
+        return NULL;
+      break;
+    case PANGO_ATTR_STYLE:
+      if (!binary_check_enum (a->value[0], style_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_VARIANT:
+      if (!binary_check_enum (a->value[0], variant_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_STRETCH:
+      if (!binary_check_enum (a->value[0], stretch_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_UNDERLINE:
+      if (!binary_check_enum (a->value[0], underline_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_OVERLINE:
+      if (!binary_check_enum (a->value[0], overline_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_GRAVITY:
+      if (!binary_check_enum (a->value[0], gravity_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_GRAVITY_HINT:
+      if (!binary_check_enum (a->value[0], gravity_hint_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_TEXT_TRANSFORM:
+      if (!binary_check_enum (a->value[0], text_transform_names))
+        return NULL;
+      break;
+    case PANGO_ATTR_FONT_SCALE:
+      if (!binary_check_enum (a->value[0], font_scale_names))
+        return NULL;
+      break;
+    default:
+      break;
+    }
+
+  switch (a->type)
+    {
+    default:
+      return NULL;
+
+    case PANGO_ATTR_LANGUAGE:
+      attr = pango_attr_language_new (pango_language_from_string (str));
+      break;
+
+    case PANGO_ATTR_FAMILY:
+      attr = pango_attr_family_new (str);
+      break;
+
+    case PANGO_ATTR_FONT_FEATURES:
+      attr = pango_attr_font_features_new (str);
+      break;
+
+    case PANGO_ATTR_FONT_DESC:
+      desc = pango_font_description_from_string (str);
+      attr = pango_attr_font_desc_new (desc);
+      pango_font_description_free (desc);
+      break;
+
+    case PANGO_ATTR_STYLE:
+      attr = pango_attr_style_new ((PangoStyle) value);
+      break;
+
+    case PANGO_ATTR_WEIGHT:
+      attr = pango_attr_weight_new ((PangoWeight) value);
+      break;
+
+    case PANGO_ATTR_VARIANT:
+      attr = pango_attr_variant_new ((PangoVariant) value);
+      break;
+
+    case PANGO_ATTR_STRETCH:
+      attr = pango_attr_stretch_new ((PangoStretch) value);
+      break;
+
+    case PANGO_ATTR_SIZE:
+      attr = pango_attr_size_new (value);
+      break;
+
+    case PANGO_ATTR_FOREGROUND:
+      attr = pango_attr_foreground_new (red, green, blue);
+      break;
+
+    case PANGO_ATTR_BACKGROUND:
+      attr = pango_attr_background_new (red, green, blue);
+      break;
+
+    case PANGO_ATTR_UNDERLINE:
+      attr = pango_attr_underline_new ((PangoUnderline) value);
+      break;
+
+    case PANGO_ATTR_STRIKETHROUGH:
+      attr = pango_attr_strikethrough_new (value != 0);
+      break;
+
+    case PANGO_ATTR_RISE:
+      attr = pango_attr_rise_new (value);
+      break;
+
+    case PANGO_ATTR_SCALE:
+      attr = pango_attr_scale_new (binary_get_double (a->value));
+      break;
+
+    case PANGO_ATTR_FALLBACK:
+      attr = pango_attr_fallback_new (value != 0);
+      break;
+
+    case PANGO_ATTR_LETTER_SPACING:
+      attr = pango_attr_letter_spacing_new (value);
+      break;
+
+    case PANGO_ATTR_UNDERLINE_COLOR:
+      attr = pango_attr_underline_color_new (red, green, blue);
+      break;
+
+    case PANGO_ATTR_STRIKETHROUGH_COLOR:
+      attr = pango_attr_strikethrough_color_new (red, green, blue);
+      break;
+
+    case PANGO_ATTR_ABSOLUTE_SIZE:
+      attr = pango_attr_size_new_absolute (value);
+      break;
+
+    case PANGO_ATTR_GRAVITY:
+      attr = pango_attr_gravity_new ((PangoGravity) value);
+      break;
+
+    case PANGO_ATTR_GRAVITY_HINT:
+      attr = pango_attr_gravity_hint_new ((PangoGravityHint) value);
+      break;
+
+    case PANGO_ATTR_FOREGROUND_ALPHA:
+      attr = pango_attr_foreground_alpha_new (value);
+      break;
+
+    case PANGO_ATTR_BACKGROUND_ALPHA:
+      attr = pango_attr_background_alpha_new (value);
+      break;
+
+    case PANGO_ATTR_ALLOW_BREAKS:
+      attr = pango_attr_allow_breaks_new (value != 0);
+      break;
+
+    case PANGO_ATTR_SHOW:
+      attr = pango_attr_show_new ((PangoShowFlags) value);
+      break;
+
+    case PANGO_ATTR_INSERT_HYPHENS:
+      attr = pango_attr_insert_hyphens_new (value != 0);
+      break;
+
+    case PANGO_ATTR_OVERLINE:
+      attr = pango_attr_overline_new ((PangoOverline) value);
+      break;
+
+    case PANGO_ATTR_OVERLINE_COLOR:
+      attr = pango_attr_overline_color_new (red, green, blue);
+      break;
+
+    case PANGO_ATTR_LINE_HEIGHT:
+      attr = pango_attr_line_height_new (binary_get_double (a->value));
+      break;
+
+    case PANGO_ATTR_ABSOLUTE_LINE_HEIGHT:
+      attr = pango_attr_line_height_new_absolute (value);
+      break;
+
+    case PANGO_ATTR_TEXT_TRANSFORM:
+      attr = pango_attr_text_transform_new ((PangoTextTransform) value);
+      break;
+
+    case PANGO_ATTR_WORD:
+      attr = pango_attr_word_new ();
+      break;
+
+    case PANGO_ATTR_SENTENCE:
+      attr = pango_attr_sentence_new ();
+      break;
+
+    case PANGO_ATTR_BASELINE_SHIFT:
+      attr = pango_attr_baseline_shift_new (value);
+      break;
+
+    case PANGO_ATTR_FONT_SCALE:
+      attr = pango_attr_font_scale_new ((PangoFontScale) value);
+      break;
+    }
+
+  attr->start_index = a->start;
+  attr->end_index = a->end;
+
+  return attr;
+}
+
+static gboolean
+binary_load_fonts (BinaryReader  *reader,
+                   PangoContext  *context,
+                   PangoFont    **fonts)
+{
+  const BinFont *bin_fonts;
+  guint32 n_fonts = reader->header->fonts.length;
+
+  if (!binary_get_array (reader, reader->header->fonts, sizeof (BinFont), (gconstpointer *) &bin_fonts))
+    return FALSE;
+
+  for (guint32 i = 0; i < n_fonts; i++)
+    {
+      const char *description, *checksum, *variations;
+      PangoFontDescription *desc;
+      PangoMatrix matrix;
+      PangoRectangle ink, logical;
+
+      if (!binary_get_string (reader, bin_fonts[i].description, &description) || !description ||
+          !binary_get_string (reader, bin_fonts[i].checksum, &checksum) || !checksum ||
+          !binary_get_string (reader, bin_fonts[i].variations, &variations))
+        return FALSE;
+
+      desc = pango_font_description_from_string (description);
+      fonts[i] = pango_context_load_font (context, desc);
+      pango_font_description_free (desc);
+
+      /* If the font map resolves the description to a
+       * different face, the stored glyphs are meaningless.
+       */
+      if (!fonts[i] || strcmp (get_font_checksum (fonts[i]), checksum) != 0)
+        return FALSE;
+
+      /* The same goes for a different transformation,
+       * different variations or different font options
+       */
+      binary_get_matrix (bin_fonts[i].matrix, &matrix);
+      if (!font_state_matches (fonts[i], &matrix, variations))
+        return FALSE;
+
+      pango_font_get_glyph_extents (fonts[i], bin_fonts[i].probe_glyph, &ink, &logical);
+      if (!binary_rect_equal (bin_fonts[i].probe_ink, &ink) ||
+          !binary_rect_equal (bin_fonts[i].probe_logical, &logical))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static PangoLayoutRun *
+binary_to_run (BinaryReader   *reader,
+               PangoLayout    *layout,
+               PangoFont     **fonts,
+               const BinRun   *r)
+{
+  const BinHeader *header = reader->header;
+  const BinGlyph *glyphs;
+  const char *language;
+  PangoGlyphItem *run;
+  PangoItem *item;
+
+  if (r->offset < 0 || r->length < 0 || r->offset > layout->length ||
+      r->length > layout->length - r->offset ||
+      r->num_chars != pango_utf8_strlen (layout->text + r->offset, r->length) ||
+      (r->char_offset >= 0 && (r->char_offset > layout->n_chars ||
+                               r->num_chars > layout->n_chars - r->char_offset)) ||
+      r->level > BINARY_MAX_BIDI_LEVEL ||
+      !binary_check_enum (r->gravity, gravity_names) ||
+      r->script > G_MAXUINT8 || get_script_name ((PangoScript) r->script) == NULL ||
+      (r->font != BINARY_NONE && r->font >= header->fonts.length) ||
+      !binary_check_subrange (r->extra_attrs, header->attr_table.length) ||
+      !binary_check_subrange (r->glyphs, header->glyphs.length) ||
+      !binary_get_string (reader, r->language, &language))
+    return NULL;
+
+  glyphs = reader->glyphs + r->glyphs.offset;
+
+  item = pango_item_new ();
+  item->offset = r->offset;
+  item->length = r->length;
+  item->num_chars = r->num_chars;
+  if (r->char_offset >= 0)
+    ((PangoItemPrivate *)item)->char_offset = r->char_offset;
+  item->analysis.level = r->level;
+  item->analysis.gravity = r->gravity;
+  item->analysis.script = r->script;
+  item->analysis.flags |= r->flags & ~PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET;
+  item->analysis.language = language ? pango_language_from_string (language) : NULL;
+  if (r->font != BINARY_NONE)
+    item->analysis.font = g_object_ref (fonts[r->font]);
+
+  for (guint32 i = r->extra_attrs.length; i > 0; i--)
+    {
+      PangoAttribute *attr = binary_to_attribute (reader, &reader->attrs[r->extra_attrs.offset + i - 1]);
+      if (attr)
+        item->analysis.extra_attrs = g_slist_prepend (item->analysis.extra_attrs, attr);
+    }
+
+  run = g_slice_new (PangoGlyphItem);
+  run->item = item;
+  run->glyphs = pango_glyph_string_new ();
+  run->y_offset = r->y_offset;
+  run->start_x_offset = r->start_x_offset;
+  run->end_x_offset = r->end_x_offset;
+
+  pango_glyph_string_set_size (run->glyphs, r->glyphs.length);
+
+  for (guint32 i = 0; i < r->glyphs.length; i++)
+    {
+      PangoGlyphInfo *info = &run->glyphs->glyphs[i];
+
+      if (glyphs[i].log_cluster < 0 || glyphs[i].log_cluster >= MAX (r->length, 1))
+        {
+          pango_glyph_item_free (run);
+          return NULL;
+        }
+
+      info->glyph = glyphs[i].glyph;
+      info->geometry.width = glyphs[i].width;
+      info->geometry.x_offset = glyphs[i].x_offset;
+      info->geometry.y_offset = glyphs[i].y_offset;
+      info->attr.is_cluster_start = (glyphs[i].flags & BINARY_CLUSTER_START) != 0;
+      info->attr.is_color = (glyphs[i].flags & BINARY_IS_COLOR) != 0;
+      run->glyphs->log_clusters[i] = glyphs[i].log_cluster;
+    }
+
+  return run;
+}
+
+/* Recreates the lines of @layout from the stored output.
+ * Returns %FALSE if the output can't be used, in which case
+ * the layout is left to compute its lines as usual.
+ */
+static gboolean
+binary_restore_output (BinaryReader *reader,
+                       PangoLayout  *layout)
+{
+  const BinHeader *header = reader->header;
+  const PangoLogAttr *stored_log_attrs;
+  const BinLine *lines;
+  const BinRun *runs;
+  PangoFont **fonts;
+  GSList *line_list = NULL;
+  gboolean result = FALSE;
+
+  if (header->log_attrs.length != layout->n_chars + 1 ||
+      header->fonts.length > reader->size / sizeof (BinFont) ||
+      !binary_get_array (reader, header->log_attrs, sizeof (PangoLogAttr), (gconstpointer *) &stored_log_attrs) ||
+      !binary_get_array (reader, header->lines, sizeof (BinLine), (gconstpointer *) &lines) ||
+      !binary_get_array (reader, header->runs, sizeof (BinRun), (gconstpointer *) &runs) ||
+      !binary_get_array (reader, header->glyphs, sizeof (BinGlyph), (gconstpointer *) &reader->glyphs))
+    return FALSE;
+
+  fonts = g_new0 (PangoFont *, header->fonts.length + 1);
+
+  if (!binary_load_fonts (reader, layout->context, fonts))
+    goto out;
+
+  for (guint32 i = 0; i < header->lines.length; i++)
+    {
+      const BinLine *bl = &lines[i];
+      PangoLayoutLine *line;
+
+      if (bl->start_index < 0 || bl->length < 0 ||
+          bl->start_index > layout->length ||
+          bl->length > layout->length - bl->start_index ||
+          !binary_check_enum (bl->resolved_dir, direction_names) ||
+          !binary_check_subrange (bl->runs, header->runs.length))
+        goto out;
+
+      line = _pango_layout_line_new (layout);
+      line->start_index = bl->start_index;
+      line->length = bl->length;
+      line->is_paragraph_start = (bl->flags & BINARY_PARAGRAPH_START) != 0;
+      line->resolved_dir = bl->resolved_dir;
+      line_list = g_slist_prepend (line_list, line);
+
+      for (guint32 j = bl->runs.length; j > 0; j--)
+        {
+          PangoLayoutRun *run = binary_to_run (reader, layout, fonts, &runs[bl->runs.offset + j - 1]);
+
+          if (!run)
+            goto out;
+
+          line->runs = g_slist_prepend (line->runs, run);
+        }
+    }
+
+  _pango_layout_set_output (layout,
+                            g_slist_reverse (line_list),
+                            g_memdup2 (stored_log_attrs, header->log_attrs.length * sizeof (PangoLogAttr)),
+                            (header->layout_flags & BINARY_IS_WRAPPED) != 0,
+                            (header->layout_flags & BINARY_IS_ELLIPSIZED) != 0);
+  line_list = NULL;
+  result = TRUE;
+
+out:
+  for (GSList *l = line_list; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      line->layout = NULL;
+      pango_layout_line_unref (line);
+    }
+  g_slist_free (line_list);
+
+  for (guint32 i = 0; i < header->fonts.length; i++)
+    g_clear_object (&fonts[i]);
+  g_free (fonts);
+
+  return result;
+}
+
+static gboolean
+binary_fill_layout (GBytes                       *bytes,
+                    PangoLayout                  *layout,
+                    PangoLayoutDeserializeFlags   flags,
+                    GError                      **error)
+{
+  BinaryReader reader;
+  const BinHeader *header;
+  const char *str;
+  const BinTab *tabs;
+
+  reader.data = g_bytes_get_data (bytes, &reader.size);
+
+  if (reader.size < sizeof (BinHeader) || GPOINTER_TO_SIZE (reader.data) % 4 != 0)
+    goto invalid;
+
+  header = reader.header = (const BinHeader *) reader.data;
+
+  if (header->version != BINARY_VERSION)
+    {
+      g_set_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID,
+                   "Unsupported binary format version %u", header->version);
+      return FALSE;
+    }
+
+  if (header->byte_order != BINARY_BYTE_ORDER || header->size != reader.size)
+    goto invalid;
+
+  if (!binary_get_array (&reader, header->attr_table, sizeof (BinAttr), (gconstpointer *) &reader.attrs) ||
+      !binary_check_subrange (header->attrs, header->attr_table.length))
+    goto invalid;
+
+  if (!binary_check_enum (header->alignment, alignment_names) ||
+      !binary_check_enum (header->wrap, wrap_names) ||
+      !binary_check_enum (header->ellipsize, ellipsize_names))
+    goto invalid;
+
+  if ((flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT) && (header->flags & BINARY_HAS_CONTEXT))
+    {
+      PangoContext *context = layout->context;
+      PangoMatrix m;
+
+      if (!binary_check_enum (header->context.base_gravity, gravity_names) ||
+          !binary_check_enum (header->context.gravity_hint, gravity_hint_names) ||
+          !binary_check_enum (header->context.base_dir, direction_names))
+        goto invalid;
+
+      if (!binary_get_string (&reader, header->context.font, &str) || !str)
+        goto invalid;
+
+      PangoFontDescription *desc = pango_font_description_from_string (str);
+      pango_context_set_font_description (context, desc);
+      pango_font_description_free (desc);
+
+      if (!binary_get_string (&reader, header->context.language, &str))
+        goto invalid;
+      if (str)
+        pango_context_set_language (context, pango_language_from_string (str));
+
+      pango_context_set_base_gravity (context, (PangoGravity) header->context.base_gravity);
+      pango_context_set_gravity_hint (context, (PangoGravityHint) header->context.gravity_hint);
+      pango_context_set_base_dir (context, (PangoDirection) header->context.base_dir);
+      pango_context_set_round_glyph_positions (context, (header->layout_flags & BINARY_ROUND_POSITIONS) != 0);
+
+      binary_get_matrix (header->context.matrix, &m);
+      pango_context_set_matrix (context, &m);
+    }
+
+  if (!binary_get_string (&reader, header->comment, &str))
+    goto invalid;
+  if (str)
+    g_object_set_data_full (G_OBJECT (layout), "comment", g_strdup (str), g_free);
+
+  if (!binary_get_string (&reader, header->text, &str) || !str)
+    goto invalid;
+  pango_layout_set_text (layout, str, header->text.length);
+
+  if (header->attrs.length > 0)
+    {
+      PangoAttrList *attributes = pango_attr_list_new ();
+
+      for (guint32 i = 0; i < header->attrs.length; i++)
+        {
+          PangoAttribute *attr = binary_to_attribute (&reader, &reader.attrs[header->attrs.offset + i]);
+          if (!attr)
+            {
+              pango_attr_list_unref (attributes);
+              goto invalid;
+            }
+          pango_attr_list_insert (attributes, attr);
+        }
+
+      pango_layout_set_attributes (layout, attributes);
+      pango_attr_list_unref (attributes);
+    }
+
+  if (!binary_get_string (&reader, header->font, &str))
+    goto invalid;
+  if (str)
+    {
+      PangoFontDescription *desc = pango_font_description_from_string (str);
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
+    }
+
+  if (header->tabs.offset != BINARY_NONE)
+    {
+      PangoTabArray *tab_array;
+
+      if (!binary_get_array (&reader, header->tabs, sizeof (BinTab), (gconstpointer *) &tabs))
+        goto invalid;
+
+      tab_array = pango_tab_array_new (header->tabs.length,
+                                       (header->layout_flags & BINARY_TABS_IN_PIXELS) != 0);
+      for (guint32 i = 0; i < header->tabs.length; i++)
+        {
+          if (!binary_check_enum (tabs[i].alignment, tab_align_names))
+            {
+              pango_tab_array_free (tab_array);
+              goto invalid;
+            }
+
+          pango_tab_array_set_tab (tab_array, i, (PangoTabAlign) tabs[i].alignment, tabs[i].position);
+          pango_tab_array_set_decimal_point (tab_array, i, (gunichar) tabs[i].decimal_point);
+        }
+      pango_layout_set_tabs (layout, tab_array);
+      pango_tab_array_free (tab_array);
+    }
+
+  pango_layout_set_justify (layout, (header->layout_flags & BINARY_JUSTIFY) != 0);
+  pango_layout_set_justify_last_line (layout, (header->layout_flags & BINARY_JUSTIFY_LAST_LINE) != 0);
+  pango_layout_set_single_paragraph_mode (layout, (header->layout_flags & BINARY_SINGLE_PARAGRAPH) != 0);
+  pango_layout_set_auto_dir (layout, (header->layout_flags & BINARY_AUTO_DIR) != 0);
+  pango_layout_set_alignment (layout, (PangoAlignment) header->alignment);
+  pango_layout_set_wrap (layout, (PangoWrapMode) header->wrap);
+  pango_layout_set_ellipsize (layout, (PangoEllipsizeMode) header->ellipsize);
+  pango_layout_set_width (layout, header->width);
+  pango_layout_set_height (layout, header->height);
+  pango_layout_set_indent (layout, header->indent);
+  pango_layout_set_spacing (layout, header->spacing);
+  pango_layout_set_line_spacing (layout, binary_get_double (header->line_spacing));
+
+  if ((flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT) && (header->flags & BINARY_HAS_OUTPUT))
+    {
+      gboolean context_matches;
+
+      /* The output is only valid for a context that positions
+       * glyphs the same way, so without the context, there is
+       * no telling whether it can be used
+       */
+      context_matches = (header->flags & BINARY_HAS_CONTEXT) != 0;
+
+      if (context_matches && !(flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT))
+        {
+          const PangoMatrix *matrix = pango_context_get_matrix (layout->context);
+          PangoMatrix identity = PANGO_MATRIX_INIT;
+          PangoMatrix m;
+
+          binary_get_matrix (header->context.matrix, &m);
+          context_matches = matrix_equal (matrix ? matrix : &identity, &m) &&
+                            layout->context->round_glyph_positions == ((header->layout_flags & BINARY_ROUND_POSITIONS) != 0);
+        }
+
+      /* The font options are set by the backend, so they
+       * can only be compared, even with the stored context
+       */
+      if (context_matches)
+        {
+          if (!binary_get_string (&reader, header->context.font_options, &str))
+            goto invalid;
+
+          context_matches = g_strcmp0 (str, layout->context->font_options) == 0;
+        }
+
+      if (context_matches)
+        binary_restore_output (&reader, layout);
+    }
+
+  return TRUE;
+
+invalid:
+  g_set_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID,
+               "Invalid binary layout data");
+  return FALSE;
+}
+
+static gboolean
+bytes_are_binary (GBytes *bytes)
+{
+  gsize size;
+  const char *data = g_bytes_get_data (bytes, &size);
+
+  return size >= sizeof (BINARY_MAGIC) &&
+         memcmp (data, BINARY_MAGIC, sizeof (BINARY_MAGIC)) == 0;
+}
+
+/* }}} */
+/* {{{ Public API */
 
 /**
  * pango_layout_serialize:
@@ -1584,6 +3854,15 @@ json_parser_load_font (GtkJsonParser  *parser,
  * The intended use of this function is testing, benchmarking and debugging.
  * The format is not meant as a permanent storage format.
  *
+ * By default, the layout is serialized as JSON. If @flags include
+ * %PANGO_LAYOUT_SERIALIZE_BINARY, a compact binary format is used
+ * instead. The binary format is versioned, can be loaded directly
+ * from a memory-mapped file, and, together with
+ * %PANGO_LAYOUT_SERIALIZE_OUTPUT, lets [func@Pango.Layout.deserialize]
+ * restore the formatted lines without shaping the text again. It is
+ * meant for caching layouts that were computed ahead of time, e.g.
+ * at build time, with the same fonts that are used at runtime.
+ *
  * Returns: a `GBytes` containing the serialized form of @layout
  *
  * Since: 1.50
@@ -1599,6 +3878,9 @@ pango_layout_serialize (PangoLayout               *layout,
 
   g_return_val_if_fail (PANGO_IS_LAYOUT (layout), NULL);
 
+  if (flags & PANGO_LAYOUT_SERIALIZE_BINARY)
+    return layout_to_binary (layout, flags);
+
   str = g_string_new ("");
 
   printer = gtk_json_printer_new (gstring_write, str, NULL);
@@ -1674,6 +3956,16 @@ pango_layout_write_to_file (PangoLayout                *layout,
  * the one that was serialized, you can compare @bytes to the
  * result of serializing the layout again.
  *
+ * Both the JSON and the binary format are accepted.
+ *
+ * If @flags includes %PANGO_LAYOUT_DESERIALIZE_OUTPUT and the data
+ * contains the formatted output and the context, the fonts it refers
+ * to are loaded from @context and compared by checksum. If all of
+ * them resolve to the same font files, and @context has the same
+ * transformation and font options, the stored lines and glyphs are
+ * used as-is, without itemizing or shaping the text again. Otherwise,
+ * the output is ignored and the layout is formatted again when needed.
+ *
  * Returns: (nullable) (transfer full): a new `PangoLayout`
  *
  * Since: 1.50
@@ -1692,6 +3984,14 @@ pango_layout_deserialize (PangoContext                 *context,
 
   layout = pango_layout_new (context);
 
+  if (bytes_are_binary (bytes))
+    {
+      if (!binary_fill_layout (bytes, layout, flags, error))
+        g_clear_object (&layout);
+
+      return layout;
+    }
+
   parser = gtk_json_parser_new_for_bytes (bytes);
   json_parser_fill_layout (parser, layout, flags);
 
@@ -77,13 +77,99 @@ release_buffer (hb_buffer_t *buffer,
 /* }}} */
 /* {{{ Use PangoFont with Harfbuzz */
 
+typedef struct _PangoHbFontCache PangoHbFontCache;
+
 typedef struct
 {
   PangoFont *font;
   hb_font_t *parent;
   PangoShowFlags show_flags;
+  PangoHbFontCache *cache;
 } PangoHbShapeContext;
 
+/* Lookups in the parent font are cached per font, in small
+ * direct-mapped caches. Each entry is packed into 32 bits, so
+ * that it can be read and written atomically, and the caches
+ * can be shared between threads without locking.
+ *
+ * Nominal glyph entries hold a valid bit, the high 13 bits of
+ * the character and a 16 bit glyph. Advance entries hold a valid
+ * bit, the high 8 bits of a 16 bit glyph and a 23 bit advance.
+ * Lookups that do not fit are not cached.
+ */
+#define CACHE_SIZE 256 /* the low 8 bits of the key are the index */
+#define CACHE_MASK (CACHE_SIZE - 1)
+#define CACHE_VALID (1u << 31)
+
+struct _PangoHbFontCache
+{
+  int nominal[CACHE_SIZE];
+  int advance[CACHE_SIZE];
+
+  gboolean has_color;
+
+  /* For shaping without show flags */
+  PangoHbShapeContext context;
+  hb_font_t *hb_font;
+};
+
+static inline gboolean
+nominal_cache_lookup (PangoHbFontCache *cache,
+                      hb_codepoint_t    unicode,
+                      hb_codepoint_t   *glyph)
+{
+  guint entry = (guint) g_atomic_int_get (&cache->nominal[unicode & CACHE_MASK]);
+
+  if ((entry & 0xffff0000) != (CACHE_VALID | ((unicode >> 8) << 16)))
+    return FALSE;
+
+  *glyph = entry & 0xffff;
+  return TRUE;
+}
+
+static inline void
+nominal_cache_insert (PangoHbFontCache *cache,
+                      hb_codepoint_t    unicode,
+                      hb_codepoint_t    glyph)
+{
+  if (unicode > 0x10ffff || glyph > 0xffff)
+    return;
+
+  g_atomic_int_set (&cache->nominal[unicode & CACHE_MASK],
+                    (int) (CACHE_VALID | ((unicode >> 8) << 16) | glyph));
+}
+
+static inline gboolean
+advance_cache_lookup (PangoHbFontCache *cache,
+                      hb_codepoint_t    glyph,
+                      hb_position_t    *advance)
+{
+  guint entry;
+
+  if (glyph > 0xffff)
+    return FALSE;
+
+  entry = (guint) g_atomic_int_get (&cache->advance[glyph & CACHE_MASK]);
+
+  if ((entry & 0xff800000) != (CACHE_VALID | ((glyph >> 8) << 23)))
+    return FALSE;
+
+  *advance = entry & 0x7fffff;
+  return TRUE;
+}
+
+static inline void
+advance_cache_insert (PangoHbFontCache *cache,
+                      hb_codepoint_t    glyph,
+                      hb_position_t     advance)
+{
+  if (glyph > 0xffff || advance < 0 || advance > 0x7fffff)
+    return;
+
+  g_atomic_int_set (&cache->advance[glyph & CACHE_MASK],
+                    (int) (CACHE_VALID | ((glyph >> 8) << 23) | advance));
+}
+
 static hb_bool_t
 pango_hb_font_get_nominal_glyph (hb_font_t      *font,
                                  void           *font_data,
@@ -134,9 +220,15 @@ pango_hb_font_get_nominal_glyph (hb_font_t      *font,
         }
     }
 
-  if (hb_font_get_nominal_glyph (context->parent, unicode, glyph))
+  if (nominal_cache_lookup (context->cache, unicode, glyph))
     return TRUE;
 
+  if (hb_font_get_nominal_glyph (context->parent, unicode, glyph))
+    {
+      nominal_cache_insert (context->cache, unicode, *glyph);
+      return TRUE;
+    }
+
   *glyph = PANGO_GET_UNKNOWN_GLYPH (unicode);
 
   /* We draw our own invalid-Unicode shape, so prevent HarfBuzz
@@ -155,8 +247,13 @@ pango_hb_font_get_glyph_h_advance (hb_font_t      *font,
 {
   PangoHbShapeContext *context = (PangoHbShapeContext *) font_data;
   PangoRectangle logical;
+  hb_position_t advance;
+
+  if (advance_cache_lookup (context->cache, glyph, &advance))
+    return advance;
 
   pango_font_get_glyph_extents (context->font, glyph, NULL, &logical);
+  advance_cache_insert (context->cache, glyph, logical.width);
 
   return logical.width;
 }
@@ -198,15 +295,11 @@ pango_hb_font_get_glyph_extents (hb_font_t          *font,
   return TRUE;
 }
 
-static hb_font_t *
-pango_font_get_hb_font_for_context (PangoFont           *font,
-                                    PangoHbShapeContext *context)
+static hb_font_funcs_t *
+pango_hb_font_funcs (void)
 {
-  hb_font_t *hb_font;
   static hb_font_funcs_t *funcs;
 
-  hb_font = pango_font_get_hb_font (font);
-
   if (G_UNLIKELY (!funcs))
     {
       funcs = hb_font_funcs_create ();
@@ -219,11 +312,81 @@ pango_font_get_hb_font_for_context (PangoFont           *font,
       hb_font_funcs_make_immutable (funcs);
     }
 
+  return funcs;
+}
+
+static void
+pango_hb_font_cache_free (gpointer data)
+{
+  PangoHbFontCache *cache = data;
+
+  hb_font_destroy (cache->hb_font);
+  g_free (cache);
+}
+
+static PangoHbFontCache *
+pango_font_get_hb_font_cache (PangoFont *font)
+{
+  static GQuark cache_quark = 0;
+  PangoHbFontCache *cache;
+  hb_face_t *face;
+
+  if (G_UNLIKELY (!cache_quark))
+    cache_quark = g_quark_from_static_string ("pango-hb-font-cache");
+
+  cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+  if (G_LIKELY (cache))
+    return cache;
+
+  cache = g_new0 (PangoHbFontCache, 1);
+
+  cache->context.font = font;
+  cache->context.parent = pango_font_get_hb_font (font);
+  cache->context.show_flags = 0;
+  cache->context.cache = cache;
+
+  face = hb_font_get_face (cache->context.parent);
+  cache->has_color = hb_ot_color_has_layers (face) ||
+                     hb_ot_color_has_png (face) ||
+                     hb_ot_color_has_svg (face);
+
+  cache->hb_font = hb_font_create_sub_font (cache->context.parent);
+  hb_font_set_funcs (cache->hb_font, pango_hb_font_funcs (), &cache->context, NULL);
+  hb_font_make_immutable (cache->hb_font);
+
+  /* Another thread may have been faster */
+  if (!g_object_replace_qdata (G_OBJECT (font), cache_quark,
+                               NULL, cache, pango_hb_font_cache_free, NULL))
+    {
+      pango_hb_font_cache_free (cache);
+      cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+    }
+
+  return cache;
+}
+
+static hb_font_t *
+pango_font_get_hb_font_for_context (PangoFont           *font,
+                                    PangoHbShapeContext *context)
+{
+  PangoHbFontCache *cache;
+  hb_font_t *hb_font;
+
+  cache = pango_font_get_hb_font_cache (font);
+
+  /* Without show flags, all shaping can use the same font */
+  if (context->show_flags == 0)
+    {
+      *context = cache->context;
+      return hb_font_reference (cache->hb_font);
+    }
+
   context->font = font;
-  context->parent = hb_font;
+  context->parent = cache->context.parent;
+  context->cache = cache;
 
-  hb_font = hb_font_create_sub_font (hb_font);
-  hb_font_set_funcs (hb_font, funcs, context, NULL);
+  hb_font = hb_font_create_sub_font (context->parent);
+  hb_font_set_funcs (hb_font, pango_hb_font_funcs (), context, NULL);
 
   return hb_font;
 }
@@ -469,7 +632,7 @@ pango_hb_shape (const char          *item_text,
       infos[i].glyph = hb_glyph->codepoint;
       glyphs->log_clusters[i] = hb_glyph->cluster - item_offset;
       infos[i].attr.is_cluster_start = glyphs->log_clusters[i] != last_cluster;
-      infos[i].attr.is_color = glyph_has_color (hb_font, hb_glyph->codepoint);
+      infos[i].attr.is_color = context.cache->has_color && glyph_has_color (hb_font, hb_glyph->codepoint);
       hb_glyph++;
       last_cluster = glyphs->log_clusters[i];
     }
@@ -551,6 +714,243 @@ fallback_shape (const char          *text,
     pango_glyph_string_reverse_range (glyphs, 0, glyphs->num_glyphs);
 }
 
+/*  }}} */
+/* {{{ Grid shaping */
+
+/* Nominal glyphs for the first characters, for grid shaping.
+ * A glyph of 0 means that the font has no glyph for the character.
+ */
+#define GRID_CACHE_SIZE 256
+
+typedef struct
+{
+  PangoGlyph glyphs[GRID_CACHE_SIZE];
+  guint8 is_color[GRID_CACHE_SIZE];
+} GridGlyphCache;
+
+static GridGlyphCache *
+get_grid_glyph_cache (PangoFont *font,
+                      hb_font_t *hb_font)
+{
+  static GQuark cache_quark = 0;
+  GridGlyphCache *cache;
+  gunichar wc;
+
+  if (G_UNLIKELY (!cache_quark))
+    cache_quark = g_quark_from_static_string ("pango-grid-glyph-cache");
+
+  cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+  if (G_LIKELY (cache))
+    return cache;
+
+  cache = g_new (GridGlyphCache, 1);
+  for (wc = 0; wc < GRID_CACHE_SIZE; wc++)
+    {
+      hb_codepoint_t glyph;
+
+      if (!hb_font_get_nominal_glyph (hb_font, wc, &glyph))
+        glyph = 0;
+
+      cache->glyphs[wc] = glyph;
+      cache->is_color[wc] = glyph != 0 && glyph_has_color (hb_font, glyph);
+    }
+
+  /* Another thread may have been faster */
+  if (!g_object_replace_qdata (G_OBJECT (font), cache_quark, NULL, cache, g_free, NULL))
+    {
+      g_free (cache);
+      cache = g_object_get_qdata (G_OBJECT (font), cache_quark);
+    }
+
+  return cache;
+}
+
+/* The number of cells that a character occupies */
+static int
+grid_char_cells (gunichar wc)
+{
+  switch ((int) g_unichar_type (wc))
+    {
+    case G_UNICODE_NON_SPACING_MARK:
+    case G_UNICODE_ENCLOSING_MARK:
+    case G_UNICODE_FORMAT:
+      return 0;
+    default:
+      return g_unichar_iswide (wc) ? 2 : 1;
+    }
+}
+
+/* Whether a character can be mapped to its nominal
+ * glyph without shaping
+ */
+static gboolean
+grid_char_is_simple (gunichar wc)
+{
+  if (wc < 0x80)
+    return wc >= 0x20 && wc != 0x7f;
+
+  /* Leave emoji and other astral characters to HarfBuzz */
+  if (wc >= 0x10000)
+    return FALSE;
+
+  switch ((int) g_unichar_type (wc))
+    {
+    case G_UNICODE_CONTROL:
+    case G_UNICODE_FORMAT:
+    case G_UNICODE_SURROGATE:
+    case G_UNICODE_NON_SPACING_MARK:
+    case G_UNICODE_SPACING_MARK:
+    case G_UNICODE_ENCLOSING_MARK:
+    case G_UNICODE_LINE_SEPARATOR:
+    case G_UNICODE_PARAGRAPH_SEPARATOR:
+      return FALSE;
+    default:
+      break;
+    }
+
+  switch ((int) g_unichar_get_script (wc))
+    {
+    case G_UNICODE_SCRIPT_COMMON:
+    case G_UNICODE_SCRIPT_LATIN:
+    case G_UNICODE_SCRIPT_GREEK:
+    case G_UNICODE_SCRIPT_CYRILLIC:
+    case G_UNICODE_SCRIPT_HAN:
+    case G_UNICODE_SCRIPT_HIRAGANA:
+    case G_UNICODE_SCRIPT_KATAKANA:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean
+grid_needs_shaping (const PangoAnalysis *analysis)
+{
+  hb_feature_t features[8];
+  guint num_features = 0;
+  GSList *l;
+
+  if ((analysis->level & 1) ||
+      PANGO_GRAVITY_IS_VERTICAL (analysis->gravity) ||
+      find_show_flags (analysis) != 0 ||
+      find_text_transform (analysis) != PANGO_TEXT_TRANSFORM_NONE)
+    return TRUE;
+
+  /* Features may turn on ligatures */
+  pango_font_get_features (analysis->font, features, G_N_ELEMENTS (features), &num_features);
+  if (num_features > 0)
+    return TRUE;
+
+  for (l = analysis->extra_attrs; l; l = l->next)
+    {
+      PangoAttribute *attr = l->data;
+
+      if (attr->klass->type == PANGO_ATTR_FONT_FEATURES)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Maps each character to its nominal glyph, with advances
+ * of whole cells. Returns FALSE if the text needs shaping.
+ */
+static gboolean
+grid_shape_nominal (const char          *text,
+                    int                  length,
+                    const PangoAnalysis *analysis,
+                    int                  cell_width,
+                    PangoGlyphString    *glyphs)
+{
+  hb_font_t *hb_font;
+  GridGlyphCache *cache;
+  const char *p;
+  int i;
+
+  if (!analysis->font || grid_needs_shaping (analysis))
+    return FALSE;
+
+  hb_font = pango_font_get_hb_font (analysis->font);
+  if (!hb_font)
+    return FALSE;
+
+  cache = get_grid_glyph_cache (analysis->font, hb_font);
+
+  pango_glyph_string_set_size (glyphs, pango_utf8_strlen (text, length));
+
+  for (p = text, i = 0; p < text + length; p = g_utf8_next_char (p), i++)
+    {
+      gunichar wc = g_utf8_get_char (p);
+      PangoGlyphInfo *info = &glyphs->glyphs[i];
+      hb_codepoint_t glyph;
+
+      if (!grid_char_is_simple (wc))
+        return FALSE;
+
+      if (wc < GRID_CACHE_SIZE)
+        {
+          glyph = cache->glyphs[wc];
+          info->attr.is_color = cache->is_color[wc];
+        }
+      else if (hb_font_get_nominal_glyph (hb_font, wc, &glyph))
+        info->attr.is_color = glyph_has_color (hb_font, glyph);
+      else
+        glyph = 0;
+
+      /* Let shaping deal with missing glyphs */
+      if (glyph == 0)
+        return FALSE;
+
+      info->glyph = glyph;
+      info->geometry.width = grid_char_cells (wc) * cell_width;
+      info->geometry.x_offset = 0;
+      info->geometry.y_offset = 0;
+      info->attr.is_cluster_start = TRUE;
+      glyphs->log_clusters[i] = p - text;
+    }
+
+  return TRUE;
+}
+
+/* Adjusts the advances of shaped text so that each
+ * cluster spans as many cells as its characters
+ */
+static void
+grid_snap_clusters (const char          *text,
+                    int                  length,
+                    const PangoAnalysis *analysis,
+                    int                  cell_width,
+                    PangoGlyphString    *glyphs)
+{
+  gboolean rtl = analysis->level & 1;
+  int i, j;
+
+  for (i = 0; i < glyphs->num_glyphs; i = j)
+    {
+      int start = glyphs->log_clusters[i];
+      int end;
+      int width;
+      int cells;
+      const char *p;
+
+      width = glyphs->glyphs[i].geometry.width;
+      for (j = i + 1; j < glyphs->num_glyphs && glyphs->log_clusters[j] == start; j++)
+        width += glyphs->glyphs[j].geometry.width;
+
+      /* Clusters are in visual order */
+      if (rtl)
+        end = i > 0 ? glyphs->log_clusters[i - 1] : length;
+      else
+        end = j < glyphs->num_glyphs ? glyphs->log_clusters[j] : length;
+
+      cells = 0;
+      for (p = text + start; p < text + end; p = g_utf8_next_char (p))
+        cells += grid_char_cells (g_utf8_get_char (p));
+
+      glyphs->glyphs[j - 1].geometry.width += cells * cell_width - width;
+    }
+}
+
 /*  }}} */
 /* {{{ Shaping implementation */
 
@@ -893,6 +1293,52 @@ pango_shape_item (PangoItem        *item,
                         glyphs, flags);
 }
 
+/**
+ * pango_shape_grid:
+ * @text: valid UTF-8 text to shape
+ * @length: the length (in bytes) of @text. -1 means nul-terminated text.
+ * @analysis: `PangoAnalysis` structure from [func@Pango.itemize]
+ * @cell_width: the width of a cell, in Pango units
+ * @glyphs: glyph string in which to store results
+ *
+ * Convert the characters in @text into glyphs that are
+ * placed in cells of a fixed width.
+ *
+ * This is meant for terminals and other text that is laid out
+ * on a grid, using a monospace font. Each character occupies one
+ * cell, or two for wide characters, and combining marks occupy
+ * none. If a cluster contains several characters, its advance
+ * is the sum of their cells.
+ *
+ * Text that does not need shaping, such as plain Latin text, is
+ * converted by looking up the nominal glyph of each character,
+ * which is much faster than full shaping. Default ligatures
+ * of the font are not applied to such text; set font features
+ * to have the text shaped.
+ *
+ * Since: 1.52
+ */
+void
+pango_shape_grid (const char          *text,
+                  int                  length,
+                  const PangoAnalysis *analysis,
+                  int                  cell_width,
+                  PangoGlyphString    *glyphs)
+{
+  g_return_if_fail (text != NULL || length == 0);
+  g_return_if_fail (analysis != NULL);
+  g_return_if_fail (cell_width > 0);
+
+  if (length == -1)
+    length = strlen (text);
+
+  if (grid_shape_nominal (text, length, analysis, cell_width, glyphs))
+    return;
+
+  pango_shape_with_flags (text, length, text, length, analysis, glyphs, PANGO_SHAPE_NONE);
+  grid_snap_clusters (text, length, analysis, cell_width, glyphs);
+}
+
 /* }}} */
 
 /* vim:set foldmethod=marker expandtab: */
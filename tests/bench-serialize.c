@@ -0,0 +1,219 @@
+/* Pango
+ * bench-serialize.c: Benchmark layout serialization
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Serializes and deserializes the layouts in tests/layouts
+ * repeatedly and reports the throughput of the JSON printer
+ * and parser. Run it with `meson test --benchmark`.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "config.h"
+#include <pango/pangocairo.h>
+#include <pango/pangocairo-fc.h>
+#include <pango/pangofc-fontmap.h>
+
+static int opt_iterations = 20;
+static char *opt_fonts = NULL;
+static char *opt_layouts = NULL;
+
+static void
+install_fonts (const char *dir)
+{
+  FcConfig *config;
+  PangoFontMap *map;
+  char *path;
+  gsize len;
+  char *conf;
+
+  map = g_object_new (PANGO_TYPE_CAIRO_FC_FONT_MAP, NULL);
+
+  config = FcConfigCreate ();
+
+  path = g_build_filename (dir, "fonts.conf", NULL);
+  g_file_get_contents (path, &conf, &len, NULL);
+
+  if (!FcConfigParseAndLoadFromMemory (config, (const FcChar8 *) conf, TRUE))
+    g_error ("Failed to parse fontconfig configuration");
+
+  g_free (conf);
+  g_free (path);
+
+  FcConfigAppFontAddDir (config, (const FcChar8 *) dir);
+  pango_fc_font_map_set_config (PANGO_FC_FONT_MAP (map), config);
+  FcConfigDestroy (config);
+
+  pango_cairo_font_map_set_default (PANGO_CAIRO_FONT_MAP (map));
+
+  g_object_unref (map);
+}
+
+static GPtrArray *
+load_layouts (PangoContext *context,
+              const char   *path)
+{
+  GPtrArray *layouts;
+  GDir *dir;
+  const char *name;
+  GError *error = NULL;
+
+  layouts = g_ptr_array_new_with_free_func (g_object_unref);
+
+  dir = g_dir_open (path, 0, &error);
+  if (!dir)
+    g_error ("%s", error->message);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      char *filename;
+      char *contents;
+      gsize length;
+      GBytes *bytes;
+      PangoLayout *layout;
+
+      if (!g_str_has_suffix (name, ".layout"))
+        continue;
+
+      filename = g_build_filename (path, name, NULL);
+      if (!g_file_get_contents (filename, &contents, &length, &error))
+        g_error ("%s", error->message);
+
+      bytes = g_bytes_new_take (contents, length);
+      layout = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+      if (!layout)
+        g_error ("%s: %s", filename, error->message);
+
+      /* Format it now, so we only measure serialization */
+      pango_layout_get_line_count (layout);
+
+      g_ptr_array_add (layouts, layout);
+
+      g_bytes_unref (bytes);
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+
+  return layouts;
+}
+
+static void
+report (const char *what,
+        gint64      usec,
+        gsize       bytes)
+{
+  g_print ("%-12s %8.2f ms %10.2f MB/s\n",
+           what,
+           usec / 1000.,
+           usec > 0 ? (bytes / (1024. * 1024.)) / (usec / (double) G_USEC_PER_SEC) : 0.);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *option_context;
+  GOptionEntry entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations, "Number of iterations", "N" },
+    { "fonts", 0, 0, G_OPTION_ARG_FILENAME, &opt_fonts, "Fonts to use", "DIR" },
+    { "layouts", 0, 0, G_OPTION_ARG_FILENAME, &opt_layouts, "Layouts to use", "DIR" },
+    { NULL, 0 },
+  };
+  GError *error = NULL;
+  const char *srcdir;
+  PangoContext *context;
+  GPtrArray *layouts;
+  GPtrArray *serialized;
+  gint64 start, serialize_time, deserialize_time;
+  gsize total;
+
+  setlocale (LC_ALL, "");
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    g_error ("failed to parse options: %s", error->message);
+  g_option_context_free (option_context);
+
+  srcdir = g_getenv ("G_TEST_SRCDIR");
+  if (!srcdir)
+    srcdir = ".";
+
+  if (!opt_fonts)
+    opt_fonts = g_build_filename (srcdir, "fonts", NULL);
+  if (!opt_layouts)
+    opt_layouts = g_build_filename (srcdir, "layouts", NULL);
+
+  install_fonts (opt_fonts);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layouts = load_layouts (context, opt_layouts);
+  serialized = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+
+  total = 0;
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < opt_iterations; i++)
+    {
+      for (int j = 0; j < layouts->len; j++)
+        {
+          GBytes *bytes;
+
+          bytes = pango_layout_serialize (g_ptr_array_index (layouts, j),
+                                          PANGO_LAYOUT_SERIALIZE_CONTEXT |
+                                          PANGO_LAYOUT_SERIALIZE_OUTPUT);
+          total += g_bytes_get_size (bytes);
+
+          if (i == 0)
+            g_ptr_array_add (serialized, bytes);
+          else
+            g_bytes_unref (bytes);
+        }
+    }
+  serialize_time = g_get_monotonic_time () - start;
+
+  g_print ("%u layouts, %d iterations\n", layouts->len, opt_iterations);
+  report ("serialize", serialize_time, total);
+
+  total = 0;
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < opt_iterations; i++)
+    {
+      for (int j = 0; j < serialized->len; j++)
+        {
+          GBytes *bytes = g_ptr_array_index (serialized, j);
+          PangoLayout *layout;
+
+          layout = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+          g_assert_no_error (error);
+          total += g_bytes_get_size (bytes);
+          g_object_unref (layout);
+        }
+    }
+  deserialize_time = g_get_monotonic_time () - start;
+
+  report ("deserialize", deserialize_time, total);
+
+  g_ptr_array_unref (serialized);
+  g_ptr_array_unref (layouts);
+  g_object_unref (context);
+  g_free (opt_fonts);
+  g_free (opt_layouts);
+
+  return 0;
+}
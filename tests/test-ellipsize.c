@@ -106,6 +106,279 @@ test_ellipsize_fully (void)
   g_object_unref (layout);
 }
 
+/* Check that a long line is ellipsized to exactly the
+ * requested width, in all ellipsization modes.
+ */
+static void
+test_ellipsize_long (void)
+{
+  PangoLayout *layout;
+  PangoRectangle ellipsis, logical;
+  GString *text;
+
+  layout = pango_layout_new (context);
+
+  pango_layout_set_text (layout, "…", -1);
+  pango_layout_get_extents (layout, NULL, &ellipsis);
+
+  text = g_string_new ("");
+  for (int i = 0; i < 200; i++)
+    g_string_append_printf (text, "/directory-%d", i);
+  pango_layout_set_text (layout, text->str, text->len);
+  g_string_free (text, TRUE);
+
+  for (PangoEllipsizeMode mode = PANGO_ELLIPSIZE_START; mode <= PANGO_ELLIPSIZE_END; mode++)
+    {
+      pango_layout_set_ellipsize (layout, mode);
+
+      for (int width = 50; width < 1000; width += 37)
+        {
+          pango_layout_set_width (layout, width * PANGO_SCALE);
+
+          g_assert_cmpint (pango_layout_get_line_count (layout), ==, 1);
+          g_assert_true (pango_layout_is_ellipsized (layout));
+
+          pango_layout_get_extents (layout, NULL, &logical);
+          if (width * PANGO_SCALE >= ellipsis.width)
+            g_assert_cmpint (logical.width, ==, width * PANGO_SCALE);
+        }
+    }
+
+  g_object_unref (layout);
+}
+
+typedef struct {
+  int start_index;
+  int end_index;
+  int start_char;
+  int end_char;
+  int width;
+  int x;
+} Cluster;
+
+static gboolean
+cluster_starts_boundary (Cluster            *clusters,
+                         int                 i,
+                         const PangoLogAttr *log_attrs)
+{
+  return i == 0 || log_attrs[clusters[i].start_char].is_cursor_position;
+}
+
+static gboolean
+cluster_ends_boundary (Cluster            *clusters,
+                       int                 n_clusters,
+                       int                 i,
+                       const PangoLogAttr *log_attrs)
+{
+  return i == n_clusters - 1 || log_attrs[clusters[i].end_char + 1].is_cursor_position;
+}
+
+/* Finds the gap the way ellipsization did before it searched
+ * the gaps: grow it from the center one span at a time, until
+ * the line fits. Returns %FALSE if the line fits as it is.
+ */
+static gboolean
+reference_gap (PangoLayout        *layout,
+               PangoEllipsizeMode  mode,
+               int                 goal_width,
+               int                 ellipsis_width,
+               int                *gap_start_index,
+               int                *gap_end_index)
+{
+  PangoLayoutLine *line;
+  const PangoLogAttr *log_attrs;
+  GArray *array;
+  Cluster *clusters;
+  int n_clusters;
+  int total_width, gap_center;
+  int start, end, start_x, end_x;
+  int n_attrs, n_chars, x;
+  int c;
+
+  line = pango_layout_get_line_readonly (layout, 0);
+  log_attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+
+  array = g_array_new (FALSE, FALSE, sizeof (Cluster));
+  x = 0;
+  n_chars = 0;
+  for (GSList *l = line->runs; l; l = l->next)
+    {
+      PangoGlyphItemIter iter;
+      gboolean have_cluster;
+
+      for (have_cluster = pango_glyph_item_iter_init_start (&iter, l->data, pango_layout_get_text (layout));
+           have_cluster;
+           have_cluster = pango_glyph_item_iter_next_cluster (&iter))
+        {
+          Cluster cluster;
+
+          cluster.start_index = iter.start_index;
+          cluster.end_index = iter.end_index;
+          cluster.start_char = n_chars + iter.start_char;
+          cluster.end_char = n_chars + iter.end_char;
+          cluster.width = 0;
+          for (int i = iter.start_glyph; i < iter.end_glyph; i++)
+            cluster.width += iter.glyph_item->glyphs->glyphs[i].geometry.width;
+          cluster.x = x;
+
+          x += cluster.width;
+          g_array_append_val (array, cluster);
+        }
+
+      n_chars += ((PangoGlyphItem *) l->data)->item->num_chars;
+    }
+
+  g_assert_cmpint (n_attrs, ==, n_chars + 1);
+
+  clusters = (Cluster *) array->data;
+  n_clusters = array->len;
+  total_width = x;
+
+  if (total_width <= goal_width)
+    {
+      g_array_unref (array);
+      return FALSE;
+    }
+
+  switch (mode)
+    {
+    case PANGO_ELLIPSIZE_START:
+      gap_center = 0;
+      break;
+    case PANGO_ELLIPSIZE_MIDDLE:
+      gap_center = total_width / 2;
+      break;
+    case PANGO_ELLIPSIZE_END:
+    case PANGO_ELLIPSIZE_NONE:
+    default:
+      gap_center = total_width;
+      break;
+    }
+
+  for (c = 0; c < n_clusters - 1; c++)
+    if (clusters[c].x + clusters[c].width > gap_center)
+      break;
+
+  start = end = c;
+  while (!cluster_starts_boundary (clusters, start, log_attrs))
+    start--;
+  while (!cluster_ends_boundary (clusters, n_clusters, end, log_attrs))
+    end++;
+
+  start_x = clusters[start].x;
+  end_x = clusters[end].x + clusters[end].width;
+
+  while (total_width - (end_x - start_x) + ellipsis_width > goal_width)
+    {
+      int new_start = start, new_end = end;
+      int new_start_x = start_x, new_end_x = end_x;
+      int width;
+
+      do
+        {
+          if (new_start == 0)
+            break;
+          new_start--;
+          width = clusters[new_start].width;
+          new_start_x -= width;
+        }
+      while (!cluster_starts_boundary (clusters, new_start, log_attrs) || width == 0);
+
+      do
+        {
+          if (new_end == n_clusters - 1)
+            break;
+          new_end++;
+          width = clusters[new_end].width;
+          new_end_x += width;
+        }
+      while (!cluster_ends_boundary (clusters, n_clusters, new_end, log_attrs) || width == 0);
+
+      if (end_x == new_end_x && start_x == new_start_x)
+        break;
+
+      if (end_x == new_end_x ||
+          (start_x != new_start_x && gap_center - new_start_x < new_end_x - gap_center))
+        {
+          start = new_start;
+          start_x = new_start_x;
+        }
+      else
+        {
+          end = new_end;
+          end_x = new_end_x;
+        }
+    }
+
+  *gap_start_index = clusters[start].start_index;
+  *gap_end_index = clusters[end].end_index;
+
+  g_array_unref (array);
+
+  return TRUE;
+}
+
+/* Check that searching for the gap picks the same gap
+ * as growing it one span at a time, in all modes.
+ */
+static void
+test_ellipsize_gap (void)
+{
+  PangoLayout *layout, *ref_layout;
+  PangoRectangle ellipsis, logical;
+  GString *text;
+
+  layout = pango_layout_new (context);
+
+  pango_layout_set_text (layout, "…", -1);
+  pango_layout_get_extents (layout, NULL, &ellipsis);
+
+  text = g_string_new ("");
+  for (int i = 0; i < 40; i++)
+    g_string_append_printf (text, "%s cafe\xcc\x81 %d, ", i % 3 ? "fluffy" : "word", i * 17);
+  pango_layout_set_text (layout, text->str, text->len);
+
+  ref_layout = pango_layout_new (context);
+  pango_layout_set_text (ref_layout, text->str, text->len);
+  g_string_free (text, TRUE);
+
+  pango_layout_get_extents (ref_layout, NULL, &logical);
+
+  for (PangoEllipsizeMode mode = PANGO_ELLIPSIZE_START; mode <= PANGO_ELLIPSIZE_END; mode++)
+    {
+      pango_layout_set_ellipsize (layout, mode);
+
+      for (int width = 0; width < logical.width + 20 * PANGO_SCALE; width += 13 * PANGO_SCALE)
+        {
+          PangoLayoutRun *ellipsis_run = NULL;
+          int gap_start, gap_end;
+          gboolean expected;
+
+          pango_layout_set_width (layout, width);
+
+          expected = reference_gap (ref_layout, mode, width, ellipsis.width, &gap_start, &gap_end);
+          g_assert_cmpint (pango_layout_is_ellipsized (layout), ==, expected);
+          if (!expected)
+            continue;
+
+          for (GSList *l = pango_layout_get_line_readonly (layout, 0)->runs; l; l = l->next)
+            {
+              PangoLayoutRun *run = l->data;
+
+              if (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_IS_ELLIPSIS)
+                ellipsis_run = run;
+            }
+
+          g_assert_nonnull (ellipsis_run);
+          g_assert_cmpint (ellipsis_run->item->offset, ==, gap_start);
+          g_assert_cmpint (ellipsis_run->item->offset + ellipsis_run->item->length, ==, gap_end);
+        }
+    }
+
+  g_object_unref (ref_layout);
+  g_object_unref (layout);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -119,6 +392,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/ellipsize/height", test_ellipsize_height);
   g_test_add_func ("/layout/ellipsize/crash", test_ellipsize_crash);
   g_test_add_func ("/layout/ellipsize/fully", test_ellipsize_fully);
+  g_test_add_func ("/layout/ellipsize/long", test_ellipsize_long);
+  g_test_add_func ("/layout/ellipsize/gap", test_ellipsize_gap);
 
   return g_test_run ();
 }
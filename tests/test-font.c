@@ -557,6 +557,249 @@ test_match (void)
   pango_font_description_free (desc2);
 }
 
+static void
+test_metrics_cache (void)
+{
+  PangoFontDescription *desc;
+  PangoFontMetrics *metrics, *metrics2;
+  PangoLayout *layout;
+  PangoRectangle ext;
+  int size;
+
+  desc = pango_font_description_from_string ("Cantarell 11");
+
+  metrics = pango_context_get_metrics (context, desc, NULL);
+  g_assert_cmpint (pango_font_metrics_get_approximate_char_width (metrics), >, 0);
+  g_assert_cmpint (pango_font_metrics_get_approximate_digit_width (metrics), >, 0);
+
+  /* A digit in a layout is as wide as the approximate digit width */
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_text (layout, "0", -1);
+  pango_layout_get_extents (layout, NULL, &ext);
+  g_assert_cmpint (ext.width, <=, pango_font_metrics_get_approximate_digit_width (metrics));
+  g_object_unref (layout);
+
+  /* Equal descriptions share the cached metrics */
+  pango_font_description_set_size (desc, 12 * PANGO_SCALE);
+  pango_font_description_set_size (desc, 11 * PANGO_SCALE);
+  metrics2 = pango_context_get_metrics (context, desc, NULL);
+  g_assert_true (metrics2 == metrics);
+  pango_font_metrics_unref (metrics2);
+
+  /* Metrics for other sizes push it out of the cache eventually */
+  for (size = 12; size < 40; size++)
+    {
+      pango_font_description_set_size (desc, size * PANGO_SCALE);
+      metrics2 = pango_context_get_metrics (context, desc, NULL);
+      g_assert_cmpint (pango_font_metrics_get_height (metrics2), >=, pango_font_metrics_get_height (metrics));
+      pango_font_metrics_unref (metrics2);
+    }
+
+  pango_font_description_set_size (desc, 11 * PANGO_SCALE);
+  metrics2 = pango_context_get_metrics (context, desc, NULL);
+  g_assert_true (metrics2 != metrics);
+  g_assert_cmpint (pango_font_metrics_get_approximate_char_width (metrics2), ==,
+                   pango_font_metrics_get_approximate_char_width (metrics));
+  g_assert_cmpint (pango_font_metrics_get_approximate_digit_width (metrics2), ==,
+                   pango_font_metrics_get_approximate_digit_width (metrics));
+  pango_font_metrics_unref (metrics2);
+
+  pango_font_metrics_unref (metrics);
+  pango_font_description_free (desc);
+}
+
+static void
+test_glyph_extents_cache (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  PangoRectangle *ink, *logical;
+  PangoRectangle ink2, logical2;
+  guint size, hits, misses, evictions;
+  int n_glyphs = 1000;
+
+  fontmap = pango_cairo_font_map_get_default ();
+  context = pango_font_map_create_context (fontmap);
+
+  /* Use an odd size, to get a font nobody else has used */
+  desc = pango_font_description_from_string ("Cantarell 13.25");
+  font = pango_font_map_load_font (fontmap, context, desc);
+
+  ink = g_new (PangoRectangle, n_glyphs);
+  logical = g_new (PangoRectangle, n_glyphs);
+
+  for (int i = 0; i < n_glyphs; i++)
+    pango_font_get_glyph_extents (font, i + 1, &ink[i], &logical[i]);
+
+  pango_cairo_font_get_glyph_extents_cache_stats (PANGO_CAIRO_FONT (font),
+                                                  &size, &hits, &misses, &evictions);
+  g_assert_cmpuint (misses, ==, n_glyphs);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (size, ==, n_glyphs);
+  g_assert_cmpuint (evictions, ==, 0);
+
+  for (int i = 0; i < n_glyphs; i++)
+    {
+      pango_font_get_glyph_extents (font, i + 1, &ink2, &logical2);
+      g_assert_true (memcmp (&ink[i], &ink2, sizeof (PangoRectangle)) == 0);
+      g_assert_true (memcmp (&logical[i], &logical2, sizeof (PangoRectangle)) == 0);
+    }
+
+  /* The whole working set fits now */
+  pango_cairo_font_get_glyph_extents_cache_stats (PANGO_CAIRO_FONT (font),
+                                                  NULL, &hits, &misses, NULL);
+  g_assert_cmpuint (misses, ==, n_glyphs);
+  g_assert_cmpuint (hits, ==, n_glyphs);
+
+  /* Past the limit, whole pages of glyphs are evicted */
+  for (int i = 0; i < 10000; i++)
+    pango_font_get_glyph_extents (font, i + 1, &ink2, &logical2);
+
+  pango_cairo_font_get_glyph_extents_cache_stats (PANGO_CAIRO_FONT (font),
+                                                  &size, &hits, &misses, &evictions);
+  g_assert_cmpuint (size, <=, 8192);
+  g_assert_cmpuint (evictions, >=, 256);
+  g_assert_cmpuint (size + evictions, ==, misses);
+
+  g_free (ink);
+  g_free (logical);
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
+/* Computes the extents of a glyph string range
+ * one glyph at a time, to compare against
+ */
+static void
+reference_extents_range (PangoGlyphString *glyphs,
+                         int               start,
+                         int               end,
+                         PangoFont        *font,
+                         PangoRectangle   *ink_rect,
+                         PangoRectangle   *logical_rect)
+{
+  int x_pos = 0;
+
+  *ink_rect = (PangoRectangle) { 0, 0, 0, 0 };
+  *logical_rect = (PangoRectangle) { 0, 0, 0, 0 };
+
+  for (int i = start; i < end; i++)
+    {
+      PangoGlyphGeometry *geometry = &glyphs->glyphs[i].geometry;
+      PangoRectangle ink, logical;
+      int x, y;
+
+      pango_font_get_glyph_extents (font, glyphs->glyphs[i].glyph, &ink, &logical);
+
+      ink.x += x_pos + geometry->x_offset;
+      ink.y += geometry->y_offset;
+
+      if (ink.width != 0 && ink.height != 0)
+        {
+          if (ink_rect->width == 0 || ink_rect->height == 0)
+            *ink_rect = ink;
+          else
+            {
+              x = MIN (ink_rect->x, ink.x);
+              y = MIN (ink_rect->y, ink.y);
+              ink_rect->width = MAX (ink_rect->x + ink_rect->width, ink.x + ink.width) - x;
+              ink_rect->height = MAX (ink_rect->y + ink_rect->height, ink.y + ink.height) - y;
+              ink_rect->x = x;
+              ink_rect->y = y;
+            }
+        }
+
+      logical_rect->width += geometry->width;
+      if (i == start)
+        {
+          logical_rect->y = logical.y;
+          logical_rect->height = logical.height;
+        }
+      else
+        {
+          y = MIN (logical_rect->y, logical.y);
+          logical_rect->height = MAX (logical_rect->y + logical_rect->height, logical.y + logical.height) - y;
+          logical_rect->y = y;
+        }
+
+      x_pos += geometry->width;
+    }
+}
+
+static void
+assert_extents_range (PangoGlyphString *glyphs,
+                      int               start,
+                      int               end,
+                      PangoFont        *font)
+{
+  PangoRectangle ink, logical;
+  PangoRectangle ref_ink, ref_logical;
+
+  pango_glyph_string_extents_range (glyphs, start, end, font, &ink, &logical);
+  reference_extents_range (glyphs, start, end, font, &ref_ink, &ref_logical);
+
+  g_assert_cmpint (ink.x, ==, ref_ink.x);
+  g_assert_cmpint (ink.y, ==, ref_ink.y);
+  g_assert_cmpint (ink.width, ==, ref_ink.width);
+  g_assert_cmpint (ink.height, ==, ref_ink.height);
+  g_assert_cmpint (logical.x, ==, ref_logical.x);
+  g_assert_cmpint (logical.y, ==, ref_logical.y);
+  g_assert_cmpint (logical.width, ==, ref_logical.width);
+  g_assert_cmpint (logical.height, ==, ref_logical.height);
+}
+
+/* Test that getting glyph extents in bulk gives
+ * the same results as getting them one by one
+ */
+static void
+test_extents_range (void)
+{
+  GString *str;
+  GList *items;
+  PangoItem *item;
+  PangoGlyphString *glyphs;
+  PangoContext *context;
+  PangoFontDescription *desc;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Cantarell 11");
+  pango_context_set_font_description (context, desc);
+  pango_font_description_free (desc);
+
+  /* Long enough to span several chunks, with spaces
+   * for glyphs without ink
+   */
+  str = g_string_new ("");
+  for (int i = 0; i < 40; i++)
+    g_string_append (str, "Composer, jig ");
+
+  items = pango_itemize (context, str->str, 0, str->len, NULL, NULL);
+  g_assert_true (items->next == NULL);
+  item = items->data;
+  glyphs = pango_glyph_string_new ();
+  pango_shape (str->str, str->len, &item->analysis, glyphs);
+
+  /* Make sure we have some empty and unknown glyphs too */
+  glyphs->glyphs[3].glyph = PANGO_GLYPH_EMPTY;
+  glyphs->glyphs[100].glyph = PANGO_GET_UNKNOWN_GLYPH (0x2345);
+
+  assert_extents_range (glyphs, 0, glyphs->num_glyphs, item->analysis.font);
+  assert_extents_range (glyphs, 0, 0, item->analysis.font);
+  assert_extents_range (glyphs, 7, 8, item->analysis.font);
+  assert_extents_range (glyphs, 8, 9, item->analysis.font);
+  assert_extents_range (glyphs, 50, 200, item->analysis.font);
+  assert_extents_range (glyphs, 0, glyphs->num_glyphs, NULL);
+
+  pango_glyph_string_free (glyphs);
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+  g_string_free (str, TRUE);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -582,6 +825,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/font/models", test_font_models);
   g_test_add_func ("/pango/font/glyph-extents", test_glyph_extents);
   g_test_add_func ("/pango/font/font-metrics", test_font_metrics);
+  g_test_add_func ("/pango/font/metrics-cache", test_metrics_cache);
+  g_test_add_func ("/pango/font/glyph-extents-cache", test_glyph_extents_cache);
+  g_test_add_func ("/pango/font/extents-range", test_extents_range);
 
   return g_test_run ();
 }
@@ -21,10 +21,12 @@
 
 #include "config.h"
 #include <glib.h>
+#include <string.h>
 #include <pango/pangocairo.h>
 
 #ifdef HAVE_CAIRO_FREETYPE
 #include <pango/pango-ot.h>
+#include <pango/pangoft2.h>
 #endif
 
 /* test that we don't crash in shape_tab when the layout
@@ -818,6 +820,1152 @@ test_small_caps_crash (void)
   g_object_unref (context);
 }
 
+static void
+test_markup_cache (void)
+{
+  PangoContext *context;
+  PangoLayout *layout1, *layout2, *layout3;
+  const char *markup = "<b>Hello</b> _World";
+  gunichar accel1, accel2;
+
+  pango_markup_cache_set_max_entries (2);
+  g_assert_cmpuint (pango_markup_cache_get_max_entries (), ==, 2);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout1 = pango_layout_new (context);
+  layout2 = pango_layout_new (context);
+  layout3 = pango_layout_new (context);
+
+  pango_layout_set_markup_with_accel (layout1, markup, -1, '_', &accel1);
+  pango_layout_set_markup_with_accel (layout2, markup, -1, '_', &accel2);
+
+  g_assert_cmpstr (pango_layout_get_text (layout1), ==, "Hello World");
+  g_assert_cmpstr (pango_layout_get_text (layout1), ==, pango_layout_get_text (layout2));
+  g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout1),
+                                        pango_layout_get_attributes (layout2)));
+  g_assert_true (accel1 == 'W');
+  g_assert_true (accel2 == 'W');
+
+  /* Each layout has its own copy of the attributes */
+  g_assert_false (pango_layout_get_attributes (layout1) == pango_layout_get_attributes (layout2));
+  pango_attr_list_insert (pango_layout_get_attributes (layout1), pango_attr_size_new (20 * PANGO_SCALE));
+  g_assert_false (pango_attr_list_equal (pango_layout_get_attributes (layout1),
+                                         pango_layout_get_attributes (layout2)));
+  pango_layout_set_markup_with_accel (layout1, markup, -1, '_', &accel1);
+  g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout1),
+                                        pango_layout_get_attributes (layout2)));
+
+  /* A different accel marker is a different entry */
+  pango_layout_set_markup (layout3, markup, -1);
+  g_assert_cmpstr (pango_layout_get_text (layout3), ==, "Hello _World");
+  g_assert_false (pango_attr_list_equal (pango_layout_get_attributes (layout1),
+                                         pango_layout_get_attributes (layout3)));
+
+  /* Evict the first entry */
+  pango_layout_set_markup (layout3, "<i>other</i>", -1);
+  pango_layout_set_markup (layout2, "<i>other</i>", -1);
+  g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout2),
+                                        pango_layout_get_attributes (layout3)));
+  pango_layout_set_markup_with_accel (layout3, markup, -1, '_', NULL);
+  g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout1),
+                                        pango_layout_get_attributes (layout3)));
+
+  pango_markup_cache_set_max_entries (0);
+  g_assert_cmpuint (pango_markup_cache_get_max_entries (), ==, 0);
+
+  pango_layout_set_markup (layout1, "<i>other</i>", -1);
+  g_assert_false (pango_layout_get_attributes (layout1) == pango_layout_get_attributes (layout2));
+  g_assert_cmpstr (pango_layout_get_text (layout1), ==, "other");
+
+  g_object_unref (layout1);
+  g_object_unref (layout2);
+  g_object_unref (layout3);
+  g_object_unref (context);
+}
+
+static void
+test_wrap_optimal (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  int width;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+
+  pango_layout_set_text (layout, "xxx xx", -1);
+  pango_layout_get_size (layout, &width, NULL);
+
+  /* Greedy wrapping fills the first line and leaves the
+   * second one mostly empty; optimal wrapping evens them out
+   */
+  pango_layout_set_text (layout, "xxx xx xx xxxxx", -1);
+  pango_layout_set_width (layout, width);
+
+  pango_layout_set_wrap (layout, PANGO_WRAP_WORD);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 3);
+  g_assert_cmpint (pango_layout_get_line_readonly (layout, 1)->start_index, ==, 7);
+  g_assert_cmpint (pango_layout_get_line_readonly (layout, 2)->start_index, ==, 10);
+
+  pango_layout_set_wrap (layout, PANGO_WRAP_OPTIMAL);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 3);
+  g_assert_cmpint (pango_layout_get_line_readonly (layout, 1)->start_index, ==, 4);
+  g_assert_cmpint (pango_layout_get_line_readonly (layout, 2)->start_index, ==, 10);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static int
+line_runs_width (PangoLayoutLine *line)
+{
+  int width = 0;
+
+  for (GSList *l = line->runs; l; l = l->next)
+    width += pango_glyph_string_get_width (((PangoGlyphItem *)l->data)->glyphs);
+
+  return width;
+}
+
+static void
+test_line_ref_relayout (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayoutLine *line;
+  PangoGlyphItem *run;
+  int before;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, "Some text that is long enough to need several lines", -1);
+  pango_layout_set_width (layout, 50 * PANGO_SCALE);
+
+  line = pango_layout_line_ref (pango_layout_get_line_readonly (layout, 0));
+  before = line_runs_width (line);
+
+  /* Lines that are referenced must survive relayouts */
+  for (i = 0; i < 10; i++)
+    {
+      pango_layout_set_width (layout, (50 + 10 * i) * PANGO_SCALE);
+      g_assert_cmpint (pango_layout_get_line_count (layout), >, 0);
+    }
+
+  g_assert_null (line->layout);
+  g_assert_nonnull (line->runs);
+  g_assert_cmpint (line_runs_width (line), ==, before);
+
+  /* Runs can be taken out of a line and freed on their own */
+  run = line->runs->data;
+  line->runs = g_slist_delete_link (line->runs, line->runs);
+  pango_glyph_item_free (run);
+
+  pango_layout_line_unref (line);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+test_get_line (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  GSList *lines, *l;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, "one\ntwo\nthree\nfour\nfive six seven eight nine ten", -1);
+  pango_layout_set_width (layout, 50 * PANGO_SCALE);
+
+  lines = pango_layout_get_lines_readonly (layout);
+  g_assert_cmpint (g_slist_length (lines), ==, pango_layout_get_line_count (layout));
+
+  for (l = lines, i = 0; l; l = l->next, i++)
+    {
+      g_assert_true (pango_layout_get_line_readonly (layout, i) == l->data);
+      g_assert_true (pango_layout_get_line (layout, i) == l->data);
+    }
+
+  g_assert_null (pango_layout_get_line_readonly (layout, -1));
+  g_assert_null (pango_layout_get_line_readonly (layout, i));
+  g_assert_null (pango_layout_get_line (layout, i));
+
+  /* The lines are recomputed after a change */
+  pango_layout_set_text (layout, "one", -1);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 1);
+  g_assert_nonnull (pango_layout_get_line_readonly (layout, 0));
+  g_assert_null (pango_layout_get_line_readonly (layout, 1));
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* The line that pango_layout_xy_to_index() should pick,
+ * found by walking all the lines
+ */
+static PangoLayoutLine *
+find_line_at_y (PangoLayout *layout,
+                int          y,
+                int         *line_x)
+{
+  PangoLayoutIter *iter;
+  PangoLayoutLine *prev_line = NULL;
+  PangoLayoutLine *found = NULL;
+  int prev_last = 0;
+  int prev_x = 0;
+
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      PangoRectangle logical;
+      int first_y, last_y;
+
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      pango_layout_iter_get_line_yrange (iter, &first_y, &last_y);
+
+      if (y < first_y)
+        {
+          if (prev_line && y < prev_last + (first_y - prev_last) / 2)
+            {
+              found = prev_line;
+              *line_x = prev_x;
+            }
+          else
+            {
+              found = pango_layout_iter_get_line_readonly (iter);
+              *line_x = logical.x;
+            }
+        }
+      else if (y < last_y)
+        {
+          found = pango_layout_iter_get_line_readonly (iter);
+          *line_x = logical.x;
+        }
+
+      prev_line = pango_layout_iter_get_line_readonly (iter);
+      prev_last = last_y;
+      prev_x = logical.x;
+    }
+  while (!found && pango_layout_iter_next_line (iter));
+
+  pango_layout_iter_free (iter);
+
+  if (!found)
+    {
+      found = prev_line;
+      *line_x = prev_x;
+    }
+
+  return found;
+}
+
+static void
+test_xy_to_index (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  GString *text;
+  PangoRectangle logical;
+  int i, y;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+
+  text = g_string_new ("");
+  for (i = 0; i < 50; i++)
+    g_string_append_printf (text, "Paragraph %d has a few words in it\n\n", i);
+  pango_layout_set_text (layout, text->str, -1);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_spacing (layout, 3 * PANGO_SCALE);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
+
+  pango_layout_get_extents (layout, NULL, &logical);
+
+  for (y = logical.y - 5 * PANGO_SCALE; y < logical.y + logical.height + 5 * PANGO_SCALE; y += PANGO_SCALE / 2)
+    {
+      PangoLayoutLine *line;
+      int line_x;
+      int index, trailing;
+      int expected_index, expected_trailing;
+
+      line = find_line_at_y (layout, y, &line_x);
+      pango_layout_line_x_to_index (line, 10 * PANGO_SCALE - line_x, &expected_index, &expected_trailing);
+
+      pango_layout_xy_to_index (layout, 10 * PANGO_SCALE, y, &index, &trailing);
+
+      g_assert_cmpint (index, ==, expected_index);
+      g_assert_cmpint (trailing, ==, expected_trailing);
+    }
+
+  /* Index lookups find the line containing the index */
+  for (i = 0; i <= (int) text->len; i++)
+    {
+      int line_nr, x_pos;
+      PangoLayoutLine *line;
+
+      pango_layout_index_to_line_x (layout, i, FALSE, &line_nr, &x_pos);
+      line = pango_layout_get_line_readonly (layout, line_nr);
+
+      g_assert_cmpint (line->start_index, <=, i);
+      if (line_nr + 1 < pango_layout_get_line_count (layout))
+        g_assert_cmpint (pango_layout_get_line_readonly (layout, line_nr + 1)->start_index, >, i);
+    }
+
+  g_string_free (text, TRUE);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+assert_rectangle_equal (const PangoRectangle *r1,
+                        const PangoRectangle *r2)
+{
+  g_assert_cmpint (r1->x, ==, r2->x);
+  g_assert_cmpint (r1->y, ==, r2->y);
+  g_assert_cmpint (r1->width, ==, r2->width);
+  g_assert_cmpint (r1->height, ==, r2->height);
+}
+
+static void
+test_iter_lazy_extents (void)
+{
+  PangoContext *context;
+  PangoLayout *layout, *layout2;
+  PangoLayoutIter *iter, *iter2;
+  GString *text;
+  GArray *baselines, *extents;
+  PangoRectangle logical;
+  int index, trailing;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  text = g_string_new ("");
+  for (i = 0; i < 40; i++)
+    g_string_append_printf (text, "Line %d%s\n", i, i % 3 ? "" : " is longer");
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text->str, -1);
+  pango_layout_set_alignment (layout, PANGO_ALIGN_RIGHT);
+  pango_layout_set_spacing (layout, 2 * PANGO_SCALE);
+
+  layout2 = pango_layout_copy (layout);
+
+  /* Collect the line extents by walking all lines of one layout */
+  baselines = g_array_new (FALSE, FALSE, sizeof (int));
+  extents = g_array_new (FALSE, FALSE, sizeof (PangoRectangle));
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      int baseline = pango_layout_iter_get_baseline (iter);
+
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      g_array_append_val (baselines, baseline);
+      g_array_append_val (extents, logical);
+    }
+  while (pango_layout_iter_next_line (iter));
+  pango_layout_iter_free (iter);
+
+  g_assert_cmpint (baselines->len, ==, pango_layout_get_line_count (layout2));
+
+  /* Only compute some of the lines of the other one, then
+   * walk it with iterators that are copied midway
+   */
+  g_assert_cmpint (pango_layout_get_baseline (layout2), ==, g_array_index (baselines, int, 0));
+  pango_layout_xy_to_index (layout2, 0, g_array_index (extents, PangoRectangle, 5).y, &index, &trailing);
+
+  iter = pango_layout_get_iter (layout2);
+  iter2 = NULL;
+  i = 0;
+  do
+    {
+      if (i == 10)
+        iter2 = pango_layout_iter_copy (iter);
+
+      g_assert_cmpint (pango_layout_iter_get_baseline (iter), ==, g_array_index (baselines, int, i));
+      pango_layout_iter_get_line_extents (iter, NULL, &logical);
+      assert_rectangle_equal (&logical, &g_array_index (extents, PangoRectangle, i));
+      i++;
+    }
+  while (pango_layout_iter_next_line (iter));
+  pango_layout_iter_free (iter);
+
+  g_assert_cmpint (i, ==, baselines->len);
+
+  i = 10;
+  do
+    {
+      pango_layout_iter_get_line_extents (iter2, NULL, &logical);
+      g_assert_cmpint (pango_layout_iter_get_baseline (iter2), ==, g_array_index (baselines, int, i));
+      assert_rectangle_equal (&logical, &g_array_index (extents, PangoRectangle, i));
+      i++;
+    }
+  while (pango_layout_iter_next_line (iter2));
+  pango_layout_iter_free (iter2);
+
+  g_array_unref (baselines);
+  g_array_unref (extents);
+  g_string_free (text, TRUE);
+  g_object_unref (layout2);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static gboolean
+layout_has_attr (PangoLayout   *layout,
+                 PangoAttrType  type)
+{
+  GSList *l, *r, *a;
+
+  for (l = pango_layout_get_lines_readonly (layout); l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+
+      for (r = line->runs; r; r = r->next)
+        {
+          PangoLayoutRun *run = r->data;
+
+          for (a = run->item->analysis.extra_attrs; a; a = a->next)
+            {
+              PangoAttribute *attr = a->data;
+
+              if (attr->klass->type == type)
+                return TRUE;
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+test_measure_only (void)
+{
+  PangoContext *context;
+  PangoLayout *layout, *layout2;
+  PangoRectangle ink, logical, ink2, logical2;
+  const char *markup;
+
+  markup = "<span foreground='red'>Some</span> <u>underlined</u> and "
+           "<span background='blue' letter_spacing='2048'>spaced</span> text";
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, markup, -1);
+  pango_layout_set_width (layout, 60 * PANGO_SCALE);
+  pango_layout_set_justify (layout, TRUE);
+
+  layout2 = pango_layout_copy (layout);
+  pango_layout_set_measure_only (layout2, TRUE);
+  g_assert_true (pango_layout_get_measure_only (layout2));
+
+  pango_layout_get_extents (layout, &ink, &logical);
+  pango_layout_get_extents (layout2, &ink2, &logical2);
+
+  g_assert_cmpint (pango_layout_get_line_count (layout2), ==, pango_layout_get_line_count (layout));
+  assert_rectangle_equal (&ink, &ink2);
+  assert_rectangle_equal (&logical, &logical2);
+
+  g_assert_true (layout_has_attr (layout, PANGO_ATTR_FOREGROUND));
+  g_assert_false (layout_has_attr (layout2, PANGO_ATTR_FOREGROUND));
+  g_assert_false (layout_has_attr (layout2, PANGO_ATTR_BACKGROUND));
+  g_assert_true (layout_has_attr (layout2, PANGO_ATTR_UNDERLINE));
+
+  /* Turning it off formats the layout again, with all attributes */
+  pango_layout_set_measure_only (layout2, FALSE);
+  g_assert_true (layout_has_attr (layout2, PANGO_ATTR_FOREGROUND));
+  g_assert_true (layout_has_attr (layout2, PANGO_ATTR_BACKGROUND));
+
+  g_object_unref (layout2);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+test_measure_labels (void)
+{
+  const char *texts[] = { "Label", "", "A longer label", "Two\nlines", "ﺍﻟﻌﺮﺑﻴﺔ" };
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoRectangle ink[G_N_ELEMENTS (texts)];
+  PangoRectangle logical[G_N_ELEMENTS (texts)];
+  GSList *runs[G_N_ELEMENTS (texts)];
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Cantarell 11");
+
+  pango_layout_measure_labels (context, desc, texts, G_N_ELEMENTS (texts), ink, logical, runs);
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    {
+      PangoLayout *layout;
+      PangoRectangle ink2, logical2;
+      PangoLayoutLine *line;
+      GSList *l, *r;
+      int width;
+
+      layout = pango_layout_new (context);
+      pango_layout_set_font_description (layout, desc);
+      pango_layout_set_single_paragraph_mode (layout, TRUE);
+      pango_layout_set_text (layout, texts[i], -1);
+      pango_layout_get_extents (layout, &ink2, &logical2);
+
+      assert_rectangle_equal (&ink[i], &ink2);
+      assert_rectangle_equal (&logical[i], &logical2);
+
+      /* The runs are copies of those of the line */
+      g_assert_cmpint (pango_layout_get_line_count (layout), ==, 1);
+      line = pango_layout_get_line_readonly (layout, 0);
+      g_assert_cmpint (g_slist_length (runs[i]), ==, g_slist_length (line->runs));
+
+      width = 0;
+      for (l = runs[i], r = line->runs; l; l = l->next, r = r->next)
+        {
+          PangoGlyphItem *run = l->data;
+          PangoGlyphItem *run2 = r->data;
+
+          g_assert_true (run != run2);
+          g_assert_cmpint (run->item->offset, ==, run2->item->offset);
+          g_assert_cmpint (run->item->length, ==, run2->item->length);
+          g_assert_cmpint (run->glyphs->num_glyphs, ==, run2->glyphs->num_glyphs);
+          width += pango_glyph_string_get_width (run->glyphs);
+        }
+      g_assert_cmpint (width, ==, logical[i].width);
+
+      g_slist_free_full (runs[i], (GDestroyNotify) pango_glyph_item_free);
+      g_object_unref (layout);
+    }
+
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
+static void
+test_shape_grid (void)
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+  const char *text;
+  GList *items, *l;
+  int cell_width = 10 * PANGO_SCALE;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  desc = pango_font_description_from_string ("Monospace 11");
+  pango_context_set_font_description (context, desc);
+
+  text = "ls -la e\xcc\x81 日本 ﺄﻧﺍ";
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+  for (l = items; l; l = l->next)
+    {
+      PangoItem *item = l->data;
+      const char *item_text = text + item->offset;
+      PangoGlyphString *glyphs, *shaped;
+      const char *p;
+      int cells;
+
+      glyphs = pango_glyph_string_new ();
+      pango_shape_grid (item_text, item->length, &item->analysis, cell_width, glyphs);
+
+      cells = 0;
+      for (p = item_text; p < item_text + item->length; p = g_utf8_next_char (p))
+        {
+          gunichar wc = g_utf8_get_char (p);
+
+          if (g_unichar_type (wc) != G_UNICODE_NON_SPACING_MARK)
+            cells += g_unichar_iswide (wc) ? 2 : 1;
+        }
+
+      g_assert_cmpint (pango_glyph_string_get_width (glyphs), ==, cells * cell_width);
+
+      /* The glyphs are the same as with shaping */
+      shaped = pango_glyph_string_new ();
+      pango_shape (item_text, item->length, &item->analysis, shaped);
+      g_assert_cmpint (glyphs->num_glyphs, ==, shaped->num_glyphs);
+      for (int i = 0; i < glyphs->num_glyphs; i++)
+        {
+          g_assert_cmpuint (glyphs->glyphs[i].glyph, ==, shaped->glyphs[i].glyph);
+          g_assert_cmpint (glyphs->log_clusters[i], ==, shaped->log_clusters[i]);
+        }
+
+      pango_glyph_string_free (shaped);
+      pango_glyph_string_free (glyphs);
+    }
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+}
+
+static PangoGlyphString *
+shape_text (PangoContext  *context,
+            const char    *text,
+            PangoAttrList *attrs)
+{
+  GList *items;
+  PangoItem *item;
+  PangoGlyphString *glyphs;
+
+  items = pango_itemize (context, text, 0, strlen (text), attrs, NULL);
+  g_assert_cmpint (g_list_length (items), ==, 1);
+  item = items->data;
+
+  glyphs = pango_glyph_string_new ();
+  pango_shape_item (item, text, -1, NULL, glyphs, PANGO_SHAPE_NONE);
+
+  g_list_free_full (items, (GDestroyNotify)pango_item_free);
+
+  return glyphs;
+}
+
+static void
+assert_glyphs_equal (PangoGlyphString *glyphs1,
+                     PangoGlyphString *glyphs2)
+{
+  g_assert_cmpint (glyphs1->num_glyphs, ==, glyphs2->num_glyphs);
+  for (int i = 0; i < glyphs1->num_glyphs; i++)
+    {
+      g_assert_cmpuint (glyphs1->glyphs[i].glyph, ==, glyphs2->glyphs[i].glyph);
+      g_assert_cmpint (glyphs1->glyphs[i].geometry.width, ==, glyphs2->glyphs[i].geometry.width);
+      g_assert_cmpint (glyphs1->log_clusters[i], ==, glyphs2->log_clusters[i]);
+    }
+}
+
+static void
+test_shape_font_cache (void)
+{
+  PangoContext *context;
+  PangoAttrList *attrs;
+  PangoGlyphString *glyphs1, *glyphs2, *glyphs3;
+  const char *text = "Shape the same words, and then shape the same words again";
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  attrs = pango_attr_list_new ();
+  pango_attr_list_insert (attrs, pango_attr_show_new (PANGO_SHOW_SPACES));
+
+  /* Showing spaces must not affect later shaping of the same font */
+  glyphs1 = shape_text (context, text, NULL);
+  glyphs2 = shape_text (context, text, attrs);
+  glyphs3 = shape_text (context, text, NULL);
+
+  assert_glyphs_equal (glyphs1, glyphs3);
+  g_assert_cmpuint (glyphs1->glyphs[5].glyph, !=, glyphs2->glyphs[5].glyph);
+
+  pango_glyph_string_free (glyphs1);
+  pango_glyph_string_free (glyphs2);
+  pango_glyph_string_free (glyphs3);
+  pango_attr_list_unref (attrs);
+  g_object_unref (context);
+}
+
+static void
+assert_surfaces_equal (cairo_surface_t *s1,
+                       cairo_surface_t *s2)
+{
+  int stride = cairo_image_surface_get_stride (s1);
+  int height = cairo_image_surface_get_height (s1);
+
+  cairo_surface_flush (s1);
+  cairo_surface_flush (s2);
+
+  g_assert_cmpint (stride, ==, cairo_image_surface_get_stride (s2));
+  g_assert_cmpint (height, ==, cairo_image_surface_get_height (s2));
+  g_assert_true (memcmp (cairo_image_surface_get_data (s1),
+                         cairo_image_surface_get_data (s2),
+                         stride * height) == 0);
+}
+
+/* Test that batching the glyphs of consecutive runs
+ * in the cairo renderer does not change the output
+ */
+static void
+test_render_batched_runs (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayoutIter *iter;
+  cairo_surface_t *surface1, *surface2;
+  cairo_t *cr;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, "one <b>two</b> three <i>four</i> five <b>six</b>", -1);
+
+  surface1 = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 400, 100);
+  cr = cairo_create (surface1);
+  cairo_move_to (cr, 10, 10);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  surface2 = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 400, 100);
+  cr = cairo_create (surface2);
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      PangoLayoutRun *run = pango_layout_iter_get_run_readonly (iter);
+      PangoRectangle logical;
+
+      if (!run)
+        continue;
+
+      pango_layout_iter_get_run_extents (iter, NULL, &logical);
+      cairo_move_to (cr,
+                     10 + (double) logical.x / PANGO_SCALE,
+                     10 + (double) pango_layout_iter_get_baseline (iter) / PANGO_SCALE);
+      pango_cairo_show_glyph_item (cr, pango_layout_get_text (layout), run);
+    }
+  while (pango_layout_iter_next_run (iter));
+  pango_layout_iter_free (iter);
+  cairo_destroy (cr);
+
+  assert_surfaces_equal (surface1, surface2);
+
+  cairo_surface_destroy (surface1);
+  cairo_surface_destroy (surface2);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+count_glyphs_operation (cairo_surface_t *observer,
+                        cairo_surface_t *target,
+                        void            *data)
+{
+  (*(int *) data)++;
+}
+
+/* Test that consecutive runs with the same font and
+ * color are shown with a single glyphs operation
+ */
+static void
+test_render_batched_runs_count (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  cairo_surface_t *surface, *observer;
+  cairo_t *cr;
+  int n_operations = 0;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+
+  /* Letter spacing splits the runs, but keeps the font */
+  pango_layout_set_markup (layout,
+                           "one <span letter_spacing='1024'>two</span> three "
+                           "<span letter_spacing='2048'>four</span> five",
+                           -1);
+  g_assert_cmpint (g_slist_length (pango_layout_get_line_readonly (layout, 0)->runs), >, 1);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 400, 100);
+  observer = cairo_surface_create_observer (surface, CAIRO_SURFACE_OBSERVER_NORMAL);
+  cairo_surface_observer_add_glyphs_callback (observer, count_glyphs_operation, &n_operations);
+
+  cr = cairo_create (observer);
+  cairo_move_to (cr, 10, 10);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  g_assert_cmpint (n_operations, ==, 1);
+
+  /* A color change ends the batch */
+  n_operations = 0;
+  pango_layout_set_markup (layout, "one two <span foreground='red'>three</span> four", -1);
+
+  cr = cairo_create (observer);
+  cairo_move_to (cr, 10, 10);
+  pango_cairo_show_layout (cr, layout);
+  cairo_destroy (cr);
+
+  g_assert_cmpint (n_operations, ==, 3);
+
+  cairo_surface_destroy (observer);
+  cairo_surface_destroy (surface);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+typedef struct {
+  PangoRenderer parent_instance;
+  int n_glyphs;
+} CountingRenderer;
+
+typedef struct {
+  PangoRendererClass parent_class;
+} CountingRendererClass;
+
+G_DEFINE_TYPE (CountingRenderer, counting_renderer, PANGO_TYPE_RENDERER)
+
+static void
+counting_renderer_draw_glyphs (PangoRenderer    *renderer,
+                               PangoFont        *font,
+                               PangoGlyphString *glyphs,
+                               int               x,
+                               int               y)
+{
+  ((CountingRenderer *) renderer)->n_glyphs += glyphs->num_glyphs;
+}
+
+static void
+counting_renderer_init (CountingRenderer *renderer)
+{
+}
+
+static void
+counting_renderer_class_init (CountingRendererClass *class)
+{
+  PANGO_RENDERER_CLASS (class)->draw_glyphs = counting_renderer_draw_glyphs;
+}
+
+/* Test that lines outside of the visible rectangle are not drawn */
+static void
+test_render_visible_rect (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoRenderer *renderer;
+  PangoRectangle logical, rect;
+  int n_all;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, "one\ntwo\nthree\nfour\nfive\nsix\nseven\neight", -1);
+  pango_layout_get_extents (layout, NULL, &logical);
+
+  renderer = g_object_new (counting_renderer_get_type (), NULL);
+
+  g_assert_false (pango_renderer_get_visible_rect (renderer, NULL));
+
+  pango_renderer_draw_layout (renderer, layout, 0, 0);
+  n_all = ((CountingRenderer *) renderer)->n_glyphs;
+  g_assert_cmpint (n_all, ==, strlen ("onetwothreefourfivesixseveneight"));
+
+  /* Only the first line is visible */
+  rect.x = 0;
+  rect.y = 0;
+  rect.width = logical.width;
+  rect.height = 1;
+  pango_renderer_set_visible_rect (renderer, &rect);
+  g_assert_true (pango_renderer_get_visible_rect (renderer, &rect));
+  g_assert_cmpint (rect.height, ==, 1);
+
+  ((CountingRenderer *) renderer)->n_glyphs = 0;
+  pango_renderer_draw_layout (renderer, layout, 0, 0);
+  g_assert_cmpint (((CountingRenderer *) renderer)->n_glyphs, ==, strlen ("one"));
+
+  /* Nothing is visible */
+  rect.y = - 10 * logical.height;
+  pango_renderer_set_visible_rect (renderer, &rect);
+
+  ((CountingRenderer *) renderer)->n_glyphs = 0;
+  pango_renderer_draw_layout (renderer, layout, 0, 0);
+  g_assert_cmpint (((CountingRenderer *) renderer)->n_glyphs, ==, 0);
+
+  pango_renderer_set_visible_rect (renderer, NULL);
+
+  ((CountingRenderer *) renderer)->n_glyphs = 0;
+  pango_renderer_draw_layout (renderer, layout, 0, 0);
+  g_assert_cmpint (((CountingRenderer *) renderer)->n_glyphs, ==, n_all);
+
+  g_object_unref (renderer);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+test_export_glyphs (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoGlyphExport buffer = { 0, };
+  PangoGlyph glyphs[64];
+  guint16 glyph_fonts[64], glyph_colors[64], trapezoid_colors[8];
+  double glyph_x[64], glyph_y[64], trapezoids[6 * 8];
+  PangoFont *fonts[8];
+  PangoColor colors[8];
+  guint16 alphas[8];
+  gboolean ret;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, "ab<span color='red' underline='single'>cd</span>ef", -1);
+
+  /* Everything is too small */
+  ret = pango_layout_export_glyphs (layout, 0, 0, &buffer);
+  g_assert_false (ret);
+  g_assert_cmpuint (buffer.n_glyphs, ==, 6);
+  g_assert_cmpuint (buffer.n_trapezoids, >, 0);
+  g_assert_cmpuint (buffer.n_fonts, ==, 1);
+  g_assert_cmpuint (buffer.n_colors, ==, 1);
+
+  buffer.max_glyphs = G_N_ELEMENTS (glyphs);
+  buffer.glyphs = glyphs;
+  buffer.glyph_fonts = glyph_fonts;
+  buffer.glyph_colors = glyph_colors;
+  buffer.glyph_x = glyph_x;
+  buffer.glyph_y = glyph_y;
+  buffer.max_trapezoids = G_N_ELEMENTS (trapezoid_colors);
+  buffer.trapezoids = trapezoids;
+  buffer.trapezoid_colors = trapezoid_colors;
+  buffer.max_fonts = G_N_ELEMENTS (fonts);
+  buffer.fonts = fonts;
+  buffer.max_colors = G_N_ELEMENTS (colors);
+  buffer.colors = colors;
+  buffer.alphas = alphas;
+
+  ret = pango_layout_export_glyphs (layout, 0, 0, &buffer);
+  g_assert_true (ret);
+  g_assert_cmpuint (buffer.n_glyphs, ==, 6);
+  g_assert_cmpuint (buffer.n_fonts, ==, 1);
+  g_assert_cmpuint (buffer.n_colors, ==, 1);
+
+  g_assert_true (PANGO_IS_FONT (fonts[0]));
+  g_assert_cmpuint (colors[0].red, ==, 0xffff);
+  g_assert_cmpuint (colors[0].green, ==, 0);
+
+  for (int i = 0; i < 6; i++)
+    {
+      g_assert_cmpuint (glyph_fonts[i], ==, 0);
+      g_assert_cmpuint (glyph_colors[i], ==, (i == 2 || i == 3) ? 0 : PANGO_GLYPH_EXPORT_NO_COLOR);
+      g_assert_cmpfloat (glyph_y[i], ==, glyph_y[0]);
+      if (i > 0)
+        g_assert_cmpfloat (glyph_x[i], >, glyph_x[i - 1]);
+    }
+
+  for (int i = 0; i < buffer.n_trapezoids; i++)
+    g_assert_cmpuint (trapezoid_colors[i], ==, 0);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+#ifdef HAVE_CAIRO_FREETYPE
+static void
+render_ft2 (PangoFontMap *fontmap,
+            const char   *text,
+            FT_Bitmap    *bitmap)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+
+  bitmap->rows = 50;
+  bitmap->width = 400;
+  bitmap->pitch = 400;
+  bitmap->pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap->num_grays = 256;
+  bitmap->buffer = g_malloc0 (bitmap->rows * bitmap->pitch);
+
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+  pango_ft2_render_layout (bitmap, layout, 0, 0);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that glyphs that are evicted from the
+ * FT2 glyph cache are rendered the same way again
+ */
+static void
+test_ft2_glyph_cache (void)
+{
+  PangoFontMap *fontmap;
+  FT_Bitmap bitmap1, bitmap2, bitmap3;
+  const char *text = "The quick brown fox jumps over the lazy dog";
+  gsize size;
+  guint hits, misses, evictions;
+
+  fontmap = pango_ft2_font_map_new ();
+
+  render_ft2 (fontmap, text, &bitmap1);
+  pango_ft2_font_map_get_glyph_cache_stats (PANGO_FT2_FONT_MAP (fontmap), &size, &hits, &misses, &evictions);
+  g_assert_cmpuint (size, >, 0);
+  g_assert_cmpuint (misses, >, 0);
+  g_assert_cmpuint (evictions, ==, 0);
+
+  /* The second time, all glyphs are cached */
+  render_ft2 (fontmap, text, &bitmap2);
+  pango_ft2_font_map_get_glyph_cache_stats (PANGO_FT2_FONT_MAP (fontmap), NULL, &hits, NULL, NULL);
+  g_assert_cmpuint (hits, >=, strlen (text) - 8);
+
+  pango_ft2_font_map_set_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap), 0);
+  pango_ft2_font_map_get_glyph_cache_stats (PANGO_FT2_FONT_MAP (fontmap), &size, NULL, NULL, &evictions);
+  g_assert_cmpuint (size, ==, 0);
+  g_assert_cmpuint (evictions, >, 0);
+  render_ft2 (fontmap, text, &bitmap3);
+
+  g_assert_true (memcmp (bitmap1.buffer, bitmap2.buffer, bitmap1.rows * bitmap1.pitch) == 0);
+  g_assert_true (memcmp (bitmap1.buffer, bitmap3.buffer, bitmap1.rows * bitmap1.pitch) == 0);
+
+  g_free (bitmap1.buffer);
+  g_free (bitmap2.buffer);
+  g_free (bitmap3.buffer);
+  g_object_unref (fontmap);
+}
+#endif
+
+#ifdef HAVE_CAIRO_FREETYPE
+static void
+render_ft2_markup (PangoFontMap *fontmap,
+                   const char   *markup,
+                   guchar        background,
+                   FT_Bitmap    *bitmap)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+
+  /* An odd width, so vectorized code has leftovers */
+  bitmap->rows = 60;
+  bitmap->width = 397;
+  bitmap->pitch = 400;
+  bitmap->pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap->num_grays = 256;
+  bitmap->buffer = g_malloc (bitmap->rows * bitmap->pitch);
+
+  for (int i = 0; i < bitmap->rows * bitmap->pitch; i++)
+    bitmap->buffer[i] = background ? (background + i * 7) % 256 : 0;
+
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout, markup, -1);
+  pango_ft2_render_layout (bitmap, layout, 3, 5);
+  /* Draw again, overlapping, so coverage saturates */
+  pango_ft2_render_layout (bitmap, layout, 4, 5);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Test that compositing glyphs and trapezoids is a
+ * saturating add, by comparing against the scalar result
+ */
+static void
+test_ft2_composite (void)
+{
+  PangoFontMap *fontmap;
+  FT_Bitmap bitmap1, bitmap2;
+  const char *markup = "<span size='24pt'>Wa<u>ter</u> <s>and</s> <u>oil</u></span>";
+  gboolean has_ink = FALSE;
+
+  fontmap = pango_ft2_font_map_new ();
+
+  render_ft2_markup (fontmap, markup, 0, &bitmap1);
+  render_ft2_markup (fontmap, markup, 100, &bitmap2);
+
+  for (int i = 0; i < bitmap1.rows * bitmap1.pitch; i++)
+    {
+      int background = (100 + i * 7) % 256;
+
+      if (i % bitmap1.pitch >= bitmap1.width)
+        continue;
+
+      if (bitmap1.buffer[i] != 0)
+        has_ink = TRUE;
+
+      g_assert_cmpint (bitmap2.buffer[i], ==, MIN (background + bitmap1.buffer[i], 255));
+    }
+
+  g_assert_true (has_ink);
+
+  g_free (bitmap1.buffer);
+  g_free (bitmap2.buffer);
+  g_object_unref (fontmap);
+}
+#endif
+
+#ifdef HAVE_CAIRO_FREETYPE
+/* Test that rendering in bands gives the same result */
+static void
+test_ft2_render_tiled (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  FT_Bitmap bitmap1, bitmap2;
+  GString *markup;
+
+  fontmap = pango_ft2_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+
+  markup = g_string_new ("");
+  for (int i = 0; i < 40; i++)
+    g_string_append_printf (markup, "Line %d with <u>underlined</u> and <s>struck</s> text\n", i);
+  pango_layout_set_markup (layout, markup->str, -1);
+  g_string_free (markup, TRUE);
+
+  bitmap1.rows = 700;
+  bitmap1.width = 300;
+  bitmap1.pitch = 300;
+  bitmap1.pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap1.num_grays = 256;
+  bitmap1.buffer = g_malloc0 (bitmap1.rows * bitmap1.pitch);
+
+  bitmap2 = bitmap1;
+  bitmap2.buffer = g_malloc0 (bitmap2.rows * bitmap2.pitch);
+
+  pango_ft2_render_layout (&bitmap1, layout, 2, -7);
+  pango_ft2_render_layout_tiled (&bitmap2, layout, 2, -7, 7);
+
+  g_assert_true (memcmp (bitmap1.buffer, bitmap2.buffer, bitmap1.rows * bitmap1.pitch) == 0);
+
+  g_free (bitmap1.buffer);
+  g_free (bitmap2.buffer);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+#endif
+
+#ifdef HAVE_CAIRO_FREETYPE
+/* Test that glyph extents survive rendering and eviction
+ * of the glyph, and work for glyphs on different pages
+ */
+static void
+test_ft2_glyph_extents (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  PangoRectangle ink[3], logical[3];
+  PangoGlyph glyphs[] = { 1, 300, 1000, PANGO_GET_UNKNOWN_GLYPH (0x1234) };
+  FT_Bitmap bitmap;
+
+  fontmap = pango_ft2_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Cantarell 11");
+  font = pango_font_map_load_font (fontmap, context, desc);
+
+  for (int i = 0; i < G_N_ELEMENTS (glyphs); i++)
+    {
+      pango_font_get_glyph_extents (font, glyphs[i], &ink[0], &logical[0]);
+      pango_font_get_glyph_extents (font, glyphs[i], &ink[1], &logical[1]);
+
+      pango_ft2_font_map_set_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap), 0);
+      render_ft2 (fontmap, "abc", &bitmap);
+      g_free (bitmap.buffer);
+
+      pango_font_get_glyph_extents (font, glyphs[i], &ink[2], &logical[2]);
+
+      assert_rectangle_equal (&ink[0], &ink[1]);
+      assert_rectangle_equal (&ink[0], &ink[2]);
+      assert_rectangle_equal (&logical[0], &logical[1]);
+      assert_rectangle_equal (&logical[0], &logical[2]);
+    }
+
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -853,6 +2001,26 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/wrap-char", test_wrap_char);
   g_test_add_func ("/matrix/transform-rectangle", test_transform_rectangle);
   g_test_add_func ("/itemize/small-caps-crash", test_small_caps_crash);
+  g_test_add_func ("/layout/markup-cache", test_markup_cache);
+  g_test_add_func ("/layout/wrap-optimal", test_wrap_optimal);
+  g_test_add_func ("/layout/line-ref-relayout", test_line_ref_relayout);
+  g_test_add_func ("/layout/get-line", test_get_line);
+  g_test_add_func ("/layout/xy-to-index", test_xy_to_index);
+  g_test_add_func ("/layout/iter-lazy-extents", test_iter_lazy_extents);
+  g_test_add_func ("/layout/measure-only", test_measure_only);
+  g_test_add_func ("/layout/measure-labels", test_measure_labels);
+  g_test_add_func ("/shape/grid", test_shape_grid);
+  g_test_add_func ("/shape/font-cache", test_shape_font_cache);
+  g_test_add_func ("/render/batched-runs", test_render_batched_runs);
+  g_test_add_func ("/render/batched-runs-count", test_render_batched_runs_count);
+  g_test_add_func ("/render/visible-rect", test_render_visible_rect);
+  g_test_add_func ("/layout/export-glyphs", test_export_glyphs);
+#ifdef HAVE_CAIRO_FREETYPE
+  g_test_add_func ("/ft2/glyph-cache", test_ft2_glyph_cache);
+  g_test_add_func ("/ft2/composite", test_ft2_composite);
+  g_test_add_func ("/ft2/render-tiled", test_ft2_render_tiled);
+  g_test_add_func ("/ft2/glyph-extents", test_ft2_glyph_extents);
+#endif
 
   return g_test_run ();
 }
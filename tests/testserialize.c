@@ -465,6 +465,323 @@ install_fonts (void)
   g_free (dir);
 }
 
+static void
+test_serialize_layout_binary (void)
+{
+  const char *test =
+    "{\n"
+    "  \"text\" : \"Some fun with layouts!\\nAnd a second paragraph.\",\n"
+    "  \"attributes\" : [\n"
+    "    {\n"
+    "      \"end\" : 4,\n"
+    "      \"type\" : \"foreground\",\n"
+    "      \"value\" : \"#ffff00000000\"\n"
+    "    },\n"
+    "    {\n"
+    "      \"start\" : 5,\n"
+    "      \"end\" : 8,\n"
+    "      \"type\" : \"weight\",\n"
+    "      \"value\" : \"bold\"\n"
+    "    },\n"
+    "    {\n"
+    "      \"start\" : 14,\n"
+    "      \"type\" : \"scale\",\n"
+    "      \"value\" : 1.5\n"
+    "    }\n"
+    "  ],\n"
+    "  \"font\" : \"Sans 16\",\n"
+    "  \"alignment\" : \"center\",\n"
+    "  \"width\" : 100000,\n"
+    "  \"line-spacing\" : 1.5\n"
+    "}\n";
+
+  PangoContext *context;
+  GBytes *bytes;
+  GBytes *binary;
+  GBytes *json, *json2;
+  PangoLayout *layout, *layout2;
+  GError *error = NULL;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  bytes = g_bytes_new_static (test, strlen (test) + 1);
+  layout = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+  g_assert_no_error (error);
+
+  binary = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_BINARY |
+                                           PANGO_LAYOUT_SERIALIZE_CONTEXT |
+                                           PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  layout2 = pango_layout_deserialize (context, binary, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_assert_true (PANGO_IS_LAYOUT (layout2));
+
+  /* The restored output must match the original one */
+  json = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  json2 = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_cmpstr (g_bytes_get_data (json, NULL), ==, g_bytes_get_data (json2, NULL));
+
+  g_bytes_unref (json);
+  g_bytes_unref (json2);
+  g_object_unref (layout2);
+
+  /* Truncated data is rejected */
+  {
+    GBytes *truncated = g_bytes_new_from_bytes (binary, 0, g_bytes_get_size (binary) / 2);
+
+    layout2 = pango_layout_deserialize (context, truncated, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+    g_assert_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID);
+    g_assert_null (layout2);
+    g_clear_error (&error);
+    g_bytes_unref (truncated);
+  }
+
+  /* Out-of-range enums, counts and offsets are either rejected
+   * or give a layout that can be serialized again. We only touch
+   * small values, to leave text, sizes and colors alone.
+   */
+  {
+    gsize size;
+    const guint32 *words = g_bytes_get_data (binary, &size);
+
+    for (gsize i = 0; i < size / 4; i++)
+      {
+        guint32 *copy;
+        GBytes *corrupted;
+
+        if (words[i] >= 256)
+          continue;
+
+        copy = g_memdup2 (words, size);
+        copy[i] = 0x7fffff7f;
+        corrupted = g_bytes_new_take (copy, size);
+
+        layout2 = pango_layout_deserialize (context, corrupted, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+        if (layout2)
+          {
+            json = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+            g_bytes_unref (json);
+            g_object_unref (layout2);
+          }
+        g_clear_error (&error);
+        g_bytes_unref (corrupted);
+      }
+  }
+
+  g_bytes_unref (binary);
+  g_bytes_unref (bytes);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+/* Replace the value of the first occurrence of @member in @str with @value */
+static char *
+replace_member (const char *str,
+                const char *member,
+                const char *value)
+{
+  const char *start, *end;
+  char *key;
+  GString *s;
+
+  key = g_strdup_printf ("\"%s\" : ", member);
+  start = strstr (str, key);
+  g_assert_nonnull (start);
+  start += strlen (key);
+  g_free (key);
+
+  end = start;
+  if (*end == '"')
+    end = strchr (end + 1, '"') + 1;
+  else
+    end += strspn (end, "-0123456789");
+
+  s = g_string_new_len (str, start - str);
+  g_string_append (s, value);
+  g_string_append (s, end);
+
+  return g_string_free (s, FALSE);
+}
+
+static void
+test_serialize_layout_output (void)
+{
+  const char *test =
+    "{\n"
+    "  \"text\" : \"Some fun with layouts!\",\n"
+    "  \"font\" : \"Cantarell 11\",\n"
+    "  \"width\" : 60000\n"
+    "}\n";
+
+  PangoContext *context;
+  GBytes *bytes;
+  GBytes *out;
+  PangoLayout *layout, *layout2;
+  char *str, *str2;
+  GError *error = NULL;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  bytes = g_bytes_new_static (test, strlen (test) + 1);
+  layout = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+  g_assert_no_error (error);
+  g_bytes_unref (bytes);
+
+  out = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_CONTEXT |
+                                        PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  /* The stored output is used as-is, so a modified glyph
+   * must show up in the deserialized layout
+   */
+  str = replace_member (g_bytes_get_data (out, NULL), "glyph", "12345");
+  bytes = g_bytes_new_take (str, strlen (str) + 1);
+
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (pango_layout_get_line_count (layout2), ==, pango_layout_get_line_count (layout));
+  g_bytes_unref (out);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_nonnull (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_object_unref (layout2);
+
+  /* Without the flag, the layout is formatted again */
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+  g_assert_no_error (error);
+  g_bytes_unref (out);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_null (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_object_unref (layout2);
+
+  /* If the fonts don't match, the output is ignored */
+  str2 = replace_member (g_bytes_get_data (bytes, NULL), "checksum", "\"0000\"");
+  g_bytes_unref (bytes);
+  bytes = g_bytes_new_take (str2, strlen (str2) + 1);
+
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_bytes_unref (out);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_null (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_object_unref (layout2);
+  g_bytes_unref (bytes);
+
+  /* Without the context, the output is ignored too */
+  str = replace_member (g_bytes_get_data (out, NULL), "glyph", "12345");
+  bytes = g_bytes_new_take (str, strlen (str) + 1);
+
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_bytes_unref (out);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_null (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_object_unref (layout2);
+
+  g_bytes_unref (out);
+  g_bytes_unref (bytes);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static void
+test_serialize_layout_output_context (void)
+{
+  const char *test =
+    "{\n"
+    "  \"text\" : \"Some fun with layouts!\",\n"
+    "  \"font\" : \"Cantarell 11.3\",\n"
+    "  \"width\" : 60000\n"
+    "}\n";
+
+  PangoContext *context, *context2, *context3;
+  PangoMatrix matrix = PANGO_MATRIX_INIT;
+  cairo_font_options_t *options;
+  GBytes *bytes;
+  GBytes *out;
+  GBytes *json, *json2;
+  PangoLayout *layout, *layout2, *layout3;
+  char *str;
+  GError *error = NULL;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  context2 = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  pango_matrix_scale (&matrix, 2, 2);
+  pango_context_set_matrix (context2, &matrix);
+  context3 = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  bytes = g_bytes_new_static (test, strlen (test) + 1);
+  layout = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+  g_assert_no_error (error);
+  g_bytes_unref (bytes);
+
+  /* Output that was computed for an untransformed context
+   * is not used for a transformed one
+   */
+  out = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_CONTEXT |
+                                        PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  str = replace_member (g_bytes_get_data (out, NULL), "glyph", "12345");
+  bytes = g_bytes_new_take (str, strlen (str) + 1);
+  g_bytes_unref (out);
+
+  layout2 = pango_layout_deserialize (context2, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_null (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_bytes_unref (out);
+  g_object_unref (layout2);
+
+  /* The same context still gets the stored output */
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_nonnull (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_bytes_unref (out);
+  g_object_unref (layout2);
+
+  /* Font options change glyph advances, so output is
+   * not used for a context with different options
+   */
+  options = cairo_font_options_create ();
+  cairo_font_options_set_hint_metrics (options, CAIRO_HINT_METRICS_ON);
+  pango_cairo_context_set_font_options (context3, options);
+  cairo_font_options_destroy (options);
+
+  layout2 = pango_layout_deserialize (context3, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  out = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_null (strstr (g_bytes_get_data (out, NULL), "\"glyph\" : 12345,"));
+  g_bytes_unref (out);
+  g_object_unref (layout2);
+  g_bytes_unref (bytes);
+
+  /* Binary output from a context that does not round glyph
+   * positions is formatted again for one that does
+   */
+  pango_context_set_round_glyph_positions (context, FALSE);
+  pango_layout_context_changed (layout);
+  out = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_BINARY |
+                                        PANGO_LAYOUT_SERIALIZE_CONTEXT |
+                                        PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  pango_context_set_round_glyph_positions (context, TRUE);
+  layout2 = pango_layout_deserialize (context, out, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  layout3 = pango_layout_copy (layout2);
+
+  json = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  json2 = pango_layout_serialize (layout3, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_cmpstr (g_bytes_get_data (json, NULL), ==, g_bytes_get_data (json2, NULL));
+
+  g_bytes_unref (json);
+  g_bytes_unref (json2);
+  g_object_unref (layout3);
+  g_object_unref (layout2);
+  g_bytes_unref (out);
+  g_object_unref (layout);
+  g_object_unref (context3);
+  g_object_unref (context2);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -479,6 +796,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/serialize/layout/valid", test_serialize_layout_valid);
   g_test_add_func ("/serialize/layout/context", test_serialize_layout_context);
   g_test_add_func ("/serialize/layout/invalid", test_serialize_layout_invalid);
+  g_test_add_func ("/serialize/layout/binary", test_serialize_layout_binary);
+  g_test_add_func ("/serialize/layout/output", test_serialize_layout_output);
+  g_test_add_func ("/serialize/layout/output-context", test_serialize_layout_output_context);
 
   return g_test_run ();
 }
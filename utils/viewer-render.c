@@ -886,7 +886,7 @@ parse_options (int argc, char *argv[])
     {"width",		'w', 0, G_OPTION_ARG_INT,			&opt_width,
      "Width in points to which to wrap lines or ellipsize",	    "points"},
     {"wrap",		0, 0, G_OPTION_ARG_CALLBACK,			&parse_wrap,
-     "Text wrapping mode (needs a width to be set)",   "word/char/word-char"},
+     "Text wrapping mode (needs a width to be set)",   "word/char/word-char/optimal"},
     {"serialized",       0, 0, G_OPTION_ARG_NONE,                        &opt_serialized,
      "Create layout from a serialized file",                            NULL},
     {NULL}